@@ -1,18 +1,28 @@
 #include "./backend.h"
 
-FSM FiniteStateMachine(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock) {
-  static FSM game_state = GAME_START;
+#include <string.h>
+
+#include "./frame.h"
+#include "./leaderboard.h"
+#include "./persist.h"
+#include "./rng.h"
+
+static _Thread_local EngineContext_t* bound_context = NULL;
 
+FSM FiniteStateMachine(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock) {
   if (!CurrentState || !CurrentBlock) {
     return GAME_OVER;
   }
 
+  FSM* game_state_ptr = &getEngineContext(false)->fsm;
+  FSM game_state = *game_state_ptr;
+
   switch (game_state) {
     case GAME_START:
       game_state = on_game_start(CurrentState);
       break;
     case MOVING:
-      game_state = move_down(CurrentState, CurrentBlock);
+      game_state = apply_gravity(CurrentState, CurrentBlock);
       break;
     case SPAWN:
       game_state = on_game_spawn(CurrentState, CurrentBlock);
@@ -26,6 +36,7 @@ FSM FiniteStateMachine(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock) {
     default:
       break;
   }
+  *game_state_ptr = game_state;
   return game_state;
 }
 
@@ -50,6 +61,11 @@ void userInput(UserAction_t action, bool hold) {
     clear_temporary_figure(CurrentState);
   }
 
+  apply_user_action(CurrentState, CurrentBlock, action);
+}
+
+void apply_user_action(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock,
+                       UserAction_t action) {
   switch (action) {
     case Start:
       CurrentState->pause = PAUSE_OFF;
@@ -59,7 +75,13 @@ void userInput(UserAction_t action, bool hold) {
       break;
     case Terminate:
       CurrentState->pause = STOP;
-      save_record(CurrentState->score, CurrentState->high_score);
+      if (getEngineContext(false)->persist) {
+        save_record(CurrentState->score, CurrentState->high_score);
+        // После GAME_OVER партия уже в таблице
+        if (getEngineContext(false)->fsm != GAME_START) {
+          submit_result(CurrentState);
+        }
+      }
       break;
     case Left:
       move_left(CurrentState, CurrentBlock);
@@ -71,7 +93,6 @@ void userInput(UserAction_t action, bool hold) {
       rotate_figure(CurrentState, CurrentBlock);
       break;
     case Down:
-      hold = true;
       move_down(CurrentState, CurrentBlock);
       break;
     case Action:
@@ -107,12 +128,23 @@ GameInfo_t* getCurrentState() {
     initialized = true;
   }
 
+  int best;
+  if (persist_best_take(&best)) {
+    CurrentState->high_score = update_record(best, CurrentState->high_score);
+  }
+
   GameBlock_t* CurrentBlock = getCurrentBlock(false);
   if (CurrentBlock) {
     clear_temporary_figure(CurrentState);
 
-    if (GameTimer(CurrentState->level, CurrentState->pause)) {
-      FiniteStateMachine(CurrentState, CurrentBlock);
+    // За один вызов может набежать несколько тиков, ни один не теряется
+    for (int ticks = GameTimer(CurrentState->level, CurrentState->pause);
+         ticks > 0; ticks--) {
+      engine_tick(CurrentState, CurrentBlock);
+
+      TetrisFrame_t frame;
+      frame_capture(CurrentState, CurrentBlock, &frame);
+      frame_history_push(getFrameHistory(false), &frame);
     }
 
     draw_temporary_figure(CurrentState, CurrentBlock);
@@ -121,6 +153,50 @@ GameInfo_t* getCurrentState() {
   return CurrentState;
 }
 
+void engine_tick(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock) {
+  FiniteStateMachine(CurrentState, CurrentBlock);
+  getEngineContext(false)->tick++;
+}
+
+uint32_t getCurrentTick() { return getEngineContext(false)->tick; }
+
+EngineContext_t* getEngineContext(bool reset) {
+  static EngineContext_t context;
+  static bool initialized = false;
+
+  if (bound_context) {
+    if (reset) engine_context_init(bound_context, 0, RNG_UNIFORM);
+    return bound_context;
+  }
+  if (!initialized || reset) {
+    engine_context_init(&context, 0, RNG_UNIFORM);
+    initialized = true;
+  }
+  return &context;
+}
+
+EngineContext_t* engine_bind(EngineContext_t* context) {
+  EngineContext_t* previous = bound_context;
+  bound_context = context;
+  return previous;
+}
+
+void engine_context_init(EngineContext_t* context, uint64_t seed,
+                         PieceRngMode mode) {
+  context->fsm = GAME_START;
+  piece_rng_seed(&context->rng, seed, mode);
+  context->tick = 0;
+  context->lines = 0;
+  context->pieces = 0;
+  context->checksum = 0;
+  context->persist = true;
+  context->game_start_tick = 0;
+  context->game_start_lines = 0;
+  context->gravity = 0;
+}
+
+PieceRng_t* getPieceRng(bool reset) { return &getEngineContext(reset)->rng; }
+
 void free_resourse() {
   GameInfo_t* CurrentState = getCurrentState();
   GameBlock_t* CurrentBlock = getCurrentBlock(false);
@@ -142,10 +218,18 @@ FSM on_attaching(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock) {
     game_state = MOVING;
   } else {
     game_state = foo_attaching(CurrentState, CurrentBlock);
-    CurrentState->score += count_score(clear_full_lines(CurrentState->field));
+    int lines = clear_full_lines(CurrentState->field);
+    CurrentState->score += count_score(lines);
     CurrentState->level = lvl_up(CurrentState->score);
     CurrentState->high_score =
         update_record(CurrentState->score, CurrentState->high_score);
+
+    EngineContext_t* context = getEngineContext(false);
+    TetrisFrame_t frame;
+    frame_capture(CurrentState, NULL, &frame);
+    context->lines += (uint32_t)lines;
+    context->pieces++;
+    context->checksum = frame_checksum(&frame, context->checksum);
   }
   return game_state;
 }
@@ -162,42 +246,127 @@ FSM on_game_start(GameInfo_t* CurrentState) {
   prepare_next_figure(CurrentState);
   CurrentState->level = 0;
   CurrentState->score = 0;
+
+  EngineContext_t* context = getEngineContext(false);
+  context->game_start_tick = context->tick;
+  context->game_start_lines = context->lines;
   return SPAWN;
 }
 
 FSM on_game_over(GameInfo_t* CurrentState) {
-  if (CurrentState->score >= CurrentState->high_score) {
+  if (CurrentState->score >= CurrentState->high_score &&
+      getEngineContext(false)->persist) {
     // CurrentState->high_score = CurrentState->score;
     save_record(CurrentState->score, CurrentState->high_score);
   }
+  if (getEngineContext(false)->persist) submit_result(CurrentState);
 
   CurrentState->pause = PREVIEW;
 
   return GAME_START;
 }
 
+void submit_result(const GameInfo_t* CurrentState) {
+  EngineContext_t* context = getEngineContext(false);
+  LeaderboardEntry_t entry;
+  memset(&entry, 0, sizeof(entry));
+  const char* player = getenv("USER");
+  snprintf(entry.player, sizeof(entry.player), "%s",
+           player && player[0] ? player : "player");
+  entry.score = CurrentState->score;
+  entry.lines = context->lines - context->game_start_lines;
+  entry.level = (uint32_t)CurrentState->level;
+  entry.duration = context->tick - context->game_start_tick;
+  entry.replay_id = context->rng.seed;
+  persist_result_async(context->rng.mode, &entry);
+}
+
 int update_record(int score, int record) {
   return score > record ? score : record;
 }
 
 void save_record(int score, int record) {
   if (score == record) {
-    FILE* file = fopen("./high_score.txt", "w");
-    if (file) {
-      fprintf(file, "%d", score);
-      fclose(file);
-    }
+    persist_record_async(score);
   }
 }
 
 int lvl_up(int score) {
   int lvl = score / 600;
-  if (lvl > 10) {
-    lvl = 10;
+  if (lvl > GAME_LEVEL_MAX) {
+    lvl = GAME_LEVEL_MAX;
   }
   return lvl;
 }
 
+uint32_t level_gravity(int level) {
+  // После 10 уровня тик не короче 50 мс, скорость растёт за счёт клеток
+  static const uint32_t HIGH_LEVELS[] = {128,  192,  256,  384, 512,
+                                         768, 1024, 1536, 2560};
+  const int count = (int)(sizeof(HIGH_LEVELS) / sizeof(HIGH_LEVELS[0]));
+  if (level <= GAME_LEVEL_CLASSIC) return GRAVITY_ONE;
+  if (level - GAME_LEVEL_CLASSIC > count) return GRAVITY_20G;
+  return HIGH_LEVELS[level - GAME_LEVEL_CLASSIC - 1];
+}
+
+int gravity_cells(uint32_t gravity, uint32_t tick) {
+  uint64_t before = (uint64_t)gravity * tick / GRAVITY_ONE;
+  uint64_t after = (uint64_t)gravity * ((uint64_t)tick + 1) / GRAVITY_ONE;
+  return (int)(after - before);
+}
+
+int drop_distance(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock) {
+  TetrominoState coords =
+      blockState(CurrentBlock->name, CurrentBlock->rotation);
+  int distance = GAME_FIELD_HEIGHT;
+
+  for (int i = 0; i < 4; i++) {
+    int row = CurrentBlock->x + coords.blocks[i].x;
+    int col = CurrentBlock->y + coords.blocks[i].y;
+    if (col < 0 || col >= GAME_FIELD_WIDTH) return 0;
+
+    // Считаем только нижнюю клетку фигуры в каждом столбце
+    bool lowest = true;
+    for (int j = 0; j < 4; j++) {
+      if (coords.blocks[j].y == coords.blocks[i].y &&
+          coords.blocks[j].x > coords.blocks[i].x) {
+        lowest = false;
+      }
+    }
+    if (!lowest) continue;
+
+    int free = 0;
+    for (int r = row + 1; free < distance && r < GAME_FIELD_HEIGHT &&
+                          (r < 0 || CurrentState->field[r][col] <= 0);
+         r++) {
+      free++;
+    }
+    if (free < distance) distance = free;
+  }
+  return distance;
+}
+
+FSM apply_gravity(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock) {
+  FSM state = MOVING;
+
+  if (CurrentState && CurrentBlock && !CurrentState->pause) {
+    EngineContext_t* context = getEngineContext(false);
+    uint32_t gravity = context->gravity ? context->gravity
+                                        : level_gravity(CurrentState->level);
+    int cells = gravity_cells(gravity, context->tick);
+
+    if (cells > 0) {
+      int distance = drop_distance(CurrentState, CurrentBlock);
+      if (distance == 0) {
+        state = ATTACHING;
+      } else {
+        CurrentBlock->x += cells < distance ? cells : distance;
+      }
+    }
+  }
+  return state;
+}
+
 // Переписать все функции чтобы они возвращали состояние конечного автомата
 // Изменение скорости
 int count_score(int lines) {
@@ -254,13 +423,9 @@ bool check_collision(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock,
 }
 
 FSM fall_down(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock) {
-  FSM state = move_down(CurrentState, CurrentBlock);
-  int i = 0;
-  while (state == MOVING && i < GAME_FIELD_HEIGHT) {
-    state = move_down(CurrentState, CurrentBlock);
-    i++;
-  }
-  return state;
+  if (!CurrentState || !CurrentBlock || CurrentState->pause) return MOVING;
+  CurrentBlock->x += drop_distance(CurrentState, CurrentBlock);
+  return ATTACHING;
 }
 
 FSM move_left(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock) {
@@ -318,26 +483,57 @@ TetrominoState blockState(int BlockType, int BlockState) {
              {{{1, -1}, {0, 0}, {1, 0}, {0, 1}}},
              {{{-1, 0}, {0, 0}, {0, 1}, {1, 1}}},    //
              {{{1, -1}, {0, 0}, {1, 0}, {0, 1}}}}};  //
+  if (BlockType < I || BlockType > Z || BlockState < 0 || BlockState > 3) {
+    return (TetrominoState){0};
+  }
   return TETRIMINOS[BlockType][BlockState];
 }
 
-int GameTimer(int level, int pause) {
-  int flag = 0;
-  static struct timespec lastTime = {0, 0};
-  struct timespec now;
-  clock_gettime(CLOCK_MONOTONIC, &now);
+static GameClock_t* game_clock() {
+  static GameClock_t clock = {0, false};
+  return &clock;
+}
 
-  int interval = 1000 / (1 + level * 0.5);
-  if (interval < 50) interval = 50;
+uint64_t game_tick_interval(int level) {
+  if (level > GAME_LEVEL_CLASSIC) return GAME_TICK_MIN_NS;
+  // 1000 / (1 + level / 2) мс в целых наносекундах
+  uint64_t interval = 2000000000ULL / (uint64_t)(2 + (level > 0 ? level : 0));
+  return interval < GAME_TICK_MIN_NS ? GAME_TICK_MIN_NS : interval;
+}
 
-  double interval_check = (now.tv_sec - lastTime.tv_sec) * 1000 +
-                          (now.tv_nsec - lastTime.tv_nsec) / 1000000;
-  if (interval_check >= interval && pause == 0) {
-    flag = 1;
-    lastTime = now;
+int game_clock_advance(GameClock_t* clock, uint64_t now, int level,
+                       int pause) {
+  if (pause != 0) {
+    clock->running = false;
+    return 0;
+  }
+  if (!clock->running) {
+    // После паузы время не копится задним числом, первый тик сразу
+    clock->running = true;
+    clock->next_tick = now;
   }
 
-  return flag;
+  int ticks = 0;
+  while (ticks < GAME_TIMER_MAX_TICKS && clock->next_tick <= now) {
+    clock->next_tick += game_tick_interval(level);
+    ticks++;
+  }
+  return ticks;
+}
+
+int GameTimer(int level, int pause) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return game_clock_advance(
+      game_clock(),
+      (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec, level,
+      pause);
+}
+
+uint64_t GameTimerDeadline(int pause) {
+  if (pause != 0) return 0;
+  const GameClock_t* clock = game_clock();
+  return clock->running ? clock->next_tick : 1;
 }
 
 GameInfo_t updateCurrentState() {
@@ -368,7 +564,10 @@ GameBlock_t* getCurrentBlock(bool reset) {
 
 int load_high_score() {
   int high_score = 0;
-  FILE* file = fopen("./high_score.txt", "r");
+  char path[PERSIST_PATH_MAX];
+  FILE* file = persist_path(PERSIST_RECORD_FILE, path, sizeof(path))
+                   ? fopen(path, "r")
+                   : NULL;
 
   if (file) {
     if (fscanf(file, "%d", &high_score) != 1) {
@@ -377,6 +576,8 @@ int load_high_score() {
     fclose(file);
   }
 
+  // Таблицу открывает фоновый поток, её рекорд подхватит getCurrentState()
+  persist_best_async(getEngineContext(false)->rng.mode);
   return high_score;
 }
 
@@ -391,6 +592,8 @@ void clear_temporary_figure(GameInfo_t* state) {
 }
 
 void draw_temporary_figure(GameInfo_t* state, GameBlock_t* block) {
+  if (block->name < I || block->name > Z) return;
+
   TetrominoState coords = blockState(block->name, block->rotation);
   for (int i = 0; i < 4; i++) {
     int x = block->x + coords.blocks[i].x;
@@ -404,6 +607,21 @@ void draw_temporary_figure(GameInfo_t* state, GameBlock_t* block) {
   }
 }
 
+void erase_temporary_figure(GameInfo_t* state, GameBlock_t* block) {
+  if (block->name < I || block->name > Z) return;
+
+  TetrominoState coords = blockState(block->name, block->rotation);
+  for (int i = 0; i < 4; i++) {
+    int x = block->x + coords.blocks[i].x;
+    int y = block->y + coords.blocks[i].y;
+
+    if (x >= 0 && x < GAME_FIELD_HEIGHT && y >= 0 && y < GAME_FIELD_WIDTH &&
+        state->field[x][y] == 2) {
+      state->field[x][y] = 0;
+    }
+  }
+}
+
 // Модифицированная функция прикрепления
 FSM foo_attaching(GameInfo_t* state, GameBlock_t* block) {
   TetrominoState coords = blockState(block->name, block->rotation);
@@ -434,15 +652,7 @@ void copy_next_to_block(GameInfo_t* CurrentState, GameBlock_t* block) {
     return;
   }
 
-  int figure_type = STOP;
-  for (int i = 0; i < BLOCK_SIZE && figure_type == -1; i++) {
-    for (int j = 0; j < BLOCK_SIZE; j++) {
-      if (CurrentState->next[i][j] != 0) {
-        figure_type = CurrentState->next[i][j] - 1;
-        break;
-      }
-    }
-  }
+  int figure_type = next_figure_type(CurrentState->next);
 
   if (figure_type < 0 || figure_type > Z) {
     return;
@@ -460,8 +670,11 @@ void copy_next_to_block(GameInfo_t* CurrentState, GameBlock_t* block) {
 }
 
 void prepare_next_figure(GameInfo_t* CurrentState) {
+  place_next_figure(CurrentState, piece_rng_next(getPieceRng(false)));
+}
+
+void place_next_figure(GameInfo_t* CurrentState, int next_type) {
   empty_matrix(CurrentState->next, BLOCK_SIZE, BLOCK_SIZE);
-  int next_type = rand() % 7;
   TetrominoState next = blockState(next_type, 0);
 
   int min_x = 0, min_y = 0;
@@ -595,7 +808,7 @@ void rotate_figure(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock) {
     CurrentBlock->rotation = (CurrentBlock->rotation + 1) % 4;
 
     if (check_collision(CurrentState, CurrentBlock, false)) {
-      CurrentBlock->rotation = (CurrentBlock->rotation - 1) % 4;
+      CurrentBlock->rotation = (CurrentBlock->rotation + 3) % 4;
     }
   }
 }
\ No newline at end of file
@@ -6,15 +6,25 @@
 #define BACKEND_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 
 #include "../../common/common.h"
+#include "./rng.h"
 #define PAUSE_OFF 0
 #define STOP -1
 #define PREVIEW -2
 
+#define TETRIS_ENGINE_VERSION 2
+#define GAME_LEVEL_CLASSIC 10  // Последний уровень с одной клеткой за тик
+#define GAME_LEVEL_MAX 20
+#define GRAVITY_ONE 256  // Гравитация в 1/256 клетки за тик
+#define GRAVITY_20G (GAME_FIELD_HEIGHT * GRAVITY_ONE)
+#define GAME_TICK_MIN_NS 50000000ULL
+#define GAME_TIMER_MAX_TICKS 8  // Тиков за один вызов GameTimer()
+
 typedef enum { GAME_START, MOVING, SPAWN, ATTACHING, GAME_OVER } FSM;
 
 typedef enum { I, J, L, O, S, T, Z } TetrominoName;
@@ -33,6 +43,34 @@ typedef struct {
   int x, y;               // Координаты якоря на поле
   TetrominoState coords;  // Координаты блоков вокруг фигур
 } GameBlock_t;
+
+/**
+ * @brief Fixed-timestep clock of the real-time game
+ */
+typedef struct {
+  uint64_t next_tick;  // Когда наступает следующий тик, нс
+  bool running;        // Шёл ли таймер при прошлом вызове
+} GameClock_t;
+
+/**
+ * @brief Per-game engine state that does not fit into GameInfo_t
+ *
+ * The interactive game uses the singleton returned by getEngineContext().
+ * Headless sessions bind their own context with engine_bind() around every
+ * call into the engine, so the same FSM code drives all of them.
+ */
+typedef struct {
+  FSM fsm;            // Состояние конечного автомата
+  PieceRng_t rng;     // Генератор фигур
+  uint32_t tick;      // Количество обработанных тиков
+  uint32_t lines;     // Количество удалённых линий
+  uint32_t pieces;    // Количество зафиксированных фигур
+  uint64_t checksum;  // Хеш поля после каждой фиксации фигуры
+  bool persist;       // Сохранять ли рекорд в файл
+  uint32_t game_start_tick;   // Тик начала текущей партии
+  uint32_t game_start_lines;  // Линий до начала текущей партии
+  uint32_t gravity;  // Клеток за тик в 1/GRAVITY_ONE, 0 - по уровню
+} EngineContext_t;
 /**
  * @brief Destroys a dynamically allocated 2D matrix
  *
@@ -91,7 +129,9 @@ GameInfo_t updateCurrentState();
  * - Zero score and loaded high score
  * - Initial level and preview pause state
  *
- * Also handles automatic game timing and block drawing when called.
+ * Also handles automatic game timing and block drawing when called, and
+ * takes the leaderboard high score once the background lookup of
+ * load_high_score() has finished.
  *
  * @return GameInfo_t* Pointer to current game state (singleton instance)
  *
@@ -102,6 +142,70 @@ GameInfo_t updateCurrentState();
  * 4. Redraws temporary figure
  */
 GameInfo_t* getCurrentState();
+/**
+ * @brief Applies one user action to the given state and block
+ *
+ * Shared by userInput() and headless sessions. Expects temporary figure
+ * markers to be cleared by the caller.
+ *
+ * @param[in,out] CurrentState Pointer to current game state
+ * @param[in,out] CurrentBlock Pointer to current active block
+ * @param[in] action The user action to process
+ */
+void apply_user_action(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock,
+                       UserAction_t action);
+/**
+ * @brief Runs one game tick: one FiniteStateMachine() step
+ *
+ * Expects temporary figure markers to be cleared by the caller.
+ *
+ * @param[in,out] CurrentState Pointer to current game state
+ * @param[in,out] CurrentBlock Pointer to current active block
+ */
+void engine_tick(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock);
+/**
+ * @brief Gets or resets the engine context of the calling thread
+ *
+ * Returns the context bound with engine_bind() if there is one, otherwise
+ * the singleton context of the interactive game.
+ *
+ * @param[in] reset Whether to reinitialize the context with seed 0
+ * @return EngineContext_t* Pointer to the active context
+ */
+EngineContext_t* getEngineContext(bool reset);
+/**
+ * @brief Makes the given context active for the calling thread
+ *
+ * @param[in] context Context to bind, NULL to return to the singleton
+ * @return EngineContext_t* Previously bound context
+ */
+EngineContext_t* engine_bind(EngineContext_t* context);
+/**
+ * @brief Initializes an engine context for a new game
+ *
+ * @param[out] context Context to initialize
+ * @param[in] seed Piece generator seed
+ * @param[in] mode Piece generator mode
+ */
+void engine_context_init(EngineContext_t* context, uint64_t seed,
+                         PieceRngMode mode);
+/**
+ * @brief Gets the piece generator of the active engine context
+ *
+ * @param[in] reset Whether to reinitialize the context with seed 0
+ * @return PieceRng_t* Generator used by prepare_next_figure()
+ */
+PieceRng_t* getPieceRng(bool reset);
+/**
+ * @brief Returns the number of game ticks processed so far
+ *
+ * A tick is one call of FiniteStateMachine() triggered by GameTimer()
+ * inside getCurrentState(). User input between two ticks is applied to the
+ * same tick number, which makes (tick, action) pairs enough to replay a game.
+ *
+ * @return uint32_t Number of ticks since start
+ */
+uint32_t getCurrentTick();
 UserAction_t readInput();
 /**
  * @brief Gets the block state for a given tetromino type and rotation
@@ -124,18 +228,53 @@ TetrominoState blockState(int BlockType, int BlockState);
  * @param[out] block Pointer to the block structure to initialize
  */
 void copy_next_to_block(GameInfo_t* CurrentState, GameBlock_t* block);
+/**
+ * @brief Length of one gravity tick
+ *
+ * 1000 / (1 + level * 0.5) ms, computed in whole nanoseconds and never
+ * shorter than GAME_TICK_MIN_NS. Above GAME_LEVEL_CLASSIC the tick is
+ * GAME_TICK_MIN_NS and level_gravity() makes the game faster.
+ *
+ * @param[in] level Current game level
+ * @return uint64_t Tick length in nanoseconds
+ */
+uint64_t game_tick_interval(int level);
+/**
+ * @brief Advances a fixed-timestep clock to the given time
+ *
+ * Every tick is due exactly game_tick_interval() after the previous one,
+ * however late it was processed, so no fractional time is lost. At most
+ * GAME_TIMER_MAX_TICKS are returned per call, the rest stay due for the
+ * next call. A paused clock does not accumulate time and ticks once right
+ * after the pause ends.
+ *
+ * @param[in,out] clock Clock state
+ * @param[in] now Current time in nanoseconds
+ * @param[in] level Current game level
+ * @param[in] pause Pause state, only 0 runs the clock
+ * @return int Number of ticks to run now
+ */
+int game_clock_advance(GameClock_t* clock, uint64_t now, int level,
+                       int pause);
 /**
  * @brief Controls the game timing based on level and pause state
  *
- * Calculates the appropriate interval between game updates based on level,
- * with minimum interval of 50ms. Returns 1 when the interval has passed
- * and game is not paused.
+ * game_clock_advance() of the interactive game on CLOCK_MONOTONIC.
  *
  * @param[in] level Current game level (affects speed)
  * @param[in] pause Pause state (1 = paused, 0 = running)
- * @return int 1 if game should update, 0 otherwise
+ * @return int Number of ticks the game should run now
  */
 int GameTimer(int level, int pause);
+/**
+ * @brief Time at which GameTimer() fires next
+ *
+ * Lets the caller sleep until the next tick instead of polling GameTimer().
+ *
+ * @param[in] pause Pause state
+ * @return uint64_t CLOCK_MONOTONIC time in nanoseconds, 0 while paused
+ */
+uint64_t GameTimerDeadline(int pause);
 /**
  * @brief Main game state machine controller
  *
@@ -149,7 +288,7 @@ int GameTimer(int level, int pause);
  * State Transition Diagram:
  * - GAME_START → (via on_game_start) → SPAWN
  * - SPAWN → (via on_game_spawn) → MOVING
- * - MOVING → (via move_down) → MOVING or ATTACHING
+ * - MOVING → (via apply_gravity) → MOVING or ATTACHING
  * - ATTACHING → (via on_attaching) → SPAWN or GAME_OVER
  * - GAME_OVER → (via on_game_over) → GAME_START
  *
@@ -176,12 +315,20 @@ void empty_matrix(int** matrix, int row, int col);
 /**
  * @brief Prepares the next figure to be displayed in the "next" preview
  *
- * Generates a random tetromino type, calculates its position offset,
+ * Takes the next tetromino type from the session piece generator
+ * (getPieceRng()), calculates its position offset,
  * and stores it in the CurrentState->next matrix for display.
  *
  * @param[in,out] CurrentState Pointer to the current game state
  */
 void prepare_next_figure(GameInfo_t* CurrentState);
+/**
+ * @brief Draws the given tetromino type into the "next" preview matrix
+ *
+ * @param[in,out] CurrentState Pointer to the current game state
+ * @param[in] next_type Tetromino type (0-6)
+ */
+void place_next_figure(GameInfo_t* CurrentState, int next_type);
 /**
  * @brief Checks for collision between current block and game field
  *
@@ -253,12 +400,12 @@ FSM move_right(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock);
 /**
  * @brief Moves block down until it hits bottom or another block
  *
- * Repeatedly attempts to move the block down until collision is detected.
- * Uses move_down() internally and stops after maximum field height attempts.
+ * Moves the block by drop_distance() in one step. Does nothing while the
+ * game is paused.
  *
  * @param[in,out] CurrentState Pointer to current game state
  * @param[in,out] CurrentBlock Pointer to current active block
- * @return FSM Next state (MOVING or ATTACHING)
+ * @return FSM ATTACHING, or MOVING if nothing was moved
  */
 FSM fall_down(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock);
 /**
@@ -312,19 +459,80 @@ int count_score(int lines);
 /**
  * @brief Calculates current level based on score
  *
- * Level increases every 600 points, capped at level 10.
+ * Level increases every 600 points, capped at GAME_LEVEL_MAX.
  *
  * @param[in] score Current game score
- * @return int Current level (0-10)
+ * @return int Current level (0-GAME_LEVEL_MAX)
  */
 int lvl_up(int score);
+/**
+ * @brief Gravity of a level in 1/GRAVITY_ONE cells per tick
+ *
+ * Up to GAME_LEVEL_CLASSIC a piece falls one cell per tick and the levels
+ * only shorten the tick. Above it the tick stays at GAME_TICK_MIN_NS and
+ * the gravity grows instead, from half a cell per tick up to GRAVITY_20G,
+ * which drops a piece to the floor in one tick.
+ *
+ * @param[in] level Current game level
+ * @return uint32_t Gravity
+ */
+uint32_t level_gravity(int level);
+/**
+ * @brief Whole cells a piece falls in one tick under fractional gravity
+ *
+ * Derived from the tick number alone, so no fractional state has to be
+ * saved in snapshots: over any N ticks the piece falls
+ * gravity * N / GRAVITY_ONE cells, rounded the same way every time.
+ *
+ * @param[in] gravity Gravity in 1/GRAVITY_ONE cells per tick
+ * @param[in] tick Engine tick
+ * @return int Cells to fall in this tick
+ */
+int gravity_cells(uint32_t gravity, uint32_t tick);
+/**
+ * @brief Number of free cells under the falling block
+ *
+ * Resolved from the column profile: for the lowest cell of the block in
+ * each column, counts the free cells down to the first filled one, and
+ * takes the minimum. Expects temporary figure markers to be cleared.
+ *
+ * @param[in] CurrentState Pointer to current game state
+ * @param[in] CurrentBlock Pointer to current active block
+ * @return int Rows the block can move down, 0 if it rests on something
+ */
+int drop_distance(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock);
+/**
+ * @brief Gravity step of one tick
+ *
+ * Moves the block down by gravity_cells() of the context's gravity, or of
+ * level_gravity() when it is not set, but no further than drop_distance().
+ * A block that rests on something when it has to fall starts attaching.
+ *
+ * @param[in,out] CurrentState Pointer to current game state
+ * @param[in,out] CurrentBlock Pointer to current active block
+ * @return FSM Next state (MOVING or ATTACHING)
+ */
+FSM apply_gravity(GameInfo_t* CurrentState, GameBlock_t* CurrentBlock);
 /**
  * @brief Saves high score to file if it matches current record
  *
+ * Only queues the value; the file is replaced atomically by the
+ * RecordWriter_t thread, see persist.h.
+ *
  * @param[in] score Score to save
  * @param[in] record Current high score to verify
  */
 void save_record(int score, int record);
+/**
+ * @brief Adds the finished game to the leaderboard of its mode
+ *
+ * The mode is the piece generator mode, the replay ID is the game seed.
+ * The entry is queued with persist_result_async(), the game thread does
+ * not touch the store.
+ *
+ * @param[in] state Final game state
+ */
+void submit_result(const GameInfo_t* state);
 /**
  * @brief Updates high score record if new score is higher
  *
@@ -336,7 +544,10 @@ int update_record(int score, int record);
 /**
  * @brief Loads the high score from file
  *
- * Attempts to read the high score from "high_score.txt" file.
+ * Attempts to read the high score from "high_score.txt" in the data
+ * directory (persist_data_dir()). The best result on the leaderboard of
+ * the current mode is looked up with persist_best_async(), and
+ * getCurrentState() raises the high score to it once it is found.
  * Returns 0 if file doesn't exist or can't be read.
  *
  * @return int The loaded high score, or 0 if not available
@@ -362,6 +573,16 @@ void draw_temporary_figure(GameInfo_t* state, GameBlock_t* block);
  * @param[in,out] state Pointer to the current game state
  */
 void clear_temporary_figure(GameInfo_t* state);
+/**
+ * @brief Clears the temporary markers drawn for the given block only
+ *
+ * Cheaper than clear_temporary_figure() when the caller knows the markers
+ * were drawn by draw_temporary_figure() for the same block pose.
+ *
+ * @param[in,out] state Pointer to the current game state
+ * @param[in] block Pointer to the block whose markers are removed
+ */
+void erase_temporary_figure(GameInfo_t* state, GameBlock_t* block);
 /**
  * @brief Gets or resets the current game block
  *
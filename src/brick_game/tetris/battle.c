@@ -0,0 +1,284 @@
+#include "./battle.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t mix(uint64_t value) {
+  value += 0x9E3779B97F4A7C15ULL;
+  value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+  return value ^ (value >> 31);
+}
+
+void battle_queue_init(BattleQueue_t* queue) {
+  atomic_init(&queue->tail, 0);
+  queue->head = 0;
+  for (unsigned i = 0; i < BATTLE_QUEUE_SIZE; i++) {
+    atomic_init(&queue->cells[i].sequence, i);
+  }
+}
+
+bool battle_queue_push(BattleQueue_t* queue, const BattleAttack_t* attack) {
+  unsigned pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  for (;;) {
+    BattleCell_t* cell = &queue->cells[pos & (BATTLE_QUEUE_SIZE - 1)];
+    unsigned sequence =
+        atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    int diff = (int)(sequence - pos);
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&queue->tail, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        cell->attack = *attack;
+        atomic_store_explicit(&cell->sequence, pos + 1,
+                              memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;  // Получатель ещё не освободил ячейку
+    } else {
+      pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    }
+  }
+}
+
+bool battle_queue_pop(BattleQueue_t* queue, BattleAttack_t* attack) {
+  BattleCell_t* cell = &queue->cells[queue->head & (BATTLE_QUEUE_SIZE - 1)];
+  unsigned sequence =
+      atomic_load_explicit(&cell->sequence, memory_order_acquire);
+  if (sequence != queue->head + 1) return false;
+
+  *attack = cell->attack;
+  atomic_store_explicit(&cell->sequence, queue->head + BATTLE_QUEUE_SIZE,
+                        memory_order_release);
+  queue->head++;
+  return true;
+}
+
+int battle_garbage_lines(int cleared) {
+  return count_score(cleared) / BATTLE_POINTS_PER_LINE;
+}
+
+bool battle_add_garbage(TetrisSession_t* session, int lines, int hole) {
+  if (lines <= 0) return true;
+  if (lines > GAME_FIELD_HEIGHT) lines = GAME_FIELD_HEIGHT;
+
+  bool piece = session->block.name >= I && session->block.name <= Z;
+  if (piece) erase_temporary_figure(&session->info, &session->block);
+
+  bool fits = true;
+  for (int row = 0; row < lines; row++) {
+    for (int col = 0; col < GAME_FIELD_WIDTH; col++) {
+      if (session->cells[row][col]) fits = false;
+    }
+  }
+  // Поле лежит одним массивом, поэтому сдвиг - один memmove
+  memmove(session->cells[0], session->cells[lines],
+          (size_t)(GAME_FIELD_HEIGHT - lines) * sizeof(session->cells[0]));
+  for (int row = GAME_FIELD_HEIGHT - lines; row < GAME_FIELD_HEIGHT; row++) {
+    for (int col = 0; col < GAME_FIELD_WIDTH; col++) {
+      session->cells[row][col] = col != hole;
+    }
+  }
+
+  if (piece) {
+    while (check_collision(&session->info, &session->block, false) &&
+           session->block.x > -BLOCK_SIZE) {
+      session->block.x--;
+    }
+    draw_temporary_figure(&session->info, &session->block);
+  }
+  return fits;
+}
+
+/**
+ * Chooses the receiver of an attack among the other living boards. Only
+ * alive flags from the previous tick are read, they change in the
+ * delivery phase.
+ */
+static int pick_target(const Battle_t* battle, int source) {
+  uint64_t hash =
+      mix(battle->seed ^ ((uint64_t)battle->tick << 32) ^ (uint64_t)source);
+  int others = battle->count - 1;
+  int start = (int)(hash % (uint64_t)others);
+
+  for (int i = 0; i < others; i++) {
+    int target = (source + 1 + (start + i) % others) % battle->count;
+    if (battle->boards[target].alive) return target;
+  }
+  return -1;
+}
+
+static void send_phase(Battle_t* battle, int index) {
+  BattleBoard_t* board = &battle->boards[index];
+  if (!board->alive) return;
+
+  uint32_t before = board->lines_seen;
+  session_step(&board->session);
+  board->lines_seen = board->session.engine.lines;
+  if (board->session.info.pause == PREVIEW) board->topped_out = true;
+
+  int garbage = battle_garbage_lines((int)(board->lines_seen - before));
+  int target = garbage > 0 ? pick_target(battle, index) : -1;
+  if (target < 0) return;
+
+  uint64_t hash = mix(battle->seed ^ ~((uint64_t)battle->tick << 32) ^
+                      (uint64_t)index);
+  BattleAttack_t attack = {.tick = battle->tick,
+                           .source = (uint16_t)index,
+                           .lines = (uint8_t)garbage,
+                           .hole = (uint8_t)(hash % GAME_FIELD_WIDTH)};
+  if (battle_queue_push(&battle->boards[target].inbox, &attack)) {
+    board->sent += (uint32_t)garbage;
+  } else {
+    board->dropped++;
+  }
+}
+
+static void receive_phase(Battle_t* battle, int index) {
+  BattleBoard_t* board = &battle->boards[index];
+  BattleAttack_t attacks[BATTLE_QUEUE_SIZE];
+  int count = 0;
+  while (count < BATTLE_QUEUE_SIZE &&
+         battle_queue_pop(&board->inbox, &attacks[count])) {
+    count++;
+  }
+
+  // Порядок в очереди зависит от потоков, порядок применения - нет
+  for (int i = 1; i < count; i++) {
+    BattleAttack_t attack = attacks[i];
+    int j = i;
+    for (; j > 0 && attacks[j - 1].source > attack.source; j--) {
+      attacks[j] = attacks[j - 1];
+    }
+    attacks[j] = attack;
+  }
+
+  for (int i = 0; i < count && board->alive && !board->topped_out; i++) {
+    board->received += attacks[i].lines;
+    if (!battle_add_garbage(&board->session, attacks[i].lines,
+                            attacks[i].hole)) {
+      board->topped_out = true;
+    }
+  }
+  if (board->topped_out) board->alive = false;
+}
+
+static void barrier_wait(Battle_t* battle) {
+  pthread_mutex_lock(&battle->lock);
+  uint32_t generation = battle->generation;
+  if (++battle->arrived == battle->threads + 1) {
+    battle->arrived = 0;
+    battle->generation++;
+    pthread_cond_broadcast(&battle->turn);
+  } else {
+    while (generation == battle->generation) {
+      pthread_cond_wait(&battle->turn, &battle->lock);
+    }
+  }
+  pthread_mutex_unlock(&battle->lock);
+}
+
+static void* worker_thread(void* arg) {
+  BattleWorker_t* worker = (BattleWorker_t*)arg;
+  Battle_t* battle = worker->battle;
+  int end = worker->first + worker->count;
+
+  for (;;) {
+    barrier_wait(battle);
+    if (battle->stop) break;
+    for (int i = worker->first; i < end; i++) send_phase(battle, i);
+    barrier_wait(battle);
+    for (int i = worker->first; i < end; i++) receive_phase(battle, i);
+    barrier_wait(battle);
+  }
+  return NULL;
+}
+
+static void stop_workers(Battle_t* battle) {
+  battle->stop = true;
+  if (battle->threads) barrier_wait(battle);
+  for (int i = 0; i < battle->threads; i++) {
+    pthread_join(battle->workers[i].thread, NULL);
+  }
+  battle->threads = 0;
+}
+
+bool battle_init(Battle_t* battle, int boards, int threads, uint64_t seed,
+                 PieceRngMode mode) {
+  memset(battle, 0, sizeof(*battle));
+  if (boards < 2 || boards > BATTLE_MAX_BOARDS || threads < 0) return false;
+  if (threads > BATTLE_MAX_THREADS) threads = BATTLE_MAX_THREADS;
+  if (threads > boards) threads = boards;
+
+  battle->boards = (BattleBoard_t*)aligned_alloc(
+      BATTLE_CACHE_LINE, (size_t)boards * sizeof(BattleBoard_t));
+  if (!battle->boards) return false;
+  memset(battle->boards, 0, (size_t)boards * sizeof(BattleBoard_t));
+  battle->count = boards;
+  battle->alive = boards;
+  battle->seed = seed;
+  pthread_mutex_init(&battle->lock, NULL);
+  pthread_cond_init(&battle->turn, NULL);
+
+  for (int i = 0; i < boards; i++) {
+    BattleBoard_t* board = &battle->boards[i];
+    session_init(&board->session, seed + (uint64_t)i, mode);
+    session_input(&board->session, Start);
+    battle_queue_init(&board->inbox);
+    board->alive = true;
+  }
+
+  // Барьер ждёт только запущенные потоки, поэтому растим threads по одному
+  bool ok = true;
+  for (int i = 0; ok && i < threads; i++) {
+    BattleWorker_t* worker = &battle->workers[i];
+    worker->battle = battle;
+    worker->first = i * boards / threads;
+    worker->count = (i + 1) * boards / threads - worker->first;
+    pthread_mutex_lock(&battle->lock);
+    battle->threads++;
+    pthread_mutex_unlock(&battle->lock);
+    ok = pthread_create(&worker->thread, NULL, worker_thread, worker) == 0;
+    if (!ok) {
+      pthread_mutex_lock(&battle->lock);
+      battle->threads--;
+      pthread_mutex_unlock(&battle->lock);
+    }
+  }
+
+  if (!ok) battle_free(battle);
+  return ok;
+}
+
+void battle_input(Battle_t* battle, int board, UserAction_t action) {
+  if (board >= 0 && board < battle->count && battle->boards[board].alive) {
+    session_input(&battle->boards[board].session, action);
+  }
+}
+
+void battle_tick(Battle_t* battle) {
+  if (battle->threads) {
+    barrier_wait(battle);
+    barrier_wait(battle);
+    barrier_wait(battle);
+  } else {
+    for (int i = 0; i < battle->count; i++) send_phase(battle, i);
+    for (int i = 0; i < battle->count; i++) receive_phase(battle, i);
+  }
+
+  battle->tick++;
+  battle->alive = 0;
+  for (int i = 0; i < battle->count; i++) {
+    battle->alive += battle->boards[i].alive;
+  }
+}
+
+void battle_free(Battle_t* battle) {
+  if (!battle->boards) return;
+  stop_workers(battle);
+  pthread_cond_destroy(&battle->turn);
+  pthread_mutex_destroy(&battle->lock);
+  free(battle->boards);
+  battle->boards = NULL;
+}
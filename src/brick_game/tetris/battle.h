@@ -0,0 +1,178 @@
+/**
+ * @file battle.h
+ * @brief Battle mode: many boards in one process sending garbage lines
+ *
+ * A board that clears lines sends garbage to another living board: one
+ * line per BATTLE_POINTS_PER_LINE points that count_score() gives for the
+ * cleared lines. Attacks go through a bounded lock-free MPSC queue of the
+ * target board, and garbage is inserted by shifting whole rows up and
+ * filling the bottom with rows that have one hole.
+ *
+ * Boards are split into contiguous ranges between worker threads. A tick
+ * has two phases separated by barriers: every board steps and sends its
+ * attacks, then every board drains its queue, sorts the attacks by sender
+ * and applies them. Targets and holes are derived from the seed, the tick
+ * and the sender, so the result does not depend on the number of threads
+ * or on the order in which attacks were queued.
+ */
+#ifndef BATTLE_H
+#define BATTLE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./session.h"
+
+#define BATTLE_MAX_BOARDS 128
+#define BATTLE_MAX_THREADS 32
+#define BATTLE_QUEUE_SIZE 128  // Степень двойки, не меньше числа досок
+#define BATTLE_POINTS_PER_LINE 300
+#define BATTLE_CACHE_LINE 64
+
+/**
+ * @brief Garbage sent by one board in one tick
+ */
+typedef struct {
+  uint32_t tick;
+  uint16_t source;  // Номер доски отправителя
+  uint8_t lines;
+  uint8_t hole;  // Столбец без мусора
+} BattleAttack_t;
+
+typedef struct {
+  atomic_uint sequence;  // Чья очередь: отправителя или получателя
+  BattleAttack_t attack;
+} BattleCell_t;
+
+/**
+ * @brief Bounded multi-producer single-consumer queue of attacks
+ *
+ * Senders reserve a cell with a compare-and-swap on tail; the receiver
+ * owns head and needs no atomic read-modify-write at all.
+ */
+typedef struct {
+  _Alignas(BATTLE_CACHE_LINE) atomic_uint tail;
+  _Alignas(BATTLE_CACHE_LINE) uint32_t head;
+  BattleCell_t cells[BATTLE_QUEUE_SIZE];
+} BattleQueue_t;
+
+/**
+ * @brief One board of a battle
+ */
+typedef struct {
+  _Alignas(BATTLE_CACHE_LINE) TetrisSession_t session;
+  BattleQueue_t inbox;
+  uint32_t lines_seen;  // engine.lines на конец прошлого тика
+  bool alive;
+  bool topped_out;  // Выбыла в текущем тике, alive снимется после доставки
+  uint32_t sent;    // Отправлено линий мусора
+  uint32_t received;
+  uint32_t dropped;  // Атаки доски, не поместившиеся в очередь цели
+} BattleBoard_t;
+
+typedef struct Battle Battle_t;
+
+typedef struct {
+  Battle_t* battle;
+  pthread_t thread;
+  int first;
+  int count;
+} BattleWorker_t;
+
+/**
+ * @brief Battle room
+ */
+struct Battle {
+  BattleBoard_t* boards;
+  int count;
+  int alive;  // Живые доски после последнего тика
+  uint64_t seed;
+  uint32_t tick;
+  BattleWorker_t workers[BATTLE_MAX_THREADS];
+  int threads;           // 0 - всё в вызывающем потоке
+  pthread_mutex_t lock;  // Барьер между фазами тика
+  pthread_cond_t turn;
+  int arrived;
+  uint32_t generation;
+  bool stop;
+};
+
+/**
+ * @brief Initializes an empty attack queue
+ *
+ * @param[out] queue Queue
+ */
+void battle_queue_init(BattleQueue_t* queue);
+/**
+ * @brief Adds an attack, safe to call from several threads at once
+ *
+ * @param[in,out] queue Queue of the target board
+ * @param[in] attack Attack to send
+ * @return false if the queue is full
+ */
+bool battle_queue_push(BattleQueue_t* queue, const BattleAttack_t* attack);
+/**
+ * @brief Takes the oldest attack, only the owner of the board may call it
+ *
+ * @param[in,out] queue Queue
+ * @param[out] attack Received attack
+ * @return false if the queue is empty
+ */
+bool battle_queue_pop(BattleQueue_t* queue, BattleAttack_t* attack);
+/**
+ * @brief Garbage lines sent for clearing lines at once
+ *
+ * @param[in] cleared Lines cleared by one placement
+ * @return int count_score(cleared) / BATTLE_POINTS_PER_LINE
+ */
+int battle_garbage_lines(int cleared);
+/**
+ * @brief Pushes the locked rows up and fills the bottom with garbage
+ *
+ * The falling piece keeps its place and is moved up only if it would
+ * overlap the raised cells.
+ *
+ * @param[in,out] session Board
+ * @param[in] lines Number of garbage rows
+ * @param[in] hole Empty column of every garbage row
+ * @return false if locked cells were pushed out of the field
+ */
+bool battle_add_garbage(TetrisSession_t* session, int lines, int hole);
+/**
+ * @brief Starts a room with every board already playing
+ *
+ * Board i uses seed + i for its pieces.
+ *
+ * @param[out] battle Room to initialize
+ * @param[in] boards Number of boards, 2..BATTLE_MAX_BOARDS
+ * @param[in] threads Worker threads, 0 to run ticks in the caller
+ * @param[in] seed Seed of the room
+ * @param[in] mode Piece generator mode of all boards
+ * @return false on bad arguments or if a thread could not be started
+ */
+bool battle_init(Battle_t* battle, int boards, int threads, uint64_t seed,
+                 PieceRngMode mode);
+/**
+ * @brief Applies a player action to a board between ticks
+ *
+ * @param[in,out] battle Room
+ * @param[in] board Board index
+ * @param[in] action User action
+ */
+void battle_input(Battle_t* battle, int board, UserAction_t action);
+/**
+ * @brief Runs one tick of every living board and delivers its attacks
+ *
+ * @param[in,out] battle Room
+ */
+void battle_tick(Battle_t* battle);
+/**
+ * @brief Stops the workers and releases the boards
+ *
+ * @param[in,out] battle Room
+ */
+void battle_free(Battle_t* battle);
+
+#endif
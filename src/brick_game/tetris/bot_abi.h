@@ -0,0 +1,101 @@
+/**
+ * @file bot_abi.h
+ * @brief Binary interface between the game and in-process bot plugins
+ *
+ * A plugin is a shared object that exports BOT_PLUGIN_ENTRY_NAME. The host
+ * calls it with its BOT_ABI_VERSION and gets back a table of functions, or
+ * NULL if the plugin cannot work with that version. For every falling
+ * piece the host calls choose() with a read-only view of the board and
+ * the plugin answers with the pose to drop the piece in.
+ *
+ * The header depends on nothing from the engine: the board is a bitmask
+ * per row, not the int** field of GameInfo_t, so the engine can change
+ * its own layout without breaking built plugins. Fields are only ever
+ * appended to the structures; size tells which of them the host filled.
+ */
+#ifndef BOT_ABI_H
+#define BOT_ABI_H
+
+#include <stdint.h>
+
+#define BOT_ABI_VERSION 1
+#define BOT_PLUGIN_ENTRY_NAME "brick_bot_entry"
+#define BOT_PIECE_COUNT 7
+#define BOT_ROTATION_COUNT 4
+#define BOT_PIECE_CELLS 4
+
+/**
+ * @brief Cells of every piece in every rotation
+ *
+ * cells[piece][rotation][i] = {row, column} offset of cell i from the
+ * anchor of the piece. Pieces are numbered I, J, L, O, S, T, Z.
+ */
+typedef struct {
+  int8_t cells[BOT_PIECE_COUNT][BOT_ROTATION_COUNT][BOT_PIECE_CELLS][2];
+} BotShapeTable_t;
+
+/**
+ * @brief What a bot sees when it has to place a piece
+ *
+ * All pointers point into the host's memory and stay valid only during the
+ * choose() call.
+ */
+typedef struct {
+  uint32_t abi_version;
+  uint32_t size;          // sizeof этой структуры у хоста
+  const uint16_t* rows;   // Занятые клетки, бит c - столбец c, строка 0 сверху
+  int32_t height;         // Число строк
+  int32_t width;          // Число столбцов
+  int32_t piece;          // Падающая фигура
+  int32_t rotation;       // Её поворот
+  int32_t row, column;    // Её якорь на поле
+  const int8_t* queue;    // Следующие фигуры, первой идёт превью
+  int32_t queue_length;
+  int32_t score;
+  int32_t level;
+  uint32_t lines;
+  const BotShapeTable_t* shapes;
+} BotBoardView_t;
+
+/**
+ * @brief Pose the piece is dropped in
+ */
+typedef struct {
+  int32_t rotation;
+  int32_t column;  // Столбец якоря фигуры
+} BotPlacement_t;
+
+/**
+ * @brief Functions of a plugin
+ */
+typedef struct {
+  uint32_t abi_version;  // BOT_ABI_VERSION, под который собран плагин
+  const char* name;
+  /**
+   * Creates the state of one game, NULL means failure. The plugin may
+   * keep no state at all and return any non-NULL pointer.
+   */
+  void* (*create)(uint64_t seed);
+  /**
+   * Fills placement for the falling piece, returns 0 on success and
+   * anything else to give up the game.
+   */
+  int (*choose)(void* state, const BotBoardView_t* view,
+                BotPlacement_t* placement);
+  void (*destroy)(void* state);
+} BotPluginApi_t;
+
+/**
+ * @brief Signature of the exported entry point
+ */
+typedef const BotPluginApi_t* (*BotPluginEntry_t)(uint32_t host_version);
+
+/**
+ * Declares the entry point inside a plugin:
+ * BOT_PLUGIN_ENTRY(version) { return version == BOT_ABI_VERSION ? &api : 0; }
+ */
+#define BOT_PLUGIN_ENTRY(version)                                  \
+  __attribute__((visibility("default"))) const BotPluginApi_t*     \
+  brick_bot_entry(uint32_t version)
+
+#endif
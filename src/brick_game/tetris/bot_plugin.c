@@ -0,0 +1,107 @@
+#include "./bot_plugin.h"
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <string.h>
+
+static void fill_shapes(BotShapeTable_t* shapes) {
+  for (int piece = 0; piece < BOT_PIECE_COUNT; piece++) {
+    for (int rotation = 0; rotation < BOT_ROTATION_COUNT; rotation++) {
+      TetrominoState state = blockState(piece, rotation);
+      for (int i = 0; i < BOT_PIECE_CELLS; i++) {
+        shapes->cells[piece][rotation][i][0] = (int8_t)state.blocks[i].x;
+        shapes->cells[piece][rotation][i][1] = (int8_t)state.blocks[i].y;
+      }
+    }
+  }
+}
+
+bool bot_plugin_load(BotPlugin_t* plugin, const char* path, uint64_t seed,
+                     int preview, char* error, size_t error_size) {
+  memset(plugin, 0, sizeof(*plugin));
+  const char* reason = NULL;
+
+  if (preview < 1 || preview > BOT_QUEUE_MAX) {
+    reason = "bad preview length";
+  } else if (!(plugin->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL))) {
+    reason = dlerror();
+  } else {
+    BotPluginEntry_t entry =
+        (BotPluginEntry_t)dlsym(plugin->handle, BOT_PLUGIN_ENTRY_NAME);
+    plugin->api = entry ? entry(BOT_ABI_VERSION) : NULL;
+    if (!entry) {
+      reason = "no " BOT_PLUGIN_ENTRY_NAME " symbol";
+    } else if (!plugin->api || plugin->api->abi_version != BOT_ABI_VERSION ||
+               !plugin->api->create || !plugin->api->choose) {
+      reason = "unsupported bot ABI version";
+    } else if (!(plugin->state = plugin->api->create(seed))) {
+      reason = "plugin failed to create its state";
+    }
+  }
+
+  if (reason) {
+    if (error && error_size) snprintf(error, error_size, "%s", reason);
+    if (plugin->handle) dlclose(plugin->handle);
+    memset(plugin, 0, sizeof(*plugin));
+    return false;
+  }
+
+  plugin->preview = preview;
+  fill_shapes(&plugin->shapes);
+  // Указатели вида смотрят в сам слот плагина и не меняются между ходами
+  BotBoardView_t* view = &plugin->view;
+  view->abi_version = BOT_ABI_VERSION;
+  view->size = sizeof(*view);
+  view->rows = plugin->frame.rows;
+  view->height = GAME_FIELD_HEIGHT;
+  view->width = GAME_FIELD_WIDTH;
+  view->queue = plugin->queue;
+  view->queue_length = preview;
+  view->shapes = &plugin->shapes;
+  return true;
+}
+
+BotMoveResult bot_plugin_move(BotPlugin_t* plugin, TetrisSession_t* session) {
+  if (session->engine.fsm != MOVING || session->info.pause != PAUSE_OFF) {
+    return BOT_MOVE_IDLE;
+  }
+
+  frame_capture(&session->info, &session->block, &plugin->frame);
+  plugin->queue[0] = plugin->frame.next;
+  PieceRng_t rng = session->engine.rng;
+  for (int i = 1; i < plugin->preview; i++) {
+    plugin->queue[i] = (int8_t)piece_rng_next(&rng);
+  }
+
+  BotBoardView_t* view = &plugin->view;
+  view->piece = plugin->frame.piece;
+  view->rotation = plugin->frame.rotation;
+  view->row = plugin->frame.x;
+  view->column = plugin->frame.y;
+  view->score = session->info.score;
+  view->level = session->info.level;
+  view->lines = session->engine.lines;
+
+  BotPlacement_t placement = {.rotation = view->rotation,
+                              .column = view->column};
+  if (plugin->api->choose(plugin->state, view, &placement) != 0) {
+    return BOT_MOVE_GAVE_UP;
+  }
+  if (placement.rotation < 0 || placement.rotation >= BOT_ROTATION_COUNT) {
+    return BOT_MOVE_REJECTED;
+  }
+  // Пробуем на копии, чтобы недостижимая позиция ничего не меняла
+  session_clone(&plugin->trial, session);
+  if (!session_place(&plugin->trial, placement.rotation, placement.column)) {
+    return BOT_MOVE_REJECTED;
+  }
+  session_commit(session, &plugin->trial);
+  return BOT_MOVE_PLACED;
+}
+
+void bot_plugin_unload(BotPlugin_t* plugin) {
+  if (!plugin->handle) return;
+  if (plugin->api->destroy) plugin->api->destroy(plugin->state);
+  dlclose(plugin->handle);
+  memset(plugin, 0, sizeof(*plugin));
+}
@@ -0,0 +1,83 @@
+/**
+ * @file bot_plugin.h
+ * @brief Loads bot plugins with dlopen() and lets them play a session
+ *
+ * The board the plugin sees is the compact TetrisFrame_t of the session:
+ * it is captured once per decision into the plugin slot and handed to
+ * choose() by pointer, without any copying or text encoding.
+ */
+#ifndef BOT_PLUGIN_H
+#define BOT_PLUGIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "./bot_abi.h"
+#include "./frame.h"
+#include "./session.h"
+
+#define BOT_QUEUE_MAX 8
+
+/**
+ * @brief Loaded plugin playing one game
+ *
+ * The view points into the structure itself, so a loaded plugin must not be
+ * moved or copied.
+ */
+typedef struct {
+  void* handle;  // Результат dlopen()
+  const BotPluginApi_t* api;
+  void* state;  // Результат create()
+  int preview;  // Сколько следующих фигур видит бот
+  TetrisFrame_t frame;
+  int8_t queue[BOT_QUEUE_MAX];
+  BotShapeTable_t shapes;
+  BotBoardView_t view;
+  TetrisSession_t trial;  // Копия сессии для проверки позиции
+} BotPlugin_t;
+
+/**
+ * @brief Outcome of one bot move
+ */
+typedef enum {
+  BOT_MOVE_PLACED,    // Фигура зафиксирована
+  BOT_MOVE_IDLE,      // Нет падающей фигуры, бот не вызывался
+  BOT_MOVE_GAVE_UP,   // choose() вернул ошибку
+  BOT_MOVE_REJECTED,  // Позиция недостижима, сессия не изменилась
+} BotMoveResult;
+
+/**
+ * @brief Loads a plugin and creates its state for one game
+ *
+ * @param[out] plugin Plugin slot
+ * @param[in] path Path of the shared object
+ * @param[in] seed Seed passed to create()
+ * @param[in] preview Next pieces shown to the bot, 1..BOT_QUEUE_MAX
+ * @param[out] error Reason of a failure
+ * @param[in] error_size Size of error
+ * @return false if the plugin could not be loaded or has another ABI
+ */
+bool bot_plugin_load(BotPlugin_t* plugin, const char* path, uint64_t seed,
+                     int preview, char* error, size_t error_size);
+/**
+ * @brief Lets the plugin place the falling piece
+ *
+ * Pieces of the queue after the preview are drawn from a copy of the
+ * session's generator, so the session itself is not affected. The pose is
+ * tried with session_place() on a clone of the session, which replaces the
+ * session only if the piece was locked, so a rejected pose changes
+ * nothing.
+ *
+ * @param[in,out] plugin Loaded plugin
+ * @param[in,out] session Session with a falling piece
+ * @return BotMoveResult What happened
+ */
+BotMoveResult bot_plugin_move(BotPlugin_t* plugin, TetrisSession_t* session);
+/**
+ * @brief Destroys the plugin state and unloads the shared object
+ *
+ * @param[in,out] plugin Plugin slot, may be unloaded already
+ */
+void bot_plugin_unload(BotPlugin_t* plugin);
+
+#endif
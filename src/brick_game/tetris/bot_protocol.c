@@ -0,0 +1,164 @@
+#include "./bot_protocol.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "./frame.h"
+
+void bot_protocol_init(BotProtocol_t* bot) {
+  memset(bot, 0, sizeof(*bot));
+  session_init(&bot->session, 0, RNG_UNIFORM);
+}
+
+static size_t format_state(const TetrisSession_t* session, char* reply,
+                           size_t size) {
+  TetrisFrame_t frame;
+  frame_capture(&session->info, &session->block, &frame);
+
+  int length = snprintf(
+      reply, size, "state %u %d %d %u %u %d %d %d %d %d %d ",
+      session->engine.tick, session->info.score, session->info.level,
+      session->engine.lines, session->engine.pieces, session->info.pause,
+      frame.piece, frame.rotation, frame.x, frame.y, frame.next);
+  for (int row = 0; row < GAME_FIELD_HEIGHT; row++) {
+    length += snprintf(reply + length, size - (size_t)length, "%03x",
+                       (unsigned)frame.rows[row]);
+  }
+  length += snprintf(reply + length, size - (size_t)length, "\n");
+  return (size_t)length;
+}
+
+size_t bot_protocol_execute(BotProtocol_t* bot, const char* line, char* reply,
+                            size_t size) {
+  char command[16] = "";
+  char mode[16] = "uniform";
+  unsigned long long seed = 0;
+  long first = 0, second = 0;
+  int words = sscanf(line, "%15s", command);
+  const char* error = NULL;
+  int length = 0;
+
+  if (words <= 0) {
+    error = "empty command";
+  } else if (strcmp(command, "new") == 0) {
+    int count = sscanf(line, "%*s %llu %15s", &seed, mode);
+    bool bag = strcmp(mode, "bag") == 0;
+    if (count < 1 || (!bag && strcmp(mode, "uniform") != 0)) {
+      error = "usage: new SEED [uniform|bag]";
+    } else {
+      session_init(&bot->session, (uint64_t)seed, bag ? RNG_BAG : RNG_UNIFORM);
+      session_input(&bot->session, Start);
+      session_settle(&bot->session);
+      bot->started = true;
+      length = snprintf(reply, size, "ok\n");
+    }
+  } else if (strcmp(command, "state") == 0) {
+    return format_state(&bot->session, reply, size);
+  } else if (strcmp(command, "quit") == 0) {
+    bot->quit = true;
+    length = snprintf(reply, size, "bye\n");
+  } else if (!bot->started) {
+    error = "no game, send new first";
+  } else if (strcmp(command, "place") == 0) {
+    if (sscanf(line, "%*s %ld %ld", &first, &second) != 2 || first < 0 ||
+        first > 3 || second < -BLOCK_SIZE || second >= GAME_FIELD_WIDTH) {
+      error = "usage: place ROTATION COLUMN";
+    } else {
+      // Пробуем на копии, чтобы недостижимая позиция ничего не меняла
+      TetrisSession_t trial;
+      session_clone(&trial, &bot->session);
+      uint32_t lines = trial.engine.lines;
+      if (session_place(&trial, (int)first, (int)second)) {
+        session_clone(&bot->session, &trial);
+        length = snprintf(reply, size, "ok %u\n",
+                          bot->session.engine.lines - lines);
+      } else {
+        error = "placement not reachable";
+      }
+    }
+  } else if (strcmp(command, "step") == 0) {
+    if (sscanf(line, "%*s %ld", &first) != 1 || first < 0 ||
+        first > BOT_STEP_MAX) {
+      error = "usage: step N";
+    } else {
+      for (long i = 0; i < first && session_step(&bot->session); i++) {
+      }
+      length = snprintf(reply, size, "ok %u\n", bot->session.engine.tick);
+    }
+  } else {
+    error = "unknown command";
+  }
+
+  if (error) length = snprintf(reply, size, "error %s\n", error);
+  return (size_t)length;
+}
+
+static bool write_all(int fd, const char* data, size_t size) {
+  while (size) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    size -= (size_t)n;
+  }
+  return true;
+}
+
+bool bot_protocol_serve(int in_fd, int out_fd) {
+  char input[BOT_INPUT_MAX];
+  char output[BOT_OUTPUT_MAX];
+  BotProtocol_t bot;
+  size_t input_len = 0, output_len = 0;
+  bool at_end = false;
+  bool discarding = false;  // Дочитываем слишком длинную строку
+  bot_protocol_init(&bot);
+
+  while (!bot.quit && !at_end) {
+    ssize_t n = read(in_fd, input + input_len, sizeof(input) - input_len - 1);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) return false;
+    input_len += (size_t)n;
+    at_end = n == 0;
+    // Последняя строка без перевода тоже команда
+    if (at_end && input_len) input[input_len++] = '\n';
+    if (discarding) {
+      // Остаток длинной строки не команда, пропускаем его до перевода
+      char* rest = memchr(input, '\n', input_len);
+      size_t skip = rest ? (size_t)(rest - input) + 1 : input_len;
+      memmove(input, input + skip, input_len - skip);
+      input_len -= skip;
+      discarding = rest == NULL;
+    }
+
+    size_t start = 0;
+    char* end;
+    while (!bot.quit &&
+           (end = memchr(input + start, '\n', input_len - start)) != NULL) {
+      *end = '\0';
+      if (end > input + start && end[-1] == '\r') end[-1] = '\0';
+      if (output_len + BOT_REPLY_MAX > sizeof(output)) {
+        if (!write_all(out_fd, output, output_len)) return false;
+        output_len = 0;
+      }
+      output_len += bot_protocol_execute(&bot, input + start,
+                                         output + output_len,
+                                         sizeof(output) - output_len);
+      start = (size_t)(end - input) + 1;
+    }
+    memmove(input, input + start, input_len - start);
+    input_len -= start;
+
+    // Ответы на всё, что пришло одним read(), уходят одним write()
+    if (!write_all(out_fd, output, output_len)) return false;
+    output_len = 0;
+    if (input_len == sizeof(input) - 1) {
+      static const char too_long[] = "error line too long\n";
+      if (!write_all(out_fd, too_long, sizeof(too_long) - 1)) return false;
+      input_len = 0;
+      discarding = true;
+    }
+  }
+  return true;
+}
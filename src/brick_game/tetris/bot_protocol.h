@@ -0,0 +1,74 @@
+/**
+ * @file bot_protocol.h
+ * @brief Line-based protocol for driving a headless game from a bot
+ *
+ * `tetris --protocol` reads one command per line from stdin and answers
+ * every command with exactly one line on stdout, in order:
+ *
+ *   new SEED [uniform|bag]   starts a game           -> ok
+ *   place ROTATION COLUMN    rotates, moves and drops -> ok CLEARED
+ *                            the falling piece, then
+ *                            runs ticks until the next
+ *                            piece appears
+ *   step N                   runs N ticks             -> ok TICK
+ *   state                    current game             -> state ...
+ *   quit                     ends the session         -> bye
+ *
+ * The state line is "state TICK SCORE LEVEL LINES PIECES PAUSE PIECE
+ * ROTATION ROW COLUMN NEXT FIELD", where FIELD is GAME_FIELD_HEIGHT groups
+ * of three hex digits, the locked cells of each row from the top with bit
+ * c for column c. Invalid commands are answered with "error REASON" and
+ * change nothing.
+ *
+ * Commands may be pipelined: the replies to everything that one read()
+ * returned are written with a single write().
+ */
+#ifndef BOT_PROTOCOL_H
+#define BOT_PROTOCOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "./session.h"
+
+#define BOT_INPUT_MAX 65536
+#define BOT_OUTPUT_MAX 65536
+#define BOT_REPLY_MAX 256
+#define BOT_STEP_MAX 1000000
+
+/**
+ * @brief State of one protocol connection
+ */
+typedef struct {
+  TetrisSession_t session;
+  bool started;  // Была ли команда new
+  bool quit;
+} BotProtocol_t;
+
+/**
+ * @brief Prepares a connection without a game
+ *
+ * @param[out] bot Connection state
+ */
+void bot_protocol_init(BotProtocol_t* bot);
+/**
+ * @brief Executes one command line
+ *
+ * @param[in,out] bot Connection state
+ * @param[in] line Command without the line break
+ * @param[out] reply Reply line including the line break
+ * @param[in] size Size of reply, at least BOT_REPLY_MAX
+ * @return size_t Length of the reply
+ */
+size_t bot_protocol_execute(BotProtocol_t* bot, const char* line, char* reply,
+                            size_t size);
+/**
+ * @brief Serves commands until quit or the end of input
+ *
+ * @param[in] in_fd Descriptor commands are read from
+ * @param[in] out_fd Descriptor replies are written to
+ * @return false if reading or writing failed
+ */
+bool bot_protocol_serve(int in_fd, int out_fd);
+
+#endif
@@ -0,0 +1,137 @@
+#include "./checkpoint.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint32_t record_checksum(const CheckpointRecord_t* record) {
+  uint32_t hash = 2166136261u;
+  const uint8_t* bytes = (const uint8_t*)&record->sequence;
+  for (size_t i = 0; i < sizeof(record->sequence); i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  bytes = (const uint8_t*)&record->body;
+  for (size_t i = 0; i < sizeof(record->body); i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+void checkpoint_encode(const CheckpointBody_t* body, uint32_t sequence,
+                       CheckpointRecord_t* record) {
+  memset(record, 0, sizeof(*record));
+  memcpy(record->magic, CHECKPOINT_MAGIC, sizeof(record->magic));
+  record->version = CHECKPOINT_VERSION;
+  record->size = sizeof(CheckpointBody_t);
+  record->sequence = sequence;
+  record->body = *body;
+  record->checksum = record_checksum(record);
+}
+
+bool checkpoint_decode(const CheckpointRecord_t* record,
+                       CheckpointBody_t* body) {
+  bool ok = memcmp(record->magic, CHECKPOINT_MAGIC, sizeof(record->magic)) ==
+                0 &&
+            record->version == CHECKPOINT_VERSION &&
+            record->size == sizeof(CheckpointBody_t) &&
+            record->sequence != 0 &&
+            record->checksum == record_checksum(record);
+  if (ok) *body = record->body;
+  return ok;
+}
+
+bool checkpoint_store_open(CheckpointStore_t* store, const char* path,
+                           uint32_t slot_count) {
+  memset(store, 0, sizeof(*store));
+  if (slot_count == 0) return false;
+
+  int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) return false;
+
+  size_t map_size = sizeof(CheckpointStoreHeader_t) +
+                    (size_t)slot_count * 2 * sizeof(CheckpointRecord_t);
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0;
+  bool fresh = ok && st.st_size != (off_t)map_size;
+  if (fresh) {
+    ok = ftruncate(fd, 0) == 0 && ftruncate(fd, (off_t)map_size) == 0;
+  }
+
+  void* map = MAP_FAILED;
+  if (ok) {
+    map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) return false;
+
+  store->header = (CheckpointStoreHeader_t*)map;
+  store->records = (CheckpointRecord_t*)(store->header + 1);
+  store->map_size = map_size;
+  store->slot_count = slot_count;
+
+  CheckpointStoreHeader_t* header = store->header;
+  if (memcmp(header->magic, CHECKPOINT_STORE_MAGIC, sizeof(header->magic)) !=
+          0 ||
+      header->version != CHECKPOINT_VERSION ||
+      header->slot_count != slot_count ||
+      header->record_size != sizeof(CheckpointRecord_t)) {
+    memset(map, 0, map_size);
+    memcpy(header->magic, CHECKPOINT_STORE_MAGIC, sizeof(header->magic));
+    header->version = CHECKPOINT_VERSION;
+    header->slot_count = slot_count;
+    header->record_size = sizeof(CheckpointRecord_t);
+  }
+  return true;
+}
+
+void checkpoint_store_close(CheckpointStore_t* store) {
+  if (store->header) munmap(store->header, store->map_size);
+  memset(store, 0, sizeof(*store));
+}
+
+/**
+ * Index of the valid copy with the highest sequence number, or -1.
+ */
+static int newest_copy(const CheckpointStore_t* store, uint32_t slot,
+                       CheckpointBody_t* body) {
+  const CheckpointRecord_t* copies = &store->records[slot * 2];
+  CheckpointBody_t candidate;
+  int newest = -1;
+
+  for (int i = 0; i < 2; i++) {
+    if (checkpoint_decode(&copies[i], &candidate) &&
+        (newest < 0 || copies[i].sequence > copies[newest].sequence)) {
+      newest = i;
+      if (body) *body = candidate;
+    }
+  }
+  return newest;
+}
+
+bool checkpoint_store_save(CheckpointStore_t* store, uint32_t slot,
+                           const CheckpointBody_t* body) {
+  if (!store->header || slot >= store->slot_count) return false;
+
+  int newest = newest_copy(store, slot, NULL);
+  uint32_t sequence =
+      newest < 0 ? 1 : store->records[slot * 2 + newest].sequence + 1;
+
+  // Пишем поверх старой копии, последняя удачная остаётся нетронутой
+  CheckpointRecord_t* target = &store->records[slot * 2 + (newest == 0)];
+  checkpoint_encode(body, sequence, target);
+  return true;
+}
+
+bool checkpoint_store_load(const CheckpointStore_t* store, uint32_t slot,
+                           CheckpointBody_t* body) {
+  if (!store->header || slot >= store->slot_count) return false;
+  return newest_copy(store, slot, body) >= 0;
+}
+
+void checkpoint_store_clear(CheckpointStore_t* store, uint32_t slot) {
+  if (store->header && slot < store->slot_count) {
+    memset(&store->records[slot * 2], 0, 2 * sizeof(CheckpointRecord_t));
+  }
+}
@@ -0,0 +1,136 @@
+/**
+ * @file checkpoint.h
+ * @brief Versioned session checkpoints and a memory-mapped slot file
+ *
+ * A checkpoint is a CheckpointRecord_t: a small header with version, size,
+ * sequence number and checksum, followed by the GameSnapshot_t of the game
+ * and its timer phase. The slot file holds a fixed number of slots, one per
+ * session, and is used in place through mmap(). Every slot has two copies
+ * that are written in turn, so a crash in the middle of a write still
+ * leaves the previous checkpoint intact.
+ */
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./frame.h"
+
+#define CHECKPOINT_MAGIC "BGCP"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_STORE_MAGIC "BGCS"
+
+/**
+ * @brief State of a game besides the snapshot
+ */
+typedef struct {
+  GameSnapshot_t state;
+  uint32_t timer_phase_ms;  // Сколько прошло с последнего тика
+  uint32_t game_start_tick;
+  uint32_t game_start_lines;
+  uint32_t reserved;
+} CheckpointBody_t;
+
+/**
+ * @brief Serialized checkpoint
+ */
+typedef struct {
+  char magic[4];
+  uint16_t version;
+  uint16_t size;      // sizeof(CheckpointBody_t) версии version
+  uint32_t sequence;  // Номер сохранения, 0 - пустая копия
+  uint32_t checksum;  // FNV-1a от sequence и body
+  CheckpointBody_t body;
+} CheckpointRecord_t;
+
+/**
+ * @brief Header of the slot file
+ */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t slot_count;
+  uint32_t record_size;
+} CheckpointStoreHeader_t;
+
+/**
+ * @brief Open slot file
+ *
+ * Slot i consists of records[2 * i] and records[2 * i + 1].
+ */
+typedef struct {
+  CheckpointStoreHeader_t* header;
+  CheckpointRecord_t* records;
+  size_t map_size;
+  uint32_t slot_count;
+} CheckpointStore_t;
+
+/**
+ * @brief Serializes a checkpoint
+ *
+ * @param[in] body State to store
+ * @param[in] sequence Sequence number, must not be 0
+ * @param[out] record Destination record
+ */
+void checkpoint_encode(const CheckpointBody_t* body, uint32_t sequence,
+                       CheckpointRecord_t* record);
+/**
+ * @brief Validates and deserializes a checkpoint
+ *
+ * @param[in] record Source record
+ * @param[out] body Stored state
+ * @return false if the record is empty, torn or of another version
+ */
+bool checkpoint_decode(const CheckpointRecord_t* record,
+                       CheckpointBody_t* body);
+
+/**
+ * @brief Opens or creates a slot file
+ *
+ * An existing file with the same number of slots keeps its checkpoints,
+ * any other file is reset.
+ *
+ * @param[out] store Store to initialize
+ * @param[in] path Slot file path
+ * @param[in] slot_count Number of slots
+ * @return false if the file could not be created or mapped
+ */
+bool checkpoint_store_open(CheckpointStore_t* store, const char* path,
+                           uint32_t slot_count);
+/**
+ * @brief Unmaps the slot file
+ *
+ * @param[in,out] store Open store
+ */
+void checkpoint_store_close(CheckpointStore_t* store);
+/**
+ * @brief Writes a checkpoint into a slot, replacing the older copy
+ *
+ * @param[in,out] store Open store
+ * @param[in] slot Slot index
+ * @param[in] body State to store
+ * @return false if the slot does not exist
+ */
+bool checkpoint_store_save(CheckpointStore_t* store, uint32_t slot,
+                           const CheckpointBody_t* body);
+/**
+ * @brief Reads the newest valid checkpoint of a slot
+ *
+ * @param[in] store Open store
+ * @param[in] slot Slot index
+ * @param[out] body Stored state
+ * @return false if the slot holds no valid checkpoint
+ */
+bool checkpoint_store_load(const CheckpointStore_t* store, uint32_t slot,
+                           CheckpointBody_t* body);
+/**
+ * @brief Empties a slot, for example when its game is over
+ *
+ * @param[in,out] store Open store
+ * @param[in] slot Slot index
+ */
+void checkpoint_store_clear(CheckpointStore_t* store, uint32_t slot);
+
+#endif
@@ -0,0 +1,154 @@
+#include "./frame.h"
+
+#include <string.h>
+
+void frame_capture(const GameInfo_t* state, const GameBlock_t* block,
+                   TetrisFrame_t* frame) {
+  memset(frame, 0, sizeof(*frame));
+  frame->piece = FRAME_NO_PIECE;
+  frame->next = FRAME_NO_PIECE;
+
+  if (!state) return;
+
+  if (state->field) {
+    for (int row = 0; row < GAME_FIELD_HEIGHT; row++) {
+      uint16_t mask = 0;
+      for (int col = 0; col < GAME_FIELD_WIDTH; col++) {
+        if (state->field[row][col] == 1) mask |= (uint16_t)(1u << col);
+      }
+      frame->rows[row] = mask;
+    }
+  }
+
+  if (block) {
+    if (block->name >= I && block->name <= Z) {
+      frame->piece = (int8_t)block->name;
+    }
+    frame->rotation = (int8_t)block->rotation;
+    frame->x = (int8_t)block->x;
+    frame->y = (int8_t)block->y;
+  }
+
+  if (state->next) frame->next = (int8_t)next_figure_type(state->next);
+  frame->level = (int8_t)state->level;
+  frame->pause = (int16_t)state->pause;
+  frame->score = state->score;
+}
+
+void frame_expand(const TetrisFrame_t* frame, GameInfo_t* state) {
+  for (int row = 0; row < GAME_FIELD_HEIGHT; row++) {
+    for (int col = 0; col < GAME_FIELD_WIDTH; col++) {
+      state->field[row][col] = (frame->rows[row] >> col) & 1;
+    }
+  }
+
+  if (frame->piece != FRAME_NO_PIECE) {
+    GameBlock_t block = {.name = (TetrominoName)frame->piece,
+                         .rotation = frame->rotation,
+                         .x = frame->x,
+                         .y = frame->y};
+    draw_temporary_figure(state, &block);
+  }
+
+  if (frame->next != FRAME_NO_PIECE) {
+    place_next_figure(state, frame->next);
+  } else {
+    empty_matrix(state->next, BLOCK_SIZE, BLOCK_SIZE);
+  }
+
+  state->level = frame->level;
+  state->pause = frame->pause;
+  state->score = frame->score;
+}
+
+void snapshot_capture(const GameInfo_t* state, const GameBlock_t* block,
+                      const EngineContext_t* engine, GameSnapshot_t* snapshot) {
+  memset(snapshot, 0, sizeof(*snapshot));
+  frame_capture(state, block, &snapshot->frame);
+
+  snapshot->rng = engine->rng;
+  snapshot->checksum = engine->checksum;
+  snapshot->tick = engine->tick;
+  snapshot->lines = engine->lines;
+  snapshot->pieces = engine->pieces;
+  snapshot->high_score = state->high_score;
+  snapshot->speed = state->speed;
+  snapshot->fsm = engine->fsm;
+}
+
+void snapshot_restore(const GameSnapshot_t* snapshot, GameInfo_t* state,
+                      GameBlock_t* block, EngineContext_t* engine) {
+  const TetrisFrame_t* frame = &snapshot->frame;
+
+  block->name = (TetrominoName)frame->piece;
+  block->rotation = frame->rotation;
+  block->x = frame->x;
+  block->y = frame->y;
+  block->coords = blockState(block->name, block->rotation);
+
+  frame_expand(frame, state);
+  state->high_score = snapshot->high_score;
+  state->speed = snapshot->speed;
+
+  engine->fsm = (FSM)snapshot->fsm;
+  engine->rng = snapshot->rng;
+  engine->tick = snapshot->tick;
+  engine->lines = snapshot->lines;
+  engine->pieces = snapshot->pieces;
+  engine->checksum = snapshot->checksum;
+}
+
+uint64_t frame_checksum(const TetrisFrame_t* frame, uint64_t checksum) {
+  const uint8_t* bytes = (const uint8_t*)frame;
+  uint64_t hash = checksum ^ 0xCBF29CE484222325ULL;
+
+  for (size_t i = 0; i < sizeof(*frame); i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+int next_figure_type(int** next) {
+  for (int i = 0; i < BLOCK_SIZE; i++) {
+    for (int j = 0; j < BLOCK_SIZE; j++) {
+      if (next[i][j] != 0) return next[i][j] - 1;
+    }
+  }
+  return FRAME_NO_PIECE;
+}
+
+void frame_history_init(FrameHistory_t* history, int depth) {
+  if (depth < 1) depth = 1;
+  if (depth > FRAME_HISTORY_MAX) depth = FRAME_HISTORY_MAX;
+
+  history->depth = depth;
+  history->count = 0;
+  history->head = 0;
+}
+
+void frame_history_push(FrameHistory_t* history, const TetrisFrame_t* frame) {
+  history->frames[history->head] = *frame;
+  history->frames[history->head + history->depth] = *frame;
+
+  history->head = (history->head + 1) % history->depth;
+  if (history->count < history->depth) history->count++;
+}
+
+FrameStackView_t frame_history_view(const FrameHistory_t* history) {
+  int start = history->head + history->depth - history->count;
+  FrameStackView_t view = {.frames = &history->frames[start],
+                           .depth = history->count,
+                           .stride = sizeof(TetrisFrame_t)};
+  return view;
+}
+
+FrameHistory_t* getFrameHistory(bool reset) {
+  static FrameHistory_t history;
+  static bool initialized = false;
+
+  if (!initialized || reset) {
+    frame_history_init(&history, FRAME_HISTORY_DEFAULT);
+    initialized = true;
+  }
+  return &history;
+}
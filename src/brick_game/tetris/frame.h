@@ -0,0 +1,170 @@
+/**
+ * @file frame.h
+ * @brief Compact board snapshots and the per-session frame history ring
+ */
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./backend.h"
+
+#define FRAME_HISTORY_MAX 32
+#define FRAME_HISTORY_DEFAULT 4
+#define FRAME_NO_PIECE -1
+
+/**
+ * @brief Compact snapshot of one game frame
+ *
+ * Locked cells are stored as one bitmask per row (bit c = column c), the
+ * active piece is stored as its pose instead of temporary field markers.
+ */
+typedef struct {
+  uint16_t rows[GAME_FIELD_HEIGHT];  // Заблокированные клетки поля
+  int8_t piece;                      // Активная фигура или FRAME_NO_PIECE
+  int8_t rotation;                   // Состояние поворота
+  int8_t x, y;                       // Координаты якоря на поле
+  int8_t next;                       // Фигура в превью или FRAME_NO_PIECE
+  int8_t level;
+  int16_t pause;
+  int32_t score;
+} TetrisFrame_t;
+
+/**
+ * @brief Everything needed to continue a game exactly, in a fixed layout
+ *
+ * Contains no pointers, so it can be stored in files and shared memory
+ * as raw bytes. Padding is always zeroed.
+ */
+typedef struct {
+  TetrisFrame_t frame;  // Поле, фигура, превью, уровень, пауза, счёт
+  PieceRng_t rng;
+  uint64_t checksum;
+  uint32_t tick;
+  uint32_t lines;
+  uint32_t pieces;
+  int32_t high_score;
+  int32_t speed;
+  int32_t fsm;
+} GameSnapshot_t;
+
+/**
+ * @brief Ring of the last K frames of one session
+ *
+ * Every frame is written twice (at slot and slot + depth), so the last K
+ * frames always form one contiguous window and can be handed out without
+ * copying.
+ */
+typedef struct {
+  TetrisFrame_t frames[FRAME_HISTORY_MAX * 2];
+  int depth;
+  int count;
+  int head;
+} FrameHistory_t;
+
+/**
+ * @brief Read-only view of the stacked frames, oldest first
+ *
+ * Frame k starts at (const char*)frames + k * stride. The view stays valid
+ * until the next frame_history_push() on the same history.
+ */
+typedef struct {
+  const TetrisFrame_t* frames;
+  int depth;
+  size_t stride;
+} FrameStackView_t;
+
+/**
+ * @brief Encodes the current game state into a compact frame
+ *
+ * Only cells with value 1 are treated as locked; temporary figure markers
+ * (value 2) are replaced by the pose of the block. The pose is stored even
+ * before the first spawn, when the block has no tetromino yet.
+ *
+ * @param[in] state Game state to encode
+ * @param[in] block Active block, may be NULL
+ * @param[out] frame Destination frame
+ */
+void frame_capture(const GameInfo_t* state, const GameBlock_t* block,
+                   TetrisFrame_t* frame);
+/**
+ * @brief Decodes a compact frame back into a GameInfo_t matrix layout
+ *
+ * Writes locked cells as 1, the active piece as 2 and the preview figure
+ * into state->next, the same way updateCurrentState() exposes them.
+ *
+ * @param[in] frame Source frame
+ * @param[out] state State with allocated field and next matrices
+ */
+void frame_expand(const TetrisFrame_t* frame, GameInfo_t* state);
+/**
+ * @brief Captures a full game snapshot
+ *
+ * @param[in] state Game state
+ * @param[in] block Active block
+ * @param[in] engine Engine context of the game
+ * @param[out] snapshot Destination snapshot
+ */
+void snapshot_capture(const GameInfo_t* state, const GameBlock_t* block,
+                      const EngineContext_t* engine, GameSnapshot_t* snapshot);
+/**
+ * @brief Restores a game from a snapshot
+ *
+ * The persist flag of the engine context is left unchanged.
+ *
+ * @param[in] snapshot Source snapshot
+ * @param[out] state State with allocated field and next matrices
+ * @param[out] block Active block
+ * @param[out] engine Engine context of the game
+ */
+void snapshot_restore(const GameSnapshot_t* snapshot, GameInfo_t* state,
+                      GameBlock_t* block, EngineContext_t* engine);
+/**
+ * @brief Folds a frame into a running checksum
+ *
+ * @param[in] frame Frame to hash
+ * @param[in] checksum Checksum of the previous frames, 0 for the first one
+ * @return uint64_t Updated checksum
+ */
+uint64_t frame_checksum(const TetrisFrame_t* frame, uint64_t checksum);
+/**
+ * @brief Returns the tetromino type shown in the preview matrix
+ *
+ * @param[in] next Preview matrix (BLOCK_SIZE x BLOCK_SIZE)
+ * @return int Tetromino type or FRAME_NO_PIECE if the preview is empty
+ */
+int next_figure_type(int** next);
+
+/**
+ * @brief Clears the history and sets how many frames it keeps
+ *
+ * @param[out] history History to initialize
+ * @param[in] depth Number of frames to keep, clamped to 1..FRAME_HISTORY_MAX
+ */
+void frame_history_init(FrameHistory_t* history, int depth);
+/**
+ * @brief Appends a frame, dropping the oldest one when the ring is full
+ *
+ * @param[in,out] history Frame history
+ * @param[in] frame Frame to store
+ */
+void frame_history_push(FrameHistory_t* history, const TetrisFrame_t* frame);
+/**
+ * @brief Returns the last frames as a contiguous view without copying
+ *
+ * @param[in] history Frame history
+ * @return FrameStackView_t View of history->count frames, oldest first
+ */
+FrameStackView_t frame_history_view(const FrameHistory_t* history);
+/**
+ * @brief Gets or resets the frame history of the current game
+ *
+ * getCurrentState() pushes a frame into it after every game tick.
+ *
+ * @param[in] reset Whether to clear the history
+ * @return FrameHistory_t* Pointer to the singleton history
+ */
+FrameHistory_t* getFrameHistory(bool reset);
+
+#endif
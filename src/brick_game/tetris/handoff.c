@@ -0,0 +1,298 @@
+#define _GNU_SOURCE
+#include "./handoff.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static bool map_segment(Handoff_t* handoff, size_t size, bool create) {
+  void* map = mmap(NULL, size, PROT_READ | (create ? PROT_WRITE : 0),
+                   MAP_SHARED, handoff->memfd, 0);
+  if (map == MAP_FAILED) return false;
+
+  handoff->header = (HandoffHeader_t*)map;
+  handoff->sessions = (HandoffSession_t*)(handoff->header + 1);
+  handoff->map_size = size;
+  return true;
+}
+
+bool handoff_create(Handoff_t* handoff, uint32_t session_count) {
+  memset(handoff, 0, sizeof(*handoff));
+  handoff->memfd = memfd_create("brick_game_handoff", MFD_CLOEXEC);
+  if (handoff->memfd < 0) return false;
+
+  size_t size = sizeof(HandoffHeader_t) +
+                (size_t)session_count * sizeof(HandoffSession_t);
+  if (ftruncate(handoff->memfd, (off_t)size) != 0 ||
+      !map_segment(handoff, size, true)) {
+    handoff_close(handoff);
+    return false;
+  }
+
+  HandoffHeader_t* header = handoff->header;
+  memcpy(header->magic, HANDOFF_MAGIC, sizeof(header->magic));
+  header->version = HANDOFF_VERSION;
+  header->record_version = CHECKPOINT_VERSION;
+  header->record_size = sizeof(HandoffSession_t);
+  header->session_count = session_count;
+  return true;
+}
+
+void handoff_put_session(Handoff_t* handoff, uint32_t index, uint64_t id,
+                         const TetrisSession_t* session) {
+  if (!handoff->header || index >= handoff->header->session_count) return;
+
+  CheckpointBody_t body;
+  session_checkpoint(session, &body);
+  handoff->sessions[index].id = id;
+  checkpoint_encode(&body, 1, &handoff->sessions[index].record);
+}
+
+static bool socket_address(const char* path, struct sockaddr_un* address) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address->sun_path)) return false;
+  strcpy(address->sun_path, path);
+  return true;
+}
+
+int handoff_listen(const char* path) {
+  // Путь появляется уже у слушающего сокета, новый процесс может ждать его
+  // и подключаться сразу
+  char staged[sizeof(((struct sockaddr_un*)0)->sun_path)];
+  struct sockaddr_un address;
+  if (snprintf(staged, sizeof(staged), "%s.new", path) >= (int)sizeof(staged) ||
+      !socket_address(staged, &address)) {
+    return -1;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+
+  unlink(staged);
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+      listen(fd, 1) != 0 || rename(staged, path) != 0) {
+    unlink(staged);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * Sends one message: a 32-bit word in the data and up to
+ * HANDOFF_MAX_FDS + 1 descriptors in SCM_RIGHTS.
+ */
+static bool send_fds(int socket_fd, uint32_t word, const int* fds,
+                     int count) {
+  struct iovec iov = {.iov_base = &word, .iov_len = sizeof(word)};
+  union {
+    char buffer[CMSG_SPACE((HANDOFF_MAX_FDS + 1) * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  memset(&control, 0, sizeof(control));
+
+  struct msghdr message = {0};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = CMSG_SPACE((size_t)count * sizeof(int));
+
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN((size_t)count * sizeof(int));
+  memcpy(CMSG_DATA(cmsg), fds, (size_t)count * sizeof(int));
+  return sendmsg(socket_fd, &message, MSG_NOSIGNAL) == (ssize_t)sizeof(word);
+}
+
+/**
+ * Receives one message of send_fds() into fds, which must hold
+ * HANDOFF_MAX_FDS + 1 descriptors. Returns the number of descriptors; word
+ * is UINT32_MAX if the data could not be read or descriptors were cut off.
+ */
+static int receive_fds(int socket_fd, uint32_t* word, int* fds) {
+  struct iovec iov = {.iov_base = word, .iov_len = sizeof(*word)};
+  union {
+    char buffer[CMSG_SPACE((HANDOFF_MAX_FDS + 1) * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct msghdr message = {0};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = sizeof(control.buffer);
+
+  ssize_t got = recvmsg(socket_fd, &message, MSG_CMSG_CLOEXEC);
+  // Не поместившиеся дескрипторы ядро отбросило, счёт уже не сойдётся
+  if (got != (ssize_t)sizeof(*word) || (message.msg_flags & MSG_CTRUNC)) {
+    *word = UINT32_MAX;
+  }
+  // Дескрипторы уже наши, даже если данные не дошли, их закроет вызывающий
+  struct cmsghdr* cmsg = got >= 0 ? CMSG_FIRSTHDR(&message) : NULL;
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS) {
+    return 0;
+  }
+  int received = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+  memcpy(fds, CMSG_DATA(cmsg), (size_t)received * sizeof(int));
+  return received;
+}
+
+/**
+ * Waits for the answer of the new process. One that hangs counts as a
+ * refusal, so the old process can start serving again.
+ */
+static bool read_ack(int client) {
+  struct pollfd ready = {.fd = client, .events = POLLIN};
+  int waited;
+  do {
+    waited = poll(&ready, 1, HANDOFF_ACK_TIMEOUT_MS);
+  } while (waited < 0 && errno == EINTR);
+
+  uint8_t ack = 0;
+  return waited == 1 && read(client, &ack, 1) == 1 && ack == 1;
+}
+
+bool handoff_send(const Handoff_t* handoff, int listen_fd, const int* fds,
+                  int fd_count) {
+  if (!handoff->header || fd_count < 0 || fd_count > HANDOFF_FD_LIMIT) {
+    return false;
+  }
+
+  int client;
+  do {
+    client = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+  } while (client < 0 && errno == EINTR);
+  if (client < 0) return false;
+  // Зависший приёмник не должен держать и отправку
+  struct timeval timeout = {.tv_sec = HANDOFF_ACK_TIMEOUT_MS / 1000};
+  setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  // Первое сообщение несёт сегмент и общее число дескрипторов, следующие -
+  // очередную пачку дескрипторов и её размер
+  int first[HANDOFF_MAX_FDS + 1];
+  int batch = fd_count < HANDOFF_MAX_FDS ? fd_count : HANDOFF_MAX_FDS;
+  first[0] = handoff->memfd;
+  if (batch) memcpy(first + 1, fds, (size_t)batch * sizeof(int));
+  bool ok = send_fds(client, (uint32_t)fd_count, first, batch + 1);
+  for (int sent = batch; ok && sent < fd_count; sent += batch) {
+    batch = fd_count - sent < HANDOFF_MAX_FDS ? fd_count - sent
+                                              : HANDOFF_MAX_FDS;
+    ok = send_fds(client, (uint32_t)batch, fds + sent, batch);
+  }
+
+  ok = ok && read_ack(client);
+  close(client);
+  return ok;
+}
+
+static bool header_matches(const Handoff_t* handoff, size_t size) {
+  const HandoffHeader_t* header = handoff->header;
+  return size >= sizeof(HandoffHeader_t) &&
+         memcmp(header->magic, HANDOFF_MAGIC, sizeof(header->magic)) == 0 &&
+         header->version == HANDOFF_VERSION &&
+         header->record_version == CHECKPOINT_VERSION &&
+         header->record_size == sizeof(HandoffSession_t) &&
+         size >= sizeof(HandoffHeader_t) +
+                     (size_t)header->session_count * sizeof(HandoffSession_t);
+}
+
+bool handoff_receive(Handoff_t* handoff, const char* path) {
+  memset(handoff, 0, sizeof(*handoff));
+  handoff->memfd = -1;
+
+  struct sockaddr_un address;
+  if (!socket_address(path, &address)) return false;
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return false;
+  if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+    close(fd);
+    return false;
+  }
+
+  uint32_t count = 0;
+  int passed[HANDOFF_MAX_FDS + 1];
+  int received = receive_fds(fd, &count, passed);
+  // Сегмент переходит к handoff сразу, handoff_close() закроет его при
+  // любом отказе
+  if (received >= 1) handoff->memfd = passed[0];
+  uint32_t batch = count < HANDOFF_MAX_FDS ? count : HANDOFF_MAX_FDS;
+  bool ok = received >= 1 && count <= HANDOFF_FD_LIMIT &&
+            (uint32_t)received == batch + 1;
+  if (ok && count) {
+    handoff->fds = (int*)malloc(count * sizeof(int));
+    ok = handoff->fds != NULL;
+  }
+  if (ok) {
+    if (batch) memcpy(handoff->fds, passed + 1, batch * sizeof(int));
+    handoff->fd_count = (int)batch;
+  } else {
+    for (int i = 1; i < received; i++) close(passed[i]);
+  }
+
+  while (ok && (uint32_t)handoff->fd_count < count) {
+    received = receive_fds(fd, &batch, passed);
+    ok = received > 0 && (uint32_t)received == batch &&
+         batch <= count - (uint32_t)handoff->fd_count;
+    if (ok) {
+      memcpy(handoff->fds + handoff->fd_count, passed,
+             batch * sizeof(int));
+      handoff->fd_count += received;
+    } else {
+      for (int i = 0; i < received; i++) close(passed[i]);
+    }
+  }
+
+  struct stat st;
+  if (ok) {
+    ok = fstat(handoff->memfd, &st) == 0 &&
+         map_segment(handoff, (size_t)st.st_size, false) &&
+         header_matches(handoff, (size_t)st.st_size);
+  }
+
+  uint8_t ack = ok ? 1 : 0;
+  ok = send(fd, &ack, 1, MSG_NOSIGNAL) == 1 && ok;
+  close(fd);
+
+  if (!ok) {
+    // Старый процесс продолжит работу со своими копиями дескрипторов
+    for (int i = 0; i < handoff->fd_count; i++) close(handoff->fds[i]);
+    handoff_close(handoff);
+  }
+  return ok;
+}
+
+bool handoff_take_session(const Handoff_t* handoff, uint32_t index,
+                          uint64_t* id, TetrisSession_t* session) {
+  if (!handoff->header || index >= handoff->header->session_count) {
+    return false;
+  }
+
+  CheckpointBody_t body;
+  const HandoffSession_t* entry = &handoff->sessions[index];
+  if (!checkpoint_decode(&entry->record, &body)) return false;
+
+  session_load_checkpoint(session, &body);
+  *id = entry->id;
+  return true;
+}
+
+void handoff_close(Handoff_t* handoff) {
+  if (handoff->header) munmap(handoff->header, handoff->map_size);
+  if (handoff->memfd >= 0) close(handoff->memfd);
+  free(handoff->fds);
+  handoff->header = NULL;
+  handoff->sessions = NULL;
+  handoff->memfd = -1;
+  handoff->fds = NULL;
+  handoff->fd_count = 0;
+}
@@ -0,0 +1,142 @@
+/**
+ * @file handoff.h
+ * @brief Hands live sessions and descriptors over to a new process
+ *
+ * The old process copies every session into a memfd segment as versioned
+ * CheckpointRecord_t entries and sends that segment, together with its
+ * listening and client descriptors, over a Unix socket with SCM_RIGHTS,
+ * at most HANDOFF_MAX_FDS descriptors per message. The new
+ * process maps the segment, checks the layout versions and answers with an
+ * acknowledgement; only then may the old process exit. If the versions do
+ * not match the new process refuses and the old one keeps serving.
+ *
+ * Typical sequence: the old process calls handoff_listen(), starts the new
+ * binary, stops advancing its sessions, fills a Handoff_t and calls
+ * handoff_send(). The new binary calls handoff_receive() and
+ * handoff_take_session() for every session.
+ */
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./checkpoint.h"
+#include "./session.h"
+
+#define HANDOFF_MAGIC "BGHO"
+#define HANDOFF_VERSION 2
+#define HANDOFF_MAX_FDS 16            // Дескрипторов в одном сообщении
+#define HANDOFF_FD_LIMIT 65536        // Дескрипторов за всю передачу
+#define HANDOFF_CLIENT_SIZE 64        // Данные вызывающего о сессии
+#define HANDOFF_ACK_TIMEOUT_MS 30000  // Ожидание ответа нового процесса
+
+/**
+ * @brief One session in the handoff segment
+ */
+typedef struct {
+  uint64_t id;
+  uint8_t client[HANDOFF_CLIENT_SIZE];  // Движок их не читает
+  CheckpointRecord_t record;
+} HandoffSession_t;
+
+/**
+ * @brief Layout description at the start of the handoff segment
+ */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t record_version;  // CHECKPOINT_VERSION отправителя
+  uint32_t record_size;     // sizeof(HandoffSession_t) отправителя
+  uint32_t session_count;
+  uint32_t reserved;
+} HandoffHeader_t;
+
+/**
+ * @brief Handoff segment and the descriptors that travel with it
+ */
+typedef struct {
+  int memfd;
+  HandoffHeader_t* header;
+  HandoffSession_t* sessions;
+  size_t map_size;
+  int* fds;  // Принятые дескрипторы, массив освобождает handoff_close()
+  int fd_count;
+} Handoff_t;
+
+/**
+ * @brief Creates an empty segment for the given number of sessions
+ *
+ * @param[out] handoff Handoff to initialize
+ * @param[in] session_count Number of sessions
+ * @return false if the segment could not be created
+ */
+bool handoff_create(Handoff_t* handoff, uint32_t session_count);
+/**
+ * @brief Stores a session in the segment
+ *
+ * Whatever else the caller needs to resume the session, such as the state
+ * of its connection, goes into HandoffSession_t.client of the same entry.
+ *
+ * @param[in,out] handoff Created handoff
+ * @param[in] index Position in the segment
+ * @param[in] id Session identifier of the caller
+ * @param[in] session Session to hand over
+ */
+void handoff_put_session(Handoff_t* handoff, uint32_t index, uint64_t id,
+                         const TetrisSession_t* session);
+/**
+ * @brief Creates the Unix socket the new process connects to
+ *
+ * The path appears only once the socket listens, so the new process can
+ * wait for it and connect right away.
+ *
+ * @param[in] path Socket path, an existing file is replaced
+ * @return int Listening socket or -1
+ */
+int handoff_listen(const char* path);
+/**
+ * @brief Waits for the new process and sends it the segment and descriptors
+ *
+ * @param[in] handoff Filled handoff
+ * @param[in] listen_fd Socket from handoff_listen()
+ * @param[in] fds Descriptors to pass, for example listening and client
+ * sockets
+ * @param[in] fd_count Number of descriptors, at most HANDOFF_FD_LIMIT
+ * @return true if the new process adopted the sessions; false if it
+ * refused or did not take the descriptors and answer within
+ * HANDOFF_ACK_TIMEOUT_MS
+ */
+bool handoff_send(const Handoff_t* handoff, int listen_fd, const int* fds,
+                  int fd_count);
+/**
+ * @brief Connects to the old process and adopts its segment and descriptors
+ *
+ * @param[out] handoff Received handoff, release with handoff_close()
+ * @param[in] path Socket path given to handoff_listen()
+ * @return false if nothing was received or the layout versions differ
+ */
+bool handoff_receive(Handoff_t* handoff, const char* path);
+/**
+ * @brief Restores a session from a received segment
+ *
+ * @param[in] handoff Received handoff
+ * @param[in] index Position in the segment
+ * @param[out] id Session identifier
+ * @param[out] session Restored session
+ * @return false if the record is damaged or out of range
+ */
+bool handoff_take_session(const Handoff_t* handoff, uint32_t index,
+                          uint64_t* id, TetrisSession_t* session);
+/**
+ * @brief Releases the segment
+ *
+ * Passed descriptors in fds stay open, they belong to the caller; only the
+ * array is freed.
+ *
+ * @param[in,out] handoff Handoff to release
+ */
+void handoff_close(Handoff_t* handoff);
+
+#endif
@@ -0,0 +1,102 @@
+#include "./input_queue.h"
+
+#include <string.h>
+
+static bool auto_shifts(int action) {
+  return action == Left || action == Right || action == Down;
+}
+
+static void push(InputQueue_t* queue, uint64_t time, int action,
+                 bool repeat) {
+  if (queue->count == INPUT_QUEUE_SIZE) {
+    queue->dropped++;
+    return;
+  }
+  InputEvent_t* event =
+      &queue->events[(queue->head + queue->count) % INPUT_QUEUE_SIZE];
+  event->time = time;
+  event->action = (UserAction_t)action;
+  event->repeat = repeat;
+  queue->count++;
+}
+
+static void emit_shifts(InputQueue_t* queue, uint64_t until) {
+  while (queue->next_shift && queue->next_shift <= until) {
+    if (queue->arr == 0) {
+      for (int i = 0; i < INPUT_INSTANT_SHIFTS; i++) {
+        push(queue, queue->next_shift, queue->held, true);
+      }
+      queue->next_shift = 0;
+    } else {
+      push(queue, queue->next_shift, queue->held, true);
+      queue->next_shift += queue->arr;
+    }
+  }
+}
+
+void input_queue_init(InputQueue_t* queue, uint64_t das, uint64_t arr) {
+  memset(queue, 0, sizeof(*queue));
+  queue->das = das;
+  queue->arr = arr;
+  queue->held = INPUT_NO_ACTION;
+}
+
+void input_queue_key(InputQueue_t* queue, UserAction_t action, uint64_t now) {
+  input_queue_advance(queue, now);
+  bool same = queue->held == (int)action;
+  uint64_t gap = now - queue->last_seen;
+
+  // До задержки терминала повторов ещё нет, быстрое второе нажатие -
+  // настоящее
+  bool repeat = same && gap <= INPUT_REPEAT_GAP_NS &&
+                now - queue->held_since >= INPUT_REPEAT_DELAY_NS;
+  if (repeat) {
+    // Повтор терминала: клавиша всё ещё зажата, сдвигает уже наш таймер
+    queue->last_seen = now;
+    if (auto_shifts(action) && !queue->shifting) {
+      uint64_t due = queue->held_since + queue->das;
+      queue->shifting = true;
+      queue->next_shift = due > now ? due : now;
+      emit_shifts(queue, now);
+    }
+    return;
+  }
+
+  // Первый повтор терминала приходит после его задержки, DAS считаем от
+  // настоящего нажатия
+  if (!same || gap < INPUT_REPEAT_DELAY_NS || gap > INPUT_HOLD_DELAY_NS) {
+    queue->held_since = now;
+  }
+  queue->held = (int)action;
+  queue->last_seen = now;
+  queue->shifting = false;
+  queue->next_shift = 0;
+  push(queue, now, (int)action, false);
+}
+
+void input_queue_advance(InputQueue_t* queue, uint64_t now) {
+  if (!queue->shifting) return;
+
+  uint64_t release = queue->last_seen + INPUT_REPEAT_GAP_NS;
+  emit_shifts(queue, now < release ? now : release);
+  if (now > release) {
+    queue->shifting = false;
+    queue->next_shift = 0;
+    queue->held = INPUT_NO_ACTION;
+  }
+}
+
+bool input_queue_pop(InputQueue_t* queue, InputEvent_t* event) {
+  if (queue->count == 0) return false;
+  *event = queue->events[queue->head];
+  queue->head = (queue->head + 1) % INPUT_QUEUE_SIZE;
+  queue->count--;
+  return true;
+}
+
+uint64_t input_queue_deadline(const InputQueue_t* queue) {
+  if (!queue->shifting) return 0;
+  uint64_t release = queue->last_seen + INPUT_REPEAT_GAP_NS + 1;
+  return queue->next_shift && queue->next_shift < release ? queue->next_shift
+                                                          : release;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file input_queue.h
+ * @brief Timestamped queue of player actions with DAS and ARR auto-repeat
+ *
+ * The front end drains every pending key into the queue at once, each
+ * with the time it was read, and applies everything the queue returns
+ * before the next frame.
+ *
+ * Left, Right and Down auto-shift: after a key has been held for the
+ * delayed auto-shift time (DAS) the queue generates a repeat every
+ * auto-repeat rate (ARR), stamped with the exact time it was due. A
+ * terminal reports no key releases, only its own repeats, so a key counts
+ * as held while repeats arrive closer than INPUT_REPEAT_GAP_NS apart and
+ * as released once they stop. A terminal starts repeating only after its
+ * initial delay, so a key pressed again sooner than INPUT_REPEAT_DELAY_NS
+ * after the first press is a real press and is queued. Repeats of other
+ * keys are dropped, so a held rotation does not spin the piece.
+ */
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../../common/common.h"
+
+#define INPUT_QUEUE_SIZE 64
+#define INPUT_NO_ACTION -1
+#define INPUT_DAS_DEFAULT_NS 170000000ULL
+#define INPUT_ARR_DEFAULT_NS 50000000ULL
+#define INPUT_REPEAT_GAP_NS 80000000ULL     // Чаще - автоповтор терминала
+#define INPUT_REPEAT_DELAY_NS 200000000ULL  // Раньше повторов не бывает
+#define INPUT_HOLD_DELAY_NS 750000000ULL    // Задержка автоповтора терминала
+#define INPUT_INSTANT_SHIFTS GAME_FIELD_HEIGHT  // Сдвигов при ARR = 0
+
+/**
+ * @brief One action taken from the queue
+ */
+typedef struct {
+  uint64_t time;  // Когда нажата клавиша или наступил повтор, нс
+  UserAction_t action;
+  bool repeat;  // Сгенерировано автоповтором
+} InputEvent_t;
+
+/**
+ * @brief Action queue and auto-repeat state of one player
+ */
+typedef struct {
+  InputEvent_t events[INPUT_QUEUE_SIZE];
+  uint32_t head;
+  uint32_t count;
+  uint32_t dropped;  // События, не поместившиеся в очередь
+  uint64_t das;
+  uint64_t arr;
+  int held;              // Последняя клавиша или INPUT_NO_ACTION
+  uint64_t held_since;   // Нажатие, с которого мог начаться автоповтор
+  uint64_t last_seen;    // Последнее событие этой клавиши
+  bool shifting;         // Идёт автоповтор
+  uint64_t next_shift;   // Время следующего повтора, 0 - больше не будет
+} InputQueue_t;
+
+/**
+ * @brief Prepares an empty queue
+ *
+ * @param[out] queue Queue
+ * @param[in] das Delayed auto-shift in nanoseconds
+ * @param[in] arr Auto-repeat rate in nanoseconds, 0 shifts to the wall at
+ * once
+ */
+void input_queue_init(InputQueue_t* queue, uint64_t das, uint64_t arr);
+/**
+ * @brief Adds a key read from the terminal
+ *
+ * @param[in,out] queue Queue
+ * @param[in] action Action of the key
+ * @param[in] now Time the key was read in nanoseconds
+ */
+void input_queue_key(InputQueue_t* queue, UserAction_t action, uint64_t now);
+/**
+ * @brief Generates the repeats due by now and ends released holds
+ *
+ * @param[in,out] queue Queue
+ * @param[in] now Current time in nanoseconds
+ */
+void input_queue_advance(InputQueue_t* queue, uint64_t now);
+/**
+ * @brief Takes the oldest action
+ *
+ * @param[in,out] queue Queue
+ * @param[out] event Action
+ * @return false if the queue is empty
+ */
+bool input_queue_pop(InputQueue_t* queue, InputEvent_t* event);
+/**
+ * @brief Time the queue has to be advanced next
+ *
+ * @param[in] queue Queue
+ * @return uint64_t Next repeat or release time in nanoseconds, 0 if none
+ */
+uint64_t input_queue_deadline(const InputQueue_t* queue);
+
+#endif
@@ -0,0 +1,463 @@
+#include "./io_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static void kick(IoWriter_t* writer) {
+  if (atomic_exchange(&writer->idle, false)) {
+    uint64_t one = 1;
+    if (write(writer->event_fd, &one, sizeof(one)) < 0) {
+      // Счётчик eventfd переполниться не может, поток и так проснётся
+    }
+  }
+}
+
+static void notify_progress(IoWriter_t* writer) {
+  if (atomic_load(&writer->waiters) > 0) {
+    pthread_mutex_lock(&writer->lock);
+    pthread_cond_broadcast(&writer->progress);
+    pthread_mutex_unlock(&writer->lock);
+  }
+}
+
+static void uring_release(IoWriter_t* writer) {
+  if (writer->uring.sqes) munmap(writer->uring.sqes, writer->uring.sqes_size);
+  if (writer->uring.cq_map && writer->uring.cq_map != writer->uring.sq_map) {
+    munmap(writer->uring.cq_map, writer->uring.cq_map_size);
+  }
+  if (writer->uring.sq_map) {
+    munmap(writer->uring.sq_map, writer->uring.sq_map_size);
+  }
+  if (writer->uring.fd >= 0) close(writer->uring.fd);
+  memset(&writer->uring, 0, sizeof(writer->uring));
+  writer->uring.fd = -1;
+}
+
+static bool uring_supports_write(int fd) {
+  size_t size = sizeof(struct io_uring_probe) +
+                IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe* probe = calloc(1, size);
+  if (!probe) return false;
+
+  // Ядра без IORING_REGISTER_PROBE не знают и IORING_OP_WRITE
+  bool supported = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE,
+                           probe, IORING_OP_LAST) == 0 &&
+                   probe->last_op >= IORING_OP_WRITE &&
+                   (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+  free(probe);
+  return supported;
+}
+
+static bool uring_setup(IoWriter_t* writer) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  writer->uring.fd =
+      (int)syscall(__NR_io_uring_setup, IO_WRITER_QUEUE_DEPTH, &params);
+  if (writer->uring.fd < 0) {
+    writer->uring.fd = -1;
+    return false;
+  }
+  if (!uring_supports_write(writer->uring.fd)) {
+    uring_release(writer);
+    return false;
+  }
+
+  writer->uring.sq_map_size =
+      params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  writer->uring.cq_map_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  writer->uring.sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  bool single_map = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_map && writer->uring.cq_map_size > writer->uring.sq_map_size) {
+    writer->uring.sq_map_size = writer->uring.cq_map_size;
+  }
+
+  void* sq_map = mmap(NULL, writer->uring.sq_map_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, writer->uring.fd,
+                      IORING_OFF_SQ_RING);
+  writer->uring.sq_map = sq_map == MAP_FAILED ? NULL : sq_map;
+  void* cq_map = single_map ? sq_map
+                            : mmap(NULL, writer->uring.cq_map_size,
+                                   PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_POPULATE, writer->uring.fd,
+                                   IORING_OFF_CQ_RING);
+  writer->uring.cq_map = cq_map == MAP_FAILED ? NULL : cq_map;
+  void* sqes = mmap(NULL, writer->uring.sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, writer->uring.fd,
+                    IORING_OFF_SQES);
+  writer->uring.sqes = sqes == MAP_FAILED ? NULL : sqes;
+  if (!writer->uring.sq_map || !writer->uring.cq_map || !writer->uring.sqes) {
+    uring_release(writer);
+    return false;
+  }
+
+  uint8_t* sq = (uint8_t*)writer->uring.sq_map;
+  uint8_t* cq = (uint8_t*)writer->uring.cq_map;
+  writer->uring.sq_head = (unsigned*)(sq + params.sq_off.head);
+  writer->uring.sq_tail = (unsigned*)(sq + params.sq_off.tail);
+  writer->uring.sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+  writer->uring.sq_array = (unsigned*)(sq + params.sq_off.array);
+  writer->uring.cq_head = (unsigned*)(cq + params.cq_off.head);
+  writer->uring.cq_tail = (unsigned*)(cq + params.cq_off.tail);
+  writer->uring.cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+  writer->uring.cqes = cq + params.cq_off.cqes;
+
+  writer->queue_depth = params.sq_entries < params.cq_entries
+                            ? params.sq_entries
+                            : params.cq_entries;
+  return true;
+}
+
+static void finish_write(IoWriter_t* writer, IoStream_t* stream, int64_t res) {
+  uint64_t latency = monotonic_ns() - stream->submitted_ns;
+  uint64_t tail = atomic_load(&stream->tail);
+
+  if (res > 0) {
+    atomic_fetch_add(&writer->bytes, (uint64_t)res);
+    tail += (uint64_t)res;
+    stream->retries = 0;
+  } else if ((res == -EINVAL || res == -EOPNOTSUPP) &&
+             writer->backend == IO_BACKEND_URING) {
+    // Ядро не умеет писать в этот файл через io_uring, дальше pwrite()
+    writer->backend = IO_BACKEND_THREAD;
+  } else if ((res == -EAGAIN || res == -EINTR) &&
+             stream->retries < IO_WRITER_MAX_RETRIES) {
+    // Временная ошибка, tail не двигаем и отправляем те же байты заново
+    stream->retries++;
+    atomic_fetch_add(&writer->failures, 1);
+  } else {
+    // Данные не записать, пропускаем их, чтобы не повторять бесконечно
+    atomic_store(&stream->failed, true);
+    atomic_fetch_add(&writer->failures, 1);
+    tail += stream->in_flight_len;
+    stream->retries = 0;
+  }
+  atomic_fetch_add(&writer->writes, 1);
+  atomic_fetch_add(&writer->latency_total_ns, latency);
+  uint64_t max = atomic_load(&writer->latency_max_ns);
+  while (latency > max &&
+         !atomic_compare_exchange_weak(&writer->latency_max_ns, &max,
+                                       latency)) {
+  }
+
+  stream->in_flight = false;
+  atomic_fetch_sub(&writer->queue_depth_now, 1);
+  atomic_store(&stream->tail, tail);
+  notify_progress(writer);
+}
+
+static void uring_push(IoWriter_t* writer, IoStream_t* stream,
+                       const uint8_t* data, uint32_t len, uint64_t offset) {
+  unsigned tail = *writer->uring.sq_tail;
+  unsigned index = tail & *writer->uring.sq_mask;
+  struct io_uring_sqe* sqe = &((struct io_uring_sqe*)writer->uring.sqes)[index];
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = stream->fd;
+  sqe->off = offset;
+  sqe->addr = (uint64_t)(uintptr_t)data;
+  sqe->len = len;
+  sqe->user_data = (uint64_t)(uintptr_t)stream;
+
+  writer->uring.sq_array[index] = index;
+  __atomic_store_n(writer->uring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static void uring_reap(IoWriter_t* writer) {
+  unsigned head = *writer->uring.cq_head;
+  struct io_uring_cqe* cqes = (struct io_uring_cqe*)writer->uring.cqes;
+
+  while (head != __atomic_load_n(writer->uring.cq_tail, __ATOMIC_ACQUIRE)) {
+    struct io_uring_cqe* cqe = &cqes[head & *writer->uring.cq_mask];
+    finish_write(writer, (IoStream_t*)(uintptr_t)cqe->user_data, cqe->res);
+    head++;
+  }
+  __atomic_store_n(writer->uring.cq_head, head, __ATOMIC_RELEASE);
+}
+
+static void uring_enter(IoWriter_t* writer, unsigned to_submit, bool wait) {
+  long res;
+  do {
+    res = syscall(__NR_io_uring_enter, writer->uring.fd, to_submit,
+                  wait ? 1 : 0, IORING_ENTER_GETEVENTS, NULL, 0);
+  } while (res < 0 && errno == EINTR);
+}
+
+/**
+ * Starts one write for every stream that has pending bytes and nothing in
+ * flight. Returns the number of writes started, of them queued to io_uring
+ * goes to queued.
+ */
+static unsigned submit_pending(IoWriter_t* writer, unsigned* queued) {
+  unsigned started = 0;
+  *queued = 0;
+
+  for (int i = 0; i < IO_WRITER_MAX_STREAMS; i++) {
+    IoStream_t* stream = atomic_load(&writer->streams[i]);
+    if (!stream || stream->in_flight) continue;
+    if (atomic_load(&writer->queue_depth_now) >= writer->queue_depth) break;
+
+    uint64_t tail = atomic_load(&stream->tail);
+    uint64_t pending = atomic_load(&stream->head) - tail;
+    if (pending == 0) continue;
+
+    // Запись не переходит через конец кольца, остаток уйдёт следующей
+    size_t offset = (size_t)(tail & (stream->capacity - 1));
+    size_t len = stream->capacity - offset;
+    if (len > pending) len = (size_t)pending;
+
+    stream->in_flight = true;
+    stream->in_flight_len = (uint32_t)len;
+    stream->submitted_ns = monotonic_ns();
+    uint32_t depth = atomic_fetch_add(&writer->queue_depth_now, 1) + 1;
+    uint32_t max = atomic_load(&writer->max_queue_depth);
+    if (depth > max) atomic_store(&writer->max_queue_depth, depth);
+
+    if (writer->backend == IO_BACKEND_URING) {
+      uring_push(writer, stream, stream->ring + offset, (uint32_t)len, tail);
+      (*queued)++;
+    } else {
+      ssize_t res = pwrite(stream->fd, stream->ring + offset, len, (off_t)tail);
+      finish_write(writer, stream, res < 0 ? -errno : res);
+    }
+    started++;
+  }
+  return started;
+}
+
+static void retire_closed(IoWriter_t* writer) {
+  for (int i = 0; i < IO_WRITER_MAX_STREAMS; i++) {
+    IoStream_t* stream = atomic_load(&writer->streams[i]);
+    if (stream && atomic_load(&stream->closing) && !stream->in_flight &&
+        atomic_load(&stream->head) == atomic_load(&stream->tail)) {
+      atomic_store(&writer->streams[i], NULL);
+      atomic_store(&stream->closed, true);
+      notify_progress(writer);
+    }
+  }
+}
+
+static bool has_work(IoWriter_t* writer) {
+  bool work = atomic_load(&writer->stop);
+  for (int i = 0; !work && i < IO_WRITER_MAX_STREAMS; i++) {
+    IoStream_t* stream = atomic_load(&writer->streams[i]);
+    work = stream &&
+           (atomic_load(&stream->head) != atomic_load(&stream->tail) ||
+            atomic_load(&stream->closing));
+  }
+  return work;
+}
+
+static void* io_thread(void* arg) {
+  IoWriter_t* writer = (IoWriter_t*)arg;
+
+  for (;;) {
+    unsigned queued;
+    unsigned started = submit_pending(writer, &queued);
+    // pwrite() завершается сразу, в очереди остаются только операции
+    // io_uring, в том числе отправленные до перехода на pwrite()
+    uint32_t depth = atomic_load(&writer->queue_depth_now);
+    if (writer->uring.fd >= 0 && (queued || depth)) {
+      uring_enter(writer, queued, depth > 0);
+      uring_reap(writer);
+    }
+    retire_closed(writer);
+
+    if (started == 0 && atomic_load(&writer->queue_depth_now) == 0) {
+      if (atomic_load(&writer->stop)) break;
+
+      atomic_store(&writer->idle, true);
+      if (!has_work(writer)) {
+        uint64_t count;
+        if (read(writer->event_fd, &count, sizeof(count)) < 0) {
+          // Прерванное ожидание просто повторит проход по потокам
+        }
+      }
+      atomic_store(&writer->idle, false);
+    }
+  }
+  return NULL;
+}
+
+bool io_writer_start(IoWriter_t* writer, IoBackend backend) {
+  memset(writer, 0, sizeof(*writer));
+  writer->uring.fd = -1;
+  writer->event_fd = eventfd(0, EFD_CLOEXEC);
+  if (writer->event_fd < 0) return false;
+
+  writer->backend = IO_BACKEND_THREAD;
+  writer->queue_depth = 1;
+  if (backend != IO_BACKEND_THREAD) {
+    if (uring_setup(writer)) {
+      writer->backend = IO_BACKEND_URING;
+    } else if (backend == IO_BACKEND_URING) {
+      close(writer->event_fd);
+      return false;
+    }
+  }
+
+  pthread_mutex_init(&writer->lock, NULL);
+  pthread_cond_init(&writer->progress, NULL);
+  writer->running =
+      pthread_create(&writer->thread, NULL, io_thread, writer) == 0;
+  if (!writer->running) {
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->progress);
+    uring_release(writer);
+    close(writer->event_fd);
+  }
+  return writer->running;
+}
+
+void io_writer_stop(IoWriter_t* writer) {
+  if (!writer->running) return;
+
+  atomic_store(&writer->stop, true);
+  atomic_store(&writer->idle, true);
+  kick(writer);
+  pthread_join(writer->thread, NULL);
+  writer->running = false;
+
+  pthread_mutex_destroy(&writer->lock);
+  pthread_cond_destroy(&writer->progress);
+  uring_release(writer);
+  close(writer->event_fd);
+}
+
+void io_writer_stats(IoWriter_t* writer, IoStats_t* stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->writes = atomic_load(&writer->writes);
+  stats->bytes = atomic_load(&writer->bytes);
+  stats->failures = atomic_load(&writer->failures);
+  stats->queue_depth = atomic_load(&writer->queue_depth_now);
+  stats->max_queue_depth = atomic_load(&writer->max_queue_depth);
+  stats->latency_max_ns = atomic_load(&writer->latency_max_ns);
+  if (stats->writes) {
+    stats->latency_avg_ns = atomic_load(&writer->latency_total_ns) /
+                            stats->writes;
+  }
+  for (int i = 0; i < IO_WRITER_MAX_STREAMS; i++) {
+    IoStream_t* stream = atomic_load(&writer->streams[i]);
+    if (stream) {
+      stats->pending_bytes +=
+          atomic_load(&stream->head) - atomic_load(&stream->tail);
+    }
+  }
+}
+
+IoWriter_t* getIoWriter(bool reset) {
+  static IoWriter_t writer;
+  static bool started = false;
+
+  if (reset) {
+    if (started) io_writer_stop(&writer);
+    started = false;
+    return NULL;
+  }
+  if (!started) started = io_writer_start(&writer, IO_BACKEND_AUTO);
+  return started ? &writer : NULL;
+}
+
+bool io_stream_open(IoWriter_t* writer, IoStream_t* stream, const char* path,
+                    size_t capacity) {
+  memset(stream, 0, sizeof(*stream));
+  stream->fd = -1;
+  if (!writer || !writer->running) return false;
+
+  stream->capacity = 4096;
+  while (stream->capacity < capacity) stream->capacity *= 2;
+  stream->ring = (uint8_t*)malloc(stream->capacity);
+  stream->writer = writer;
+  if (stream->ring) {
+    stream->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  }
+
+  bool registered = false;
+  for (int i = 0; stream->fd >= 0 && !registered && i < IO_WRITER_MAX_STREAMS;
+       i++) {
+    IoStream_t* empty = NULL;
+    registered =
+        atomic_compare_exchange_strong(&writer->streams[i], &empty, stream);
+  }
+  if (!registered) {
+    if (stream->fd >= 0) close(stream->fd);
+    free(stream->ring);
+    stream->ring = NULL;
+    stream->fd = -1;
+  }
+  return registered;
+}
+
+void io_stream_write(IoStream_t* stream, const void* data, size_t len) {
+  if (stream->fd < 0) return;
+
+  IoWriter_t* writer = stream->writer;
+  const uint8_t* bytes = (const uint8_t*)data;
+  while (len > 0) {
+    uint64_t head = atomic_load_explicit(&stream->head, memory_order_relaxed);
+    size_t space =
+        stream->capacity - (size_t)(head - atomic_load(&stream->tail));
+
+    if (space == 0) {
+      pthread_mutex_lock(&writer->lock);
+      atomic_fetch_add(&writer->waiters, 1);
+      while (atomic_load(&stream->tail) + stream->capacity == head) {
+        pthread_cond_wait(&writer->progress, &writer->lock);
+      }
+      atomic_fetch_sub(&writer->waiters, 1);
+      pthread_mutex_unlock(&writer->lock);
+      continue;
+    }
+
+    size_t chunk = len < space ? len : space;
+    size_t offset = (size_t)(head & (stream->capacity - 1));
+    size_t first = stream->capacity - offset;
+    if (first > chunk) first = chunk;
+    memcpy(stream->ring + offset, bytes, first);
+    memcpy(stream->ring, bytes + first, chunk - first);
+
+    atomic_store(&stream->head, head + chunk);
+    kick(writer);
+    bytes += chunk;
+    len -= chunk;
+  }
+}
+
+bool io_stream_close(IoStream_t* stream) {
+  if (stream->fd < 0) return false;
+
+  IoWriter_t* writer = stream->writer;
+  atomic_store(&stream->closing, true);
+  kick(writer);
+
+  pthread_mutex_lock(&writer->lock);
+  atomic_fetch_add(&writer->waiters, 1);
+  while (!atomic_load(&stream->closed)) {
+    pthread_cond_wait(&writer->progress, &writer->lock);
+  }
+  atomic_fetch_sub(&writer->waiters, 1);
+  pthread_mutex_unlock(&writer->lock);
+
+  bool closed = close(stream->fd) == 0;
+  bool ok = closed && !atomic_load(&stream->failed);
+  free(stream->ring);
+  stream->ring = NULL;
+  stream->fd = -1;
+  return ok;
+}
@@ -0,0 +1,174 @@
+/**
+ * @file io_writer.h
+ * @brief Asynchronous file writer shared by all sessions
+ *
+ * Every output file is an IoStream_t with its own single-producer ring.
+ * The game thread only copies bytes into the ring; one I/O thread collects
+ * the pending data of all streams and writes it through an io_uring
+ * submission queue, or with pwrite() when io_uring is not available or the
+ * kernel turns out not to support writes through it.
+ */
+#ifndef IO_WRITER_H
+#define IO_WRITER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define IO_WRITER_MAX_STREAMS 64
+#define IO_WRITER_QUEUE_DEPTH 32
+#define IO_STREAM_CAPACITY (256 * 1024)
+#define IO_WRITER_MAX_RETRIES 8  // Повторов EAGAIN/EINTR до потери данных
+
+typedef enum {
+  IO_BACKEND_AUTO,    // io_uring, если ядро позволяет, иначе поток
+  IO_BACKEND_URING,   // Только io_uring
+  IO_BACKEND_THREAD,  // pwrite() из фонового потока
+} IoBackend;
+
+typedef struct IoWriter IoWriter_t;
+
+/**
+ * @brief One output file fed by a single producer thread
+ *
+ * head is advanced by the producer, tail by the I/O thread once the bytes
+ * are on their way to the file. The remaining fields belong to the I/O
+ * thread.
+ */
+typedef struct {
+  uint8_t* ring;
+  size_t capacity;  // Степень двойки
+  _Atomic uint64_t head;
+  _Atomic uint64_t tail;
+  atomic_bool closing;
+  atomic_bool closed;
+  atomic_bool failed;
+  int fd;
+  IoWriter_t* writer;
+  bool in_flight;
+  uint32_t in_flight_len;
+  uint32_t retries;  // Подряд повторённых временных ошибок
+  uint64_t submitted_ns;
+} IoStream_t;
+
+/**
+ * @brief Counters of an I/O writer
+ */
+typedef struct {
+  uint64_t writes;          // Завершённых операций записи
+  uint64_t bytes;           // Записанных байт
+  uint64_t failures;        // Операций, завершившихся ошибкой
+  uint64_t pending_bytes;   // Байт в кольцах, ещё не отданных на запись
+  uint32_t queue_depth;     // Операций в очереди сейчас
+  uint32_t max_queue_depth;
+  uint64_t latency_avg_ns;  // От отправки до завершения записи
+  uint64_t latency_max_ns;
+} IoStats_t;
+
+/**
+ * @brief Writer thread with its streams and io_uring instance
+ */
+struct IoWriter {
+  IoBackend backend;  // IO_BACKEND_URING или IO_BACKEND_THREAD после старта
+  _Atomic(IoStream_t*) streams[IO_WRITER_MAX_STREAMS];
+  pthread_t thread;
+  bool running;
+  atomic_bool stop;
+  atomic_bool idle;  // Поток спит на eventfd
+  int event_fd;
+  pthread_mutex_t lock;  // Только для ожидающих производителей
+  pthread_cond_t progress;
+  atomic_int waiters;
+
+  struct {
+    int fd;
+    void* sq_map;
+    void* cq_map;
+    void* sqes;
+    size_t sq_map_size;
+    size_t cq_map_size;
+    size_t sqes_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    void* cqes;
+  } uring;
+
+  uint32_t queue_depth;
+  _Atomic uint32_t queue_depth_now;
+  _Atomic uint32_t max_queue_depth;
+  _Atomic uint64_t writes;
+  _Atomic uint64_t bytes;
+  _Atomic uint64_t failures;
+  _Atomic uint64_t latency_total_ns;
+  _Atomic uint64_t latency_max_ns;
+};
+
+/**
+ * @brief Starts the I/O thread
+ *
+ * @param[out] writer Writer to initialize
+ * @param[in] backend Requested backend
+ * @return false if the backend or the thread could not be started
+ */
+bool io_writer_start(IoWriter_t* writer, IoBackend backend);
+/**
+ * @brief Writes everything still queued and stops the I/O thread
+ *
+ * Streams must be closed before.
+ *
+ * @param[in,out] writer Running writer
+ */
+void io_writer_stop(IoWriter_t* writer);
+/**
+ * @brief Reads the counters of a writer
+ *
+ * @param[in] writer Writer
+ * @param[out] stats Current counters
+ */
+void io_writer_stats(IoWriter_t* writer, IoStats_t* stats);
+/**
+ * @brief Writer shared by the whole process, started on first use
+ *
+ * @param[in] reset true to stop the writer
+ * @return IoWriter_t* Writer or NULL if it could not be started
+ */
+IoWriter_t* getIoWriter(bool reset);
+
+/**
+ * @brief Creates or truncates a file and registers it with the writer
+ *
+ * @param[in] writer Running writer
+ * @param[out] stream Stream to initialize
+ * @param[in] path File path
+ * @param[in] capacity Ring size, rounded up to a power of two
+ * @return false if the file or the ring could not be created
+ */
+bool io_stream_open(IoWriter_t* writer, IoStream_t* stream, const char* path,
+                    size_t capacity);
+/**
+ * @brief Queues bytes for writing
+ *
+ * Only copies into the ring; waits for the I/O thread only when the ring is
+ * full.
+ *
+ * @param[in,out] stream Open stream
+ * @param[in] data Bytes to write
+ * @param[in] len Number of bytes
+ */
+void io_stream_write(IoStream_t* stream, const void* data, size_t len);
+/**
+ * @brief Waits until the queued bytes are written and closes the file
+ *
+ * @param[in,out] stream Open stream
+ * @return true if every write succeeded
+ */
+bool io_stream_close(IoStream_t* stream);
+
+#endif
@@ -0,0 +1,213 @@
+#include "./leaderboard.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "./persist.h"
+
+static uint32_t record_checksum(const LeaderboardLogRecord_t* record) {
+  uint32_t hash = 2166136261u;
+  const uint8_t* bytes = (const uint8_t*)&record->mode;
+  for (size_t i = 0; i < sizeof(record->mode); i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  bytes = (const uint8_t*)&record->entry;
+  for (size_t i = 0; i < sizeof(record->entry); i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * First position whose score is lower than the given one, so equal scores
+ * stay in insertion order.
+ */
+static int upper_bound(const LeaderboardTable_t* table, int score) {
+  int low = 0, high = (int)table->count;
+  while (low < high) {
+    int middle = (low + high) / 2;
+    if (table->entries[middle].score >= score) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+static int table_insert(LeaderboardTable_t* table,
+                        const LeaderboardEntry_t* entry) {
+  int position = upper_bound(table, entry->score);
+  if (position >= LEADERBOARD_CAPACITY) return 0;
+
+  int moved = (int)table->count - position;
+  if (table->count == LEADERBOARD_CAPACITY) moved--;
+  memmove(&table->entries[position + 1], &table->entries[position],
+          (size_t)moved * sizeof(LeaderboardEntry_t));
+  table->entries[position] = *entry;
+  table->entries[position].player[LEADERBOARD_NAME_MAX - 1] = '\0';
+  if (table->count < LEADERBOARD_CAPACITY) table->count++;
+  return position + 1;
+}
+
+static void reset_file(LeaderboardFile_t* file) {
+  memset(file, 0, sizeof(*file));
+  memcpy(file->magic, LEADERBOARD_MAGIC, sizeof(file->magic));
+  file->version = LEADERBOARD_VERSION;
+}
+
+/**
+ * Applies log records from offset to the end of the log. A torn or corrupt
+ * record ends the log: it is cut off together with everything after it.
+ */
+static void replay_log(Leaderboard_t* board, uint64_t offset) {
+  LeaderboardLogRecord_t record;
+
+  while (offset + sizeof(record) <= board->log_size &&
+         pread(board->log_fd, &record, sizeof(record), (off_t)offset) ==
+             (ssize_t)sizeof(record) &&
+         record.mode < LEADERBOARD_MODES &&
+         record.checksum == record_checksum(&record)) {
+    table_insert(&board->file->tables[record.mode], &record.entry);
+    offset += sizeof(record);
+  }
+  if (offset < board->log_size) {
+    if (ftruncate(board->log_fd, (off_t)offset) == 0) board->log_size = offset;
+  }
+  board->file->applied_log_size = offset;
+}
+
+static void recover(Leaderboard_t* board) {
+  LeaderboardFile_t* file = board->file;
+  bool valid = memcmp(file->magic, LEADERBOARD_MAGIC, sizeof(file->magic)) ==
+                   0 &&
+               file->version == LEADERBOARD_VERSION;
+
+  if (!valid || file->dirty || file->applied_log_size > board->log_size) {
+    // Таблицам нельзя верить, собираем их заново из журнала
+    reset_file(file);
+    replay_log(board, 0);
+  } else if (file->applied_log_size < board->log_size) {
+    replay_log(board, file->applied_log_size);
+  }
+}
+
+static int open_in_dir(const char* dir, const char* name, int flags) {
+  char path[PERSIST_PATH_MAX];
+  int len = snprintf(path, sizeof(path), "%s/%s", dir, name);
+  if (len < 0 || (size_t)len >= sizeof(path)) return -1;
+  return open(path, flags | O_CLOEXEC, 0644);
+}
+
+bool leaderboard_open(Leaderboard_t* board, const char* dir) {
+  memset(board, 0, sizeof(*board));
+  board->log_fd = -1;
+
+  int index_fd = open_in_dir(dir, LEADERBOARD_INDEX_FILE, O_RDWR | O_CREAT);
+  if (index_fd < 0) return false;
+
+  struct stat st;
+  bool ok = fstat(index_fd, &st) == 0;
+  bool fresh = ok && st.st_size != (off_t)sizeof(LeaderboardFile_t);
+  if (fresh) {
+    ok = ftruncate(index_fd, 0) == 0 &&
+         ftruncate(index_fd, (off_t)sizeof(LeaderboardFile_t)) == 0;
+  }
+
+  void* map = MAP_FAILED;
+  if (ok) {
+    map = mmap(NULL, sizeof(LeaderboardFile_t), PROT_READ | PROT_WRITE,
+               MAP_SHARED, index_fd, 0);
+  }
+  close(index_fd);
+  if (map == MAP_FAILED) return false;
+  board->file = (LeaderboardFile_t*)map;
+
+  board->log_fd =
+      open_in_dir(dir, LEADERBOARD_LOG_FILE, O_RDWR | O_CREAT | O_APPEND);
+  if (board->log_fd < 0 || fstat(board->log_fd, &st) != 0) {
+    leaderboard_close(board);
+    return false;
+  }
+  board->log_size = (uint64_t)st.st_size;
+
+  // Новый или чужой файл индекса recover() соберёт из журнала
+  recover(board);
+  return true;
+}
+
+void leaderboard_close(Leaderboard_t* board) {
+  if (board->file) munmap(board->file, sizeof(LeaderboardFile_t));
+  if (board->log_fd >= 0) close(board->log_fd);
+  board->file = NULL;
+  board->log_fd = -1;
+  board->log_size = 0;
+}
+
+int leaderboard_insert(Leaderboard_t* board, unsigned mode,
+                       const LeaderboardEntry_t* entry) {
+  if (!board->file || mode >= LEADERBOARD_MODES) return 0;
+
+  LeaderboardTable_t* table = &board->file->tables[mode];
+  if (upper_bound(table, entry->score) >= LEADERBOARD_CAPACITY) return 0;
+
+  LeaderboardLogRecord_t record;
+  memset(&record, 0, sizeof(record));
+  record.mode = mode;
+  record.entry = *entry;
+  record.entry.player[LEADERBOARD_NAME_MAX - 1] = '\0';
+  record.checksum = record_checksum(&record);
+
+  ssize_t written;
+  do {
+    written = write(board->log_fd, &record, sizeof(record));
+  } while (written < 0 && errno == EINTR);
+  if (written != (ssize_t)sizeof(record)) {
+    // Обрывок записи отрежет recover() при следующем открытии
+    return 0;
+  }
+  board->log_size += sizeof(record);
+
+  board->file->dirty = 1;
+  int rank = table_insert(table, &record.entry);
+  board->file->applied_log_size = board->log_size;
+  board->file->dirty = 0;
+  return rank;
+}
+
+int leaderboard_rank(const Leaderboard_t* board, unsigned mode, int score) {
+  if (!board->file || mode >= LEADERBOARD_MODES) return 0;
+
+  int position = upper_bound(&board->file->tables[mode], score);
+  return position < LEADERBOARD_CAPACITY ? position + 1
+                                         : LEADERBOARD_CAPACITY + 1;
+}
+
+int leaderboard_count(const Leaderboard_t* board, unsigned mode) {
+  if (!board->file || mode >= LEADERBOARD_MODES) return 0;
+  return (int)board->file->tables[mode].count;
+}
+
+const LeaderboardEntry_t* leaderboard_entry(const Leaderboard_t* board,
+                                            unsigned mode, int rank) {
+  if (rank < 1 || rank > leaderboard_count(board, mode)) return NULL;
+  return &board->file->tables[mode].entries[rank - 1];
+}
+
+Leaderboard_t* getLeaderboard(bool reset) {
+  static Leaderboard_t board = {.file = NULL, .log_fd = -1};
+  static bool opened = false;
+
+  if (reset) {
+    if (opened) leaderboard_close(&board);
+    opened = false;
+    return NULL;
+  }
+  if (!opened) opened = leaderboard_open(&board, persist_data_dir());
+  return opened ? &board : NULL;
+}
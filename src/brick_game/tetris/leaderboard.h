@@ -0,0 +1,145 @@
+/**
+ * @file leaderboard.h
+ * @brief Persistent top-N tables of finished games, one per game mode
+ *
+ * The store is two files in the data directory:
+ * - leaderboard.idx: LeaderboardFile_t, used in place through mmap(); every
+ *   table is kept sorted by score, best first
+ * - leaderboard.log: append-only LeaderboardLogRecord_t entries, one per
+ *   result that entered a table
+ *
+ * A result is appended to the log before the table is changed, and the
+ * index remembers how much of the log it already contains. Opening a store
+ * that was closed cleanly only maps the index. After a crash the missing
+ * log tail is applied again, or the tables are rebuilt from the whole log
+ * if the crash interrupted a table update.
+ */
+#ifndef LEADERBOARD_H
+#define LEADERBOARD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LEADERBOARD_MAGIC "BGLB"
+#define LEADERBOARD_VERSION 1
+#define LEADERBOARD_MODES 8
+#define LEADERBOARD_CAPACITY 100
+#define LEADERBOARD_NAME_MAX 16
+#define LEADERBOARD_INDEX_FILE "leaderboard.idx"
+#define LEADERBOARD_LOG_FILE "leaderboard.log"
+
+/**
+ * @brief One finished game
+ */
+typedef struct {
+  char player[LEADERBOARD_NAME_MAX];  // Строка с нулём в конце
+  int32_t score;
+  uint32_t lines;
+  uint32_t level;
+  uint32_t duration;   // Длительность партии в тиках
+  uint64_t replay_id;  // Зерно партии, по нему назван файл реплея
+} LeaderboardEntry_t;
+
+/**
+ * @brief Top results of one mode, sorted by score in descending order
+ */
+typedef struct {
+  uint32_t count;
+  uint32_t reserved;
+  LeaderboardEntry_t entries[LEADERBOARD_CAPACITY];
+} LeaderboardTable_t;
+
+/**
+ * @brief Layout of leaderboard.idx
+ */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint64_t applied_log_size;  // Сколько байт журнала уже в таблицах
+  uint32_t dirty;             // Таблица менялась, когда процесс упал
+  uint32_t reserved;
+  LeaderboardTable_t tables[LEADERBOARD_MODES];
+} LeaderboardFile_t;
+
+/**
+ * @brief Record of leaderboard.log
+ */
+typedef struct {
+  uint32_t mode;
+  uint32_t checksum;  // FNV-1a от mode и entry
+  LeaderboardEntry_t entry;
+} LeaderboardLogRecord_t;
+
+/**
+ * @brief Open leaderboard store
+ */
+typedef struct {
+  LeaderboardFile_t* file;
+  int log_fd;
+  uint64_t log_size;
+} Leaderboard_t;
+
+/**
+ * @brief Opens or creates the store in a directory
+ *
+ * @param[out] board Store to initialize
+ * @param[in] dir Directory with the store files
+ * @return false if the files could not be opened or mapped
+ */
+bool leaderboard_open(Leaderboard_t* board, const char* dir);
+/**
+ * @brief Unmaps the index and closes the log
+ *
+ * @param[in,out] board Open store
+ */
+void leaderboard_close(Leaderboard_t* board);
+/**
+ * @brief Adds a finished game
+ *
+ * Results that do not make it into the top LEADERBOARD_CAPACITY are not
+ * stored. Equal scores keep the order in which they were added.
+ *
+ * @param[in,out] board Open store
+ * @param[in] mode Game mode, less than LEADERBOARD_MODES
+ * @param[in] entry Result of the game
+ * @return int 1-based rank of the new entry, 0 if it was not stored
+ */
+int leaderboard_insert(Leaderboard_t* board, unsigned mode,
+                       const LeaderboardEntry_t* entry);
+/**
+ * @brief Rank a new result with this score would get
+ *
+ * @param[in] board Open store
+ * @param[in] mode Game mode
+ * @param[in] score Score
+ * @return int 1-based rank, LEADERBOARD_CAPACITY + 1 if it is too low
+ */
+int leaderboard_rank(const Leaderboard_t* board, unsigned mode, int score);
+/**
+ * @brief Number of stored results of a mode
+ *
+ * @param[in] board Open store
+ * @param[in] mode Game mode
+ * @return int Number of entries
+ */
+int leaderboard_count(const Leaderboard_t* board, unsigned mode);
+/**
+ * @brief Returns a stored result
+ *
+ * @param[in] board Open store
+ * @param[in] mode Game mode
+ * @param[in] rank 1-based rank
+ * @return const LeaderboardEntry_t* Entry or NULL if there is no such rank
+ */
+const LeaderboardEntry_t* leaderboard_entry(const Leaderboard_t* board,
+                                            unsigned mode, int rank);
+/**
+ * @brief Store in persist_data_dir(), opened on first use
+ *
+ * @param[in] reset true to close the store
+ * @return Leaderboard_t* Store or NULL if it could not be opened
+ */
+Leaderboard_t* getLeaderboard(bool reset);
+
+#endif
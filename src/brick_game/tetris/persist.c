@@ -0,0 +1,281 @@
+#include "./persist.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static char* data_dir_buffer(void) {
+  static char dir[PERSIST_PATH_MAX] = "";
+  return dir;
+}
+
+void persist_set_data_dir(const char* dir) {
+  char* buffer = data_dir_buffer();
+  buffer[0] = '\0';
+  if (dir) {
+    snprintf(buffer, PERSIST_PATH_MAX, "%s", dir);
+    size_t len = strlen(buffer);
+    while (len > 1 && buffer[len - 1] == '/') buffer[--len] = '\0';
+  }
+}
+
+const char* persist_data_dir(void) {
+  const char* dir = data_dir_buffer();
+  if (!dir[0]) {
+    const char* env = getenv(PERSIST_DATA_DIR_ENV);
+    dir = env && env[0] ? env : ".";
+  }
+  return dir;
+}
+
+bool persist_path(const char* name, char* path, size_t size) {
+  int len = snprintf(path, size, "%s/%s", persist_data_dir(), name);
+  return len > 0 && (size_t)len < size;
+}
+
+static bool write_all(int fd, const void* data, size_t len) {
+  const char* bytes = (const char*)data;
+  while (len > 0) {
+    ssize_t written = write(fd, bytes, len);
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) return false;
+    bytes += written;
+    len -= (size_t)written;
+  }
+  return true;
+}
+
+static void sync_parent_dir(const char* path) {
+  char copy[PERSIST_PATH_MAX];
+  snprintf(copy, sizeof(copy), "%s", path);
+
+  int fd = open(dirname(copy), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd >= 0) {
+    // Без этого переименование может не пережить отключение питания
+    fsync(fd);
+    close(fd);
+  }
+}
+
+bool persist_write_atomic(const char* path, const void* data, size_t len) {
+  char temp[PERSIST_PATH_MAX];
+  int n = snprintf(temp, sizeof(temp), "%s.XXXXXX", path);
+  if (n < 0 || (size_t)n >= sizeof(temp)) return false;
+
+  int fd = mkstemp(temp);
+  if (fd < 0) return false;
+
+  bool ok = fchmod(fd, 0644) == 0 && write_all(fd, data, len) &&
+            fsync(fd) == 0;
+  ok = close(fd) == 0 && ok;
+  ok = ok && rename(temp, path) == 0;
+
+  if (ok) {
+    sync_parent_dir(path);
+  } else {
+    unlink(temp);
+  }
+  return ok;
+}
+
+static bool write_record(int score) {
+  char path[PERSIST_PATH_MAX];
+  char text[16];
+  int len = snprintf(text, sizeof(text), "%d", score);
+
+  return persist_path(PERSIST_RECORD_FILE, path, sizeof(path)) &&
+         persist_write_atomic(path, text, (size_t)len);
+}
+
+static bool apply_result(const PersistResult_t* result) {
+  // Первое обращение открывает хранилище и при необходимости чинит его
+  Leaderboard_t* board = getLeaderboard(false);
+  if (board) leaderboard_insert(board, result->mode, &result->entry);
+  return board != NULL;
+}
+
+static int best_score(unsigned mode) {
+  Leaderboard_t* board = getLeaderboard(false);
+  const LeaderboardEntry_t* best =
+      board ? leaderboard_entry(board, mode, 1) : NULL;
+  return best ? (int)best->score : 0;
+}
+
+static void* record_thread(void* arg) {
+  RecordWriter_t* writer = (RecordWriter_t*)arg;
+  PersistResult_t results[PERSIST_RESULT_QUEUE];
+
+  pthread_mutex_lock(&writer->lock);
+  for (;;) {
+    while (!writer->has_pending && !writer->result_count &&
+           !writer->lookup_pending && !writer->stop) {
+      pthread_cond_wait(&writer->wake, &writer->lock);
+    }
+    if (!writer->has_pending && !writer->result_count &&
+        !writer->lookup_pending) {
+      break;
+    }
+
+    bool has_score = writer->has_pending;
+    int score = writer->pending;
+    unsigned count = writer->result_count;
+    memcpy(results, writer->results, count * sizeof(PersistResult_t));
+    bool lookup = writer->lookup_pending;
+    unsigned mode = writer->lookup_mode;
+    unsigned long request = writer->requested;
+    writer->has_pending = false;
+    writer->result_count = 0;
+    writer->lookup_pending = false;
+
+    pthread_mutex_unlock(&writer->lock);
+    bool ok = !has_score || write_record(score);
+    for (unsigned i = 0; i < count; i++) {
+      ok = apply_result(&results[i]) && ok;
+    }
+    int best = lookup ? best_score(mode) : 0;
+    pthread_mutex_lock(&writer->lock);
+
+    if (lookup) {
+      writer->best_score = best;
+      atomic_store(&writer->best_ready, true);
+    }
+
+    if (!ok) writer->failed = true;
+    writer->completed = request;
+    pthread_cond_broadcast(&writer->done);
+  }
+  pthread_mutex_unlock(&writer->lock);
+  return NULL;
+}
+
+static void flush_writer(RecordWriter_t* writer) {
+  pthread_mutex_lock(&writer->lock);
+  while (writer->completed != writer->requested) {
+    pthread_cond_wait(&writer->done, &writer->lock);
+  }
+  pthread_mutex_unlock(&writer->lock);
+}
+
+static void flush_at_exit(void) { getRecordWriter(true); }
+
+RecordWriter_t* getRecordWriter(bool reset) {
+  static RecordWriter_t writer = {.running = false};
+  static bool exit_hook = false;
+
+  if (reset) {
+    if (writer.running) {
+      flush_writer(&writer);
+      pthread_mutex_lock(&writer.lock);
+      writer.stop = true;
+      pthread_cond_signal(&writer.wake);
+      pthread_mutex_unlock(&writer.lock);
+      pthread_join(writer.thread, NULL);
+
+      pthread_mutex_destroy(&writer.lock);
+      pthread_cond_destroy(&writer.wake);
+      pthread_cond_destroy(&writer.done);
+      writer.running = false;
+    }
+    return NULL;
+  }
+
+  if (!writer.running) {
+    memset(&writer, 0, sizeof(writer));
+    pthread_mutex_init(&writer.lock, NULL);
+    pthread_cond_init(&writer.wake, NULL);
+    pthread_cond_init(&writer.done, NULL);
+    writer.running =
+        pthread_create(&writer.thread, NULL, record_thread, &writer) == 0;
+    if (!writer.running) {
+      pthread_mutex_destroy(&writer.lock);
+      pthread_cond_destroy(&writer.wake);
+      pthread_cond_destroy(&writer.done);
+    } else if (!exit_hook) {
+      exit_hook = atexit(flush_at_exit) == 0;
+    }
+  }
+  return writer.running ? &writer : NULL;
+}
+
+void persist_record_async(int score) {
+  RecordWriter_t* writer = getRecordWriter(false);
+
+  if (!writer) {
+    // Без потока сохраняем сразу, рекорд важнее задержки
+    write_record(score);
+    return;
+  }
+
+  pthread_mutex_lock(&writer->lock);
+  writer->pending = score;
+  writer->has_pending = true;
+  writer->requested++;
+  pthread_cond_signal(&writer->wake);
+  pthread_mutex_unlock(&writer->lock);
+}
+
+void persist_result_async(unsigned mode, const LeaderboardEntry_t* entry) {
+  RecordWriter_t* writer = getRecordWriter(false);
+  PersistResult_t result = {.mode = mode, .entry = *entry};
+
+  if (!writer) {
+    apply_result(&result);
+    return;
+  }
+
+  pthread_mutex_lock(&writer->lock);
+  while (writer->result_count == PERSIST_RESULT_QUEUE) {
+    pthread_cond_wait(&writer->done, &writer->lock);
+  }
+  writer->results[writer->result_count++] = result;
+  writer->requested++;
+  pthread_cond_signal(&writer->wake);
+  pthread_mutex_unlock(&writer->lock);
+}
+
+void persist_best_async(unsigned mode) {
+  RecordWriter_t* writer = getRecordWriter(false);
+  // Без потока таблица не открывается, рекорд берётся только из файла
+  if (!writer) return;
+
+  pthread_mutex_lock(&writer->lock);
+  writer->lookup_pending = true;
+  writer->lookup_mode = mode;
+  writer->requested++;
+  pthread_cond_signal(&writer->wake);
+  pthread_mutex_unlock(&writer->lock);
+}
+
+bool persist_best_take(int* score) {
+  RecordWriter_t* writer = getRecordWriter(false);
+  // Флаг проверяется без блокировки, кадр игры не ждёт фоновый поток
+  if (!writer || !atomic_load(&writer->best_ready)) return false;
+
+  pthread_mutex_lock(&writer->lock);
+  *score = writer->best_score;
+  atomic_store(&writer->best_ready, false);
+  pthread_mutex_unlock(&writer->lock);
+  return true;
+}
+
+void persist_wait(void) {
+  RecordWriter_t* writer = getRecordWriter(false);
+  if (writer) flush_writer(writer);
+}
+
+bool persist_flush(void) {
+  RecordWriter_t* writer = getRecordWriter(false);
+  if (!writer) return true;
+
+  flush_writer(writer);
+  pthread_mutex_lock(&writer->lock);
+  bool ok = !writer->failed;
+  writer->failed = false;
+  pthread_mutex_unlock(&writer->lock);
+  return ok;
+}
@@ -0,0 +1,152 @@
+/**
+ * @file persist.h
+ * @brief Crash-safe files in the game data directory
+ *
+ * Files are replaced atomically: the new contents go to a temporary file in
+ * the same directory, which is flushed with fsync() and renamed over the
+ * old one. A crash leaves either the old or the new file, never a truncated
+ * one. The high score is written this way by a background thread, which
+ * also opens the leaderboard and adds finished games to it, so the game
+ * thread never waits for the disk.
+ */
+#ifndef PERSIST_H
+#define PERSIST_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "./leaderboard.h"
+
+#define PERSIST_PATH_MAX 512
+#define PERSIST_DATA_DIR_ENV "BRICK_GAME_DATA_DIR"
+#define PERSIST_RECORD_FILE "high_score.txt"
+#define PERSIST_RESULT_QUEUE 16
+
+/**
+ * @brief Finished game waiting to be added to the leaderboard
+ */
+typedef struct {
+  unsigned mode;
+  LeaderboardEntry_t entry;
+} PersistResult_t;
+
+/**
+ * @brief Background thread that saves the high score and game results
+ *
+ * Only the latest requested high score is kept, so a burst of requests
+ * results in a single write. Results are applied in the order they were
+ * queued.
+ */
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  bool running;
+  bool stop;
+  bool has_pending;
+  int pending;
+  PersistResult_t results[PERSIST_RESULT_QUEUE];
+  unsigned result_count;
+  bool lookup_pending;  // Нужен лучший результат режима lookup_mode
+  unsigned lookup_mode;
+  atomic_bool best_ready;  // best_score можно забрать
+  int best_score;
+  unsigned long requested;  // Номер последнего запроса
+  unsigned long completed;  // Номер последнего записанного запроса
+  bool failed;
+} RecordWriter_t;
+
+/**
+ * @brief Sets the directory for the high score and other game data
+ *
+ * By default it is taken from the BRICK_GAME_DATA_DIR environment variable,
+ * or the current directory if it is not set. Call before the game starts.
+ *
+ * @param[in] dir Directory, NULL to return to the default
+ */
+void persist_set_data_dir(const char* dir);
+/**
+ * @brief Returns the current data directory
+ *
+ * @return const char* Directory without a trailing slash
+ */
+const char* persist_data_dir(void);
+/**
+ * @brief Builds the path of a file in the data directory
+ *
+ * @param[in] name File name
+ * @param[out] path Destination buffer
+ * @param[in] size Size of path
+ * @return false if the path does not fit
+ */
+bool persist_path(const char* name, char* path, size_t size);
+/**
+ * @brief Atomically replaces a file with new contents
+ *
+ * Blocks on disk; the game thread uses persist_record_async() instead.
+ *
+ * @param[in] path File to replace
+ * @param[in] data New contents
+ * @param[in] len Size of data in bytes
+ * @return true if the new contents reached the disk
+ */
+bool persist_write_atomic(const char* path, const void* data, size_t len);
+/**
+ * @brief Queues the high score for saving and returns immediately
+ *
+ * @param[in] score New high score
+ */
+void persist_record_async(int score);
+/**
+ * @brief Queues a finished game for the leaderboard and returns immediately
+ *
+ * The store is opened, recovered and written by the background thread.
+ * Blocks only while PERSIST_RESULT_QUEUE results are already waiting.
+ *
+ * @param[in] mode Game mode
+ * @param[in] entry Result of the game
+ */
+void persist_result_async(unsigned mode, const LeaderboardEntry_t* entry);
+/**
+ * @brief Asks the background thread for the best leaderboard score
+ *
+ * The thread opens and recovers the store if this is its first use, the
+ * game thread only collects the score with persist_best_take().
+ *
+ * @param[in] mode Game mode
+ */
+void persist_best_async(unsigned mode);
+/**
+ * @brief Takes the score found by persist_best_async() without waiting
+ *
+ * @param[out] score Best score of the mode, 0 if the board is empty
+ * @return false if the lookup has not finished or was already taken
+ */
+bool persist_best_take(int* score);
+/**
+ * @brief Waits until every queued high score and result is written
+ *
+ * @return false if a write failed since the previous call
+ */
+bool persist_flush(void);
+/**
+ * @brief Waits like persist_flush() but keeps the error state
+ *
+ * Also waits for a lookup of persist_best_async(). After it the caller may
+ * read getLeaderboard() until it queues the next result.
+ */
+void persist_wait(void);
+/**
+ * @brief High score writer of the process, started on first use
+ *
+ * The writer is flushed automatically when the process exits.
+ *
+ * @param[in] reset true to flush and stop the writer
+ * @return RecordWriter_t* Writer or NULL if the thread could not be started
+ */
+RecordWriter_t* getRecordWriter(bool reset);
+
+#endif
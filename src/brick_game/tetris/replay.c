@@ -0,0 +1,421 @@
+#include "./replay.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "./backend.h"
+
+static bool buffer_reserve(ReplayBuffer_t* buffer, size_t extra) {
+  if (buffer->len + extra <= buffer->cap) return true;
+
+  size_t cap = buffer->cap ? buffer->cap : 1024;
+  while (cap < buffer->len + extra) cap *= 2;
+
+  uint8_t* data = (uint8_t*)realloc(buffer->data, cap);
+  if (!data) return false;
+
+  buffer->data = data;
+  buffer->cap = cap;
+  return true;
+}
+
+static void buffer_put_byte(ReplayBuffer_t* buffer, uint8_t byte) {
+  if (buffer_reserve(buffer, 1)) buffer->data[buffer->len++] = byte;
+}
+
+static void buffer_put_varint(ReplayBuffer_t* buffer, uint64_t value) {
+  while (value >= 0x80) {
+    buffer_put_byte(buffer, (uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  buffer_put_byte(buffer, (uint8_t)value);
+}
+
+static bool read_varint(const uint8_t* data, size_t len, size_t* pos,
+                        uint64_t* value) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && *pos < len; shift += 7) {
+    uint8_t byte = data[(*pos)++];
+    result |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint64_t zigzag_encode(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static void flush_buffer(ReplayRecorder_t* recorder) {
+  io_stream_write(&recorder->stream, recorder->buffer.data,
+                  recorder->buffer.len);
+  recorder->flushed += recorder->buffer.len;
+  recorder->buffer.len = 0;
+}
+
+static void emit_run(ReplayRecorder_t* recorder) {
+  if (recorder->run_length == 0) return;
+
+  bool has_run = recorder->run_length > 1;
+  buffer_put_varint(&recorder->buffer, ((uint64_t)recorder->run_delta << 5) |
+                                           (recorder->run_action << 1) |
+                                           has_run);
+  if (has_run) buffer_put_varint(&recorder->buffer, recorder->run_length - 2);
+  recorder->run_length = 0;
+
+  if (recorder->buffer.len >= REPLAY_FLUSH_THRESHOLD) flush_buffer(recorder);
+}
+
+bool replay_recorder_open(ReplayRecorder_t* recorder, const char* path,
+                          uint64_t seed, uint8_t ruleset) {
+  memset(recorder, 0, sizeof(*recorder));
+  recorder->open = io_stream_open(getIoWriter(false), &recorder->stream, path,
+                                  IO_STREAM_CAPACITY);
+  if (!recorder->open) return false;
+
+  ReplayBuffer_t* buffer = &recorder->buffer;
+  for (size_t i = 0; i < strlen(REPLAY_MAGIC); i++) {
+    buffer_put_byte(buffer, (uint8_t)REPLAY_MAGIC[i]);
+  }
+  buffer_put_byte(buffer, REPLAY_FORMAT_VERSION);
+  buffer_put_varint(buffer, TETRIS_ENGINE_VERSION);
+  buffer_put_byte(buffer, ruleset);
+  for (int i = 0; i < 8; i++) {
+    buffer_put_byte(buffer, (uint8_t)(seed >> (i * 8)));
+  }
+  recorder->events_offset = buffer->len;
+  recorder->next_keyframe = REPLAY_KEYFRAME_INTERVAL;
+  return true;
+}
+
+void replay_recorder_add(ReplayRecorder_t* recorder, uint32_t tick,
+                         UserAction_t action) {
+  if (!recorder->open || action < Start || action > Action) return;
+
+  uint32_t delta = tick - recorder->last_tick;
+  recorder->last_tick = tick;
+  recorder->event_count++;
+
+  if (recorder->run_length > 0 && recorder->run_delta == delta &&
+      recorder->run_action == action) {
+    recorder->run_length++;
+  } else {
+    emit_run(recorder);
+    recorder->run_delta = delta;
+    recorder->run_action = (uint8_t)action;
+    recorder->run_length = 1;
+  }
+}
+
+bool replay_recorder_keyframe_due(const ReplayRecorder_t* recorder,
+                                  uint32_t pieces) {
+  return recorder->open && pieces >= recorder->next_keyframe;
+}
+
+void replay_recorder_keyframe(ReplayRecorder_t* recorder,
+                              const GameSnapshot_t* snapshot) {
+  if (!recorder->open) return;
+
+  if (recorder->keyframe_count == recorder->keyframe_cap) {
+    size_t cap = recorder->keyframe_cap ? recorder->keyframe_cap * 2 : 16;
+    ReplayKeyframe_t* keyframes = (ReplayKeyframe_t*)realloc(
+        recorder->keyframes, cap * sizeof(ReplayKeyframe_t));
+    if (!keyframes) return;
+    recorder->keyframes = keyframes;
+    recorder->keyframe_cap = cap;
+  }
+
+  // Серия не должна переходить через ключевой кадр
+  emit_run(recorder);
+
+  ReplayKeyframe_t* keyframe = &recorder->keyframes[recorder->keyframe_count++];
+  memset(keyframe, 0, sizeof(*keyframe));
+  keyframe->event_offset = recorder->flushed + recorder->buffer.len;
+  keyframe->event_index = recorder->event_count;
+  keyframe->last_tick = recorder->last_tick;
+  keyframe->state = *snapshot;
+
+  recorder->next_keyframe = snapshot->pieces - snapshot->pieces %
+                                                   REPLAY_KEYFRAME_INTERVAL +
+                            REPLAY_KEYFRAME_INTERVAL;
+}
+
+static void put_keyframe_index(ReplayRecorder_t* recorder,
+                               uint32_t final_tick) {
+  ReplayBuffer_t* buffer = &recorder->buffer;
+  while ((recorder->flushed + buffer->len) % 8 != 0) {
+    buffer_put_byte(buffer, 0);
+  }
+
+  ReplayIndexFooter_t footer = {0};
+  memcpy(footer.magic, REPLAY_INDEX_MAGIC, sizeof(footer.magic));
+  footer.count = (uint32_t)recorder->keyframe_count;
+  footer.interval = REPLAY_KEYFRAME_INTERVAL;
+  footer.final_tick = final_tick;
+  footer.events_offset = recorder->events_offset;
+  footer.index_offset = recorder->flushed + buffer->len;
+
+  size_t index_size = recorder->keyframe_count * sizeof(ReplayKeyframe_t);
+  if (buffer_reserve(buffer, index_size + sizeof(footer))) {
+    if (index_size) {
+      memcpy(buffer->data + buffer->len, recorder->keyframes, index_size);
+    }
+    buffer->len += index_size;
+    memcpy(buffer->data + buffer->len, &footer, sizeof(footer));
+    buffer->len += sizeof(footer);
+  } else {
+    recorder->failed = true;
+  }
+}
+
+bool replay_recorder_close(ReplayRecorder_t* recorder,
+                           const ReplaySummary_t* summary) {
+  if (!recorder->open) return false;
+
+  ReplayBuffer_t* buffer = &recorder->buffer;
+  emit_run(recorder);
+  buffer_put_varint(buffer, REPLAY_END_TOKEN << 1);
+  buffer_put_varint(buffer, summary->final_tick);
+  buffer_put_varint(buffer, zigzag_encode(summary->score));
+  buffer_put_varint(buffer, summary->lines);
+  buffer_put_varint(buffer, summary->pieces);
+  for (int i = 0; i < 8; i++) {
+    buffer_put_byte(buffer, (uint8_t)(summary->checksum >> (i * 8)));
+  }
+  put_keyframe_index(recorder, summary->final_tick);
+
+  flush_buffer(recorder);
+
+  bool ok = io_stream_close(&recorder->stream) && !recorder->failed;
+  recorder->open = false;
+
+  free(recorder->buffer.data);
+  free(recorder->keyframes);
+  recorder->keyframes = NULL;
+  recorder->keyframe_count = 0;
+  recorder->keyframe_cap = 0;
+  recorder->buffer = (ReplayBuffer_t){0};
+  return ok;
+}
+
+static bool replay_push(Replay_t* replay, uint32_t tick, uint8_t action) {
+  if (replay->count == replay->capacity) {
+    size_t capacity = replay->capacity ? replay->capacity * 2 : 256;
+    ReplayEvent_t* events = (ReplayEvent_t*)realloc(
+        replay->events, capacity * sizeof(ReplayEvent_t));
+    if (!events) return false;
+    replay->events = events;
+    replay->capacity = capacity;
+  }
+  replay->events[replay->count++] = (ReplayEvent_t){tick, action};
+  return true;
+}
+
+static bool read_header(const uint8_t* data, size_t len, size_t* pos,
+                        Replay_t* replay) {
+  size_t magic_len = strlen(REPLAY_MAGIC);
+  if (len < magic_len + 1 || memcmp(data, REPLAY_MAGIC, magic_len) != 0) {
+    return false;
+  }
+
+  uint64_t value = 0;
+  *pos = magic_len;
+  replay->format_version = data[(*pos)++];
+  if (replay->format_version != REPLAY_FORMAT_VERSION ||
+      !read_varint(data, len, pos, &value) || *pos + 9 > len) {
+    return false;
+  }
+  replay->engine_version = (uint16_t)value;
+  replay->ruleset = data[(*pos)++];
+  for (int i = 0; i < 8; i++) {
+    replay->seed |= (uint64_t)data[(*pos)++] << (i * 8);
+  }
+  return true;
+}
+
+void replay_cursor_init(ReplayCursor_t* cursor, const uint8_t* data,
+                        size_t len, size_t offset, uint32_t last_tick) {
+  memset(cursor, 0, sizeof(*cursor));
+  cursor->data = data;
+  cursor->len = len;
+  cursor->pos = offset;
+  cursor->tick = last_tick;
+}
+
+bool replay_cursor_next(ReplayCursor_t* cursor, ReplayEvent_t* event) {
+  if (cursor->run_left == 0) {
+    uint64_t value = 0, run = 1;
+    if (cursor->ended ||
+        !read_varint(cursor->data, cursor->len, &cursor->pos, &value)) {
+      return false;
+    }
+
+    cursor->run_action = (value >> 1) & 0x0F;
+    if (cursor->run_action == REPLAY_END_TOKEN) {
+      cursor->ended = true;
+      return false;
+    }
+    if (cursor->run_action > Action) return false;
+
+    if (value & 1) {
+      if (!read_varint(cursor->data, cursor->len, &cursor->pos, &run)) {
+        return false;
+      }
+      run += 2;
+    }
+    cursor->run_delta = (uint32_t)(value >> 5);
+    cursor->run_left = (uint32_t)run;
+  }
+
+  cursor->run_left--;
+  cursor->tick += cursor->run_delta;
+  event->tick = cursor->tick;
+  event->action = cursor->run_action;
+  return true;
+}
+
+bool replay_decode(const uint8_t* data, size_t len, Replay_t* replay) {
+  memset(replay, 0, sizeof(*replay));
+
+  size_t pos = 0;
+  if (!read_header(data, len, &pos, replay)) return false;
+
+  ReplayCursor_t cursor;
+  ReplayEvent_t event;
+  bool ok = true;
+  replay_cursor_init(&cursor, data, len, pos, 0);
+  while (ok && replay_cursor_next(&cursor, &event)) {
+    ok = replay_push(replay, event.tick, event.action);
+  }
+
+  uint64_t value = 0, score = 0, lines = 0, pieces = 0;
+  pos = cursor.pos;
+  ok = ok && cursor.ended && read_varint(data, len, &pos, &value) &&
+       read_varint(data, len, &pos, &score) &&
+       read_varint(data, len, &pos, &lines) &&
+       read_varint(data, len, &pos, &pieces) && pos + 8 <= len;
+  if (ok) {
+    ReplaySummary_t* summary = &replay->summary;
+    summary->final_tick = (uint32_t)value;
+    summary->score = (int32_t)zigzag_decode(score);
+    summary->lines = (uint32_t)lines;
+    summary->pieces = (uint32_t)pieces;
+    for (int i = 0; i < 8; i++) {
+      summary->checksum |= (uint64_t)data[pos++] << (i * 8);
+    }
+  } else {
+    replay_free(replay);
+  }
+  return ok;
+}
+
+bool replay_load(const char* path, Replay_t* replay) {
+  bool ok = false;
+  FILE* file = fopen(path, "rb");
+
+  if (file) {
+    uint8_t* data = NULL;
+    size_t len = 0, cap = 0, got = 0;
+    do {
+      if (len == cap) {
+        cap = cap ? cap * 2 : 4096;
+        uint8_t* grown = (uint8_t*)realloc(data, cap);
+        if (!grown) break;
+        data = grown;
+      }
+      got = fread(data + len, 1, cap - len, file);
+      len += got;
+    } while (got > 0);
+    fclose(file);
+
+    ok = data && replay_decode(data, len, replay);
+    free(data);
+  }
+  return ok;
+}
+
+void replay_free(Replay_t* replay) {
+  free(replay->events);
+  replay->events = NULL;
+  replay->count = 0;
+  replay->capacity = 0;
+}
+
+bool replay_index_open(const char* path, ReplayIndex_t* index) {
+  memset(index, 0, sizeof(*index));
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  void* map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) return false;
+
+  index->map = (uint8_t*)map;
+  index->size = (size_t)st.st_size;
+
+  Replay_t header = {0};
+  size_t pos = 0;
+  ReplayIndexFooter_t footer;
+  bool ok = read_header(index->map, index->size, &pos, &header) &&
+            index->size >= pos + sizeof(footer);
+  if (ok) {
+    memcpy(&footer, index->map + index->size - sizeof(footer), sizeof(footer));
+    uint64_t index_end =
+        footer.index_offset + (uint64_t)footer.count * sizeof(ReplayKeyframe_t);
+    ok = memcmp(footer.magic, REPLAY_INDEX_MAGIC, sizeof(footer.magic)) == 0 &&
+         footer.index_offset % 8 == 0 && footer.interval > 0 &&
+         index_end <= index->size - sizeof(footer) &&
+         footer.events_offset < index->size;
+  }
+
+  if (ok) {
+    index->seed = header.seed;
+    index->ruleset = header.ruleset;
+    index->engine_version = header.engine_version;
+    index->keyframes =
+        (const ReplayKeyframe_t*)(index->map + footer.index_offset);
+    index->count = footer.count;
+    index->interval = footer.interval;
+    index->final_tick = footer.final_tick;
+    index->events_offset = footer.events_offset;
+  } else {
+    replay_index_close(index);
+  }
+  return ok;
+}
+
+void replay_index_close(ReplayIndex_t* index) {
+  if (index->map) munmap(index->map, index->size);
+  memset(index, 0, sizeof(*index));
+}
+
+const ReplayKeyframe_t* replay_index_find(const ReplayIndex_t* index,
+                                          uint32_t piece) {
+  if (index->count == 0) return NULL;
+
+  long i = (long)(piece / index->interval) - 1;
+  if (i >= (long)index->count) i = (long)index->count - 1;
+  while (i + 1 < (long)index->count && index->keyframes[i + 1].state.pieces <=
+                                           piece) {
+    i++;
+  }
+  while (i >= 0 && index->keyframes[i].state.pieces > piece) i--;
+
+  return i >= 0 ? &index->keyframes[i] : NULL;
+}
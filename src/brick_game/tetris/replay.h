@@ -0,0 +1,283 @@
+/**
+ * @file replay.h
+ * @brief Compact binary replays: recorder for the game loop and loader
+ *
+ * File layout:
+ * - header: magic "BGRP", format version, engine version, ruleset, seed
+ * - events: one varint per run of equal events,
+ *   (tick_delta << 5) | (action << 1) | has_run, followed by
+ *   varint(run - 2) when has_run is set
+ * - REPLAY_END_TOKEN as the action of the last event
+ * - trailer: varint final tick, zigzag varint final score, varint lines,
+ *   varint locked pieces, 8-byte state checksum
+ * - keyframe index: zero padding to 8 bytes, an array of ReplayKeyframe_t
+ *   and a ReplayIndexFooter_t as the last bytes of the file
+ *
+ * The keyframe index is written as raw structures in host byte order, so a
+ * viewer can mmap() the file and use it directly.
+ */
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../../common/common.h"
+#include "./frame.h"
+#include "./io_writer.h"
+
+#define REPLAY_MAGIC "BGRP"
+#define REPLAY_FORMAT_VERSION 3
+#define REPLAY_END_TOKEN 15
+#define REPLAY_FLUSH_THRESHOLD (64 * 1024)
+#define REPLAY_PATH_MAX 256
+#define REPLAY_INDEX_MAGIC "BGKI"
+#define REPLAY_KEYFRAME_INTERVAL 50
+
+typedef struct {
+  uint32_t tick;
+  uint8_t action;
+} ReplayEvent_t;
+
+/**
+ * @brief Result of a game, stored in the replay trailer
+ */
+typedef struct {
+  uint32_t final_tick;
+  int32_t score;
+  uint32_t lines;
+  uint32_t pieces;
+  uint64_t checksum;  // EngineContext_t::checksum после последней фигуры
+} ReplaySummary_t;
+
+/**
+ * @brief Fully decoded replay
+ */
+typedef struct {
+  uint8_t format_version;
+  uint16_t engine_version;
+  uint8_t ruleset;  // PieceRngMode генератора фигур
+  uint64_t seed;
+  ReplayEvent_t* events;
+  size_t count;
+  size_t capacity;
+  ReplaySummary_t summary;
+} Replay_t;
+
+/**
+ * @brief Game state at a point of the event stream
+ *
+ * Decoding can restart at event_offset with last_tick as the delta base;
+ * simulating from state then reproduces the rest of the game.
+ */
+typedef struct {
+  uint64_t event_offset;  // Смещение следующего события от начала файла
+  uint32_t event_index;   // Количество событий до ключевого кадра
+  uint32_t last_tick;     // База дельты для следующего события
+  GameSnapshot_t state;
+} ReplayKeyframe_t;
+
+/**
+ * @brief Fixed-size footer at the very end of a replay file
+ */
+typedef struct {
+  char magic[4];
+  uint32_t count;     // Количество ключевых кадров
+  uint32_t interval;  // Фигур между ключевыми кадрами
+  uint32_t final_tick;
+  uint64_t events_offset;
+  uint64_t index_offset;
+} ReplayIndexFooter_t;
+
+/**
+ * @brief Memory-mapped replay file with its keyframe index
+ */
+typedef struct {
+  uint8_t* map;
+  size_t size;
+  uint64_t seed;
+  uint8_t ruleset;
+  uint16_t engine_version;
+  const ReplayKeyframe_t* keyframes;
+  uint32_t count;
+  uint32_t interval;
+  uint32_t final_tick;
+  uint64_t events_offset;
+} ReplayIndex_t;
+
+/**
+ * @brief Incremental decoder of the event stream
+ */
+typedef struct {
+  const uint8_t* data;
+  size_t len;
+  size_t pos;
+  uint32_t tick;
+  uint32_t run_left;  // Сколько событий текущей серии ещё не выдано
+  uint32_t run_delta;
+  uint8_t run_action;
+  bool ended;  // Достигнут REPLAY_END_TOKEN
+} ReplayCursor_t;
+
+/**
+ * @brief In-memory byte buffer used by the recorder
+ */
+typedef struct {
+  uint8_t* data;
+  size_t len;
+  size_t cap;
+} ReplayBuffer_t;
+
+/**
+ * @brief Records user actions of one game into a replay file
+ *
+ * Events are encoded into an in-memory buffer. When the buffer grows past
+ * REPLAY_FLUSH_THRESHOLD it is copied into an IoStream_t of the shared
+ * writer, so the game loop itself never touches the file.
+ */
+typedef struct {
+  bool open;
+  IoStream_t stream;
+  ReplayBuffer_t buffer;
+  bool failed;
+  uint32_t last_tick;
+  uint32_t run_delta;  // Текущая серия одинаковых событий
+  uint8_t run_action;
+  uint32_t run_length;
+  uint64_t flushed;  // Байт, уже отданных в IoStream_t
+  uint64_t events_offset;
+  uint32_t event_count;
+  uint32_t next_keyframe;  // Номер фигуры для следующего ключевого кадра
+  ReplayKeyframe_t* keyframes;
+  size_t keyframe_count;
+  size_t keyframe_cap;
+} ReplayRecorder_t;
+
+/**
+ * @brief Opens a replay file and writes its header into the buffer
+ *
+ * The file is written by getIoWriter(false).
+ *
+ * @param[out] recorder Recorder to initialize
+ * @param[in] path Replay file path
+ * @param[in] seed Piece generator seed
+ * @param[in] ruleset Piece generator mode
+ * @return true on success, false if the file or the writer could not be
+ * opened
+ */
+bool replay_recorder_open(ReplayRecorder_t* recorder, const char* path,
+                          uint64_t seed, uint8_t ruleset);
+/**
+ * @brief Appends one action; only touches memory
+ *
+ * @param[in,out] recorder Open recorder
+ * @param[in] tick Tick at which the action was applied (getCurrentTick())
+ * @param[in] action User action
+ */
+void replay_recorder_add(ReplayRecorder_t* recorder, uint32_t tick,
+                         UserAction_t action);
+/**
+ * @brief Tells whether the game reached the piece count of the next keyframe
+ *
+ * @param[in] recorder Open recorder
+ * @param[in] pieces Locked pieces so far (EngineContext_t::pieces)
+ * @return true if replay_recorder_keyframe() should be called now
+ */
+bool replay_recorder_keyframe_due(const ReplayRecorder_t* recorder,
+                                  uint32_t pieces);
+/**
+ * @brief Stores a keyframe for the current position of the event stream
+ *
+ * Must be called between two actions with the snapshot of the game as it
+ * is right now. Keyframes are kept in memory and written by
+ * replay_recorder_close().
+ *
+ * @param[in,out] recorder Open recorder
+ * @param[in] snapshot Snapshot of the recorded game
+ */
+void replay_recorder_keyframe(ReplayRecorder_t* recorder,
+                              const GameSnapshot_t* snapshot);
+/**
+ * @brief Writes the trailer, waits for pending writes and closes the file
+ *
+ * @param[in,out] recorder Open recorder
+ * @param[in] summary Result of the game
+ * @return true if every write succeeded
+ */
+bool replay_recorder_close(ReplayRecorder_t* recorder,
+                           const ReplaySummary_t* summary);
+
+/**
+ * @brief Decodes a replay from memory
+ *
+ * @param[in] data Encoded replay
+ * @param[in] len Size of data in bytes
+ * @param[out] replay Decoded replay, free with replay_free()
+ * @return true if the data is a valid replay
+ */
+bool replay_decode(const uint8_t* data, size_t len, Replay_t* replay);
+/**
+ * @brief Reads and decodes a replay file
+ *
+ * @param[in] path Replay file path
+ * @param[out] replay Decoded replay, free with replay_free()
+ * @return true if the file is a valid replay
+ */
+bool replay_load(const char* path, Replay_t* replay);
+/**
+ * @brief Starts decoding events at a byte offset
+ *
+ * @param[out] cursor Cursor to initialize
+ * @param[in] data Whole replay file
+ * @param[in] len Size of data in bytes
+ * @param[in] offset Offset of the first event to decode
+ * @param[in] last_tick Tick of the event before offset
+ */
+void replay_cursor_init(ReplayCursor_t* cursor, const uint8_t* data,
+                        size_t len, size_t offset, uint32_t last_tick);
+/**
+ * @brief Decodes the next event
+ *
+ * @param[in,out] cursor Cursor
+ * @param[out] event Decoded event
+ * @return false at the end of the stream or on corrupt data
+ */
+bool replay_cursor_next(ReplayCursor_t* cursor, ReplayEvent_t* event);
+/**
+ * @brief Maps a replay file and validates its header and keyframe index
+ *
+ * Only the header and the footer are read; keyframes are used in place.
+ *
+ * @param[in] path Replay file path
+ * @param[out] index Mapped index, release with replay_index_close()
+ * @return true if the file has a valid keyframe index
+ */
+bool replay_index_open(const char* path, ReplayIndex_t* index);
+/**
+ * @brief Unmaps a replay opened with replay_index_open()
+ *
+ * @param[in,out] index Index to release
+ */
+void replay_index_close(ReplayIndex_t* index);
+/**
+ * @brief Finds the last keyframe taken at or before the given piece
+ *
+ * Keyframes are taken every interval pieces, so the position is computed
+ * directly and only corrected by a step or two.
+ *
+ * @param[in] index Mapped index
+ * @param[in] piece Number of locked pieces to seek to
+ * @return const ReplayKeyframe_t* Keyframe or NULL to start from the beginning
+ */
+const ReplayKeyframe_t* replay_index_find(const ReplayIndex_t* index,
+                                          uint32_t piece);
+/**
+ * @brief Frees the events of a decoded replay
+ *
+ * @param[in,out] replay Replay to free
+ */
+void replay_free(Replay_t* replay);
+
+#endif
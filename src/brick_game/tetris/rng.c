@@ -0,0 +1,107 @@
+#include "./rng.h"
+
+#define RNG_GAMMA 0x9E3779B97F4A7C15ULL
+
+static uint64_t mix64(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+uint64_t piece_rng_bits(uint64_t key, uint64_t counter) {
+  return mix64(key + (counter + 1) * RNG_GAMMA);
+}
+
+/*
+ * Lemire's multiply-shift reduction. The rejection branch is taken with
+ * probability range / 2^32, so it almost never breaks the batch loop.
+ */
+static int reduce_bits(PieceRng_t* rng, uint64_t bits, uint32_t range) {
+  uint32_t threshold = (uint32_t)(-range) % range;
+  uint64_t m = (bits >> 32) * range;
+
+  while ((uint32_t)m < threshold) {
+    bits = piece_rng_bits(rng->key, rng->counter++);
+    m = (bits >> 32) * range;
+  }
+  return (int)(m >> 32);
+}
+
+void piece_rng_seed(PieceRng_t* rng, uint64_t seed, PieceRngMode mode) {
+  rng->seed = seed;
+  rng->key = mix64(seed ^ RNG_GAMMA);
+  rng->counter = 0;
+  rng->mode = (uint8_t)mode;
+  rng->bag_left = 0;
+  for (int i = 0; i < TETROMINO_COUNT; i++) {
+    rng->bag[i] = (uint8_t)i;
+  }
+}
+
+int piece_rng_next(PieceRng_t* rng) {
+  int piece = 0;
+  piece_rng_next_batch(rng, &piece, 1);
+  return piece;
+}
+
+void piece_rng_refill_batch(PieceRng_t* rngs, size_t count) {
+  uint64_t bits[RNG_BATCH_CHUNK];
+  bool refill[RNG_BATCH_CHUNK];
+
+  for (size_t base = 0; base < count; base += RNG_BATCH_CHUNK) {
+    size_t n = count - base < RNG_BATCH_CHUNK ? count - base : RNG_BATCH_CHUNK;
+    PieceRng_t* chunk = rngs + base;
+
+    for (size_t i = 0; i < n; i++) {
+      refill[i] = chunk[i].mode == RNG_BAG && chunk[i].bag_left == 0;
+      if (refill[i]) {
+        for (int p = 0; p < TETROMINO_COUNT; p++) chunk[i].bag[p] = (uint8_t)p;
+      }
+    }
+
+    // Fisher-Yates, один шаг перестановки сразу для всех мешков пачки
+    for (uint32_t k = TETROMINO_COUNT - 1; k > 0; k--) {
+      for (size_t i = 0; i < n; i++) {
+        bits[i] = piece_rng_bits(chunk[i].key, chunk[i].counter);
+      }
+      for (size_t i = 0; i < n; i++) {
+        if (!refill[i]) continue;
+        chunk[i].counter++;
+        int j = reduce_bits(&chunk[i], bits[i], k + 1);
+        uint8_t tmp = chunk[i].bag[k];
+        chunk[i].bag[k] = chunk[i].bag[j];
+        chunk[i].bag[j] = tmp;
+      }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      if (refill[i]) chunk[i].bag_left = TETROMINO_COUNT;
+    }
+  }
+}
+
+void piece_rng_next_batch(PieceRng_t* rngs, int* pieces, size_t count) {
+  uint64_t bits[RNG_BATCH_CHUNK];
+
+  piece_rng_refill_batch(rngs, count);
+
+  for (size_t base = 0; base < count; base += RNG_BATCH_CHUNK) {
+    size_t n = count - base < RNG_BATCH_CHUNK ? count - base : RNG_BATCH_CHUNK;
+    PieceRng_t* chunk = rngs + base;
+
+    for (size_t i = 0; i < n; i++) {
+      bits[i] = piece_rng_bits(chunk[i].key, chunk[i].counter);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      PieceRng_t* rng = &chunk[i];
+      if (rng->mode == RNG_BAG) {
+        pieces[base + i] = rng->bag[TETROMINO_COUNT - rng->bag_left];
+        rng->bag_left--;
+      } else {
+        rng->counter++;
+        pieces[base + i] = reduce_bits(rng, bits[i], TETROMINO_COUNT);
+      }
+    }
+  }
+}
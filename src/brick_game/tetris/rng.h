@@ -0,0 +1,80 @@
+/**
+ * @file rng.h
+ * @brief Counter-based piece generator with batched generation
+ */
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TETROMINO_COUNT 7
+#define RNG_BATCH_CHUNK 64
+
+typedef enum { RNG_UNIFORM, RNG_BAG } PieceRngMode;
+
+/**
+ * @brief Piece generator state of one session
+ *
+ * Output number n of a stream is a pure function of (key, n), so streams
+ * of different sessions are independent and can be advanced side by side.
+ */
+typedef struct {
+  uint64_t seed;     // Исходное зерно сессии
+  uint64_t key;      // Ключ потока, выводится из зерна
+  uint64_t counter;  // Номер следующего случайного числа
+  uint8_t mode;      // PieceRngMode
+  uint8_t bag_left;  // Сколько фигур осталось в мешке
+  uint8_t bag[TETROMINO_COUNT];
+} PieceRng_t;
+
+/**
+ * @brief Returns random bits number counter of the stream with the given key
+ *
+ * @param[in] key Stream key
+ * @param[in] counter Position in the stream
+ * @return uint64_t 64 random bits
+ */
+uint64_t piece_rng_bits(uint64_t key, uint64_t counter);
+/**
+ * @brief Seeds a generator, the same seed always gives the same pieces
+ *
+ * @param[out] rng Generator to seed
+ * @param[in] seed Session seed
+ * @param[in] mode RNG_UNIFORM for independent pieces, RNG_BAG for 7-bag
+ */
+void piece_rng_seed(PieceRng_t* rng, uint64_t seed, PieceRngMode mode);
+/**
+ * @brief Returns the next tetromino type of one session
+ *
+ * Same stream as piece_rng_next_batch() with a single generator.
+ *
+ * @param[in,out] rng Generator state
+ * @return int Tetromino type (0-6)
+ */
+int piece_rng_next(PieceRng_t* rng);
+/**
+ * @brief Generates one tetromino type for each of count sessions
+ *
+ * Random bits for all sessions are produced in one branch-free pass,
+ * then reduced to 0..6 without modulo bias. Empty bags are refilled in
+ * one batch before pieces are taken.
+ *
+ * @param[in,out] rngs Array of generators
+ * @param[out] pieces Array of count tetromino types
+ * @param[in] count Number of sessions
+ */
+void piece_rng_next_batch(PieceRng_t* rngs, int* pieces, size_t count);
+/**
+ * @brief Refills every empty 7-bag in the array with a fresh permutation
+ *
+ * Generators in RNG_UNIFORM mode and bags that still hold pieces are left
+ * untouched.
+ *
+ * @param[in,out] rngs Array of generators
+ * @param[in] count Number of generators
+ */
+void piece_rng_refill_batch(PieceRng_t* rngs, size_t count);
+
+#endif
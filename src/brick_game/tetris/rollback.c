@@ -0,0 +1,85 @@
+#include "./rollback.h"
+
+#include <string.h>
+
+static uint64_t snapshot_hash(const GameSnapshot_t* snapshot) {
+  const uint8_t* bytes = (const uint8_t*)snapshot;
+  uint64_t hash = 0xCBF29CE484222325ULL;
+
+  for (size_t i = 0; i < sizeof(*snapshot); i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+void rollback_init(Rollback_t* rollback, uint64_t seed, PieceRngMode mode) {
+  memset(rollback->frames, 0, sizeof(rollback->frames));
+  session_init(&rollback->session, seed, mode);
+  rollback->frame = 0;
+  rollback->dirty = 0;
+  rollback->resimulated = 0;
+  session_save(&rollback->session, &rollback->frames[0].start);
+}
+
+bool rollback_input(Rollback_t* rollback, uint32_t frame,
+                    UserAction_t action) {
+  if (frame > rollback->frame || rollback->frame - frame >= ROLLBACK_WINDOW) {
+    return false;
+  }
+
+  RollbackFrame_t* slot = &rollback->frames[frame % ROLLBACK_WINDOW];
+  if (slot->input_count == ROLLBACK_INPUTS_MAX) return false;
+
+  slot->inputs[slot->input_count++] = (uint8_t)action;
+  if (frame < rollback->dirty) rollback->dirty = frame;
+  return true;
+}
+
+/**
+ * Applies the input of one tick, steps the session and saves the result
+ * as the start of the following tick.
+ */
+static void run_frame(Rollback_t* rollback, uint32_t frame) {
+  const RollbackFrame_t* slot = &rollback->frames[frame % ROLLBACK_WINDOW];
+  for (int i = 0; i < slot->input_count; i++) {
+    session_input(&rollback->session, (UserAction_t)slot->inputs[i]);
+  }
+  session_step(&rollback->session);
+
+  RollbackFrame_t* next = &rollback->frames[(frame + 1) % ROLLBACK_WINDOW];
+  session_save(&rollback->session, &next->start);
+  rollback->frames[frame % ROLLBACK_WINDOW].checksum =
+      snapshot_hash(&next->start);
+}
+
+uint32_t rollback_advance(Rollback_t* rollback) {
+  uint32_t resimulated = rollback->frame - rollback->dirty;
+  if (resimulated) {
+    session_restore(&rollback->session,
+                    &rollback->frames[rollback->dirty % ROLLBACK_WINDOW].start);
+    for (uint32_t f = rollback->dirty; f < rollback->frame; f++) {
+      run_frame(rollback, f);
+    }
+  }
+
+  // Слот следующего тика освобождается только после пересчёта: раньше он
+  // хранил самый старый тик окна
+  RollbackFrame_t* next =
+      &rollback->frames[(rollback->frame + 1) % ROLLBACK_WINDOW];
+  run_frame(rollback, rollback->frame);
+  next->input_count = 0;
+  rollback->frame++;
+  rollback->dirty = rollback->frame;
+  rollback->resimulated = resimulated;
+  return resimulated;
+}
+
+bool rollback_checksum(const Rollback_t* rollback, uint32_t frame,
+                       uint64_t* checksum) {
+  if (frame >= rollback->frame ||
+      rollback->frame - frame >= ROLLBACK_WINDOW) {
+    return false;
+  }
+  *checksum = rollback->frames[frame % ROLLBACK_WINDOW].checksum;
+  return true;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file rollback.h
+ * @brief Rollback simulation of a session whose input may arrive late
+ *
+ * Every tick the state at its start and the input applied in it are kept
+ * in a ring of ROLLBACK_WINDOW ticks. When an input for a past tick
+ * arrives, the next rollback_advance() restores that tick and simulates
+ * again up to the present. After every tick a checksum of the whole state
+ * is stored, so two processes can compare them and detect a desync.
+ *
+ * A tick here is one call of rollback_advance(); it passes even while the
+ * game is paused, unlike engine.tick. Simulation uses only the headless
+ * session and never allocates or renders.
+ */
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./session.h"
+
+#define ROLLBACK_WINDOW 8
+#define ROLLBACK_INPUTS_MAX 4
+
+/**
+ * @brief One tick in the rollback ring
+ */
+typedef struct {
+  GameSnapshot_t start;  // Состояние до ввода этого тика
+  uint64_t checksum;     // Хеш состояния после тика
+  uint8_t inputs[ROLLBACK_INPUTS_MAX];
+  uint8_t input_count;
+} RollbackFrame_t;
+
+/**
+ * @brief Session with its recent ticks
+ */
+typedef struct {
+  TetrisSession_t session;
+  RollbackFrame_t frames[ROLLBACK_WINDOW];
+  uint32_t frame;        // Тик, который выполнит следующий advance
+  uint32_t dirty;        // Самый ранний тик с опоздавшим вводом
+  uint32_t resimulated;  // Сколько тиков пересчитал последний advance
+} Rollback_t;
+
+/**
+ * @brief Starts a session at tick 0
+ *
+ * @param[out] rollback State to initialize
+ * @param[in] seed Piece generator seed
+ * @param[in] mode Piece generator mode
+ */
+void rollback_init(Rollback_t* rollback, uint64_t seed, PieceRngMode mode);
+/**
+ * @brief Adds an action to the current or a recent tick
+ *
+ * Actions of one tick are applied in the order they were added.
+ *
+ * @param[in,out] rollback Session
+ * @param[in] frame Tick of the action, at most ROLLBACK_WINDOW - 1 back
+ * @param[in] action Action
+ * @return false if the tick is too old, in the future or already full
+ */
+bool rollback_input(Rollback_t* rollback, uint32_t frame,
+                    UserAction_t action);
+/**
+ * @brief Re-simulates ticks with late input and runs the current tick
+ *
+ * @param[in,out] rollback Session
+ * @return uint32_t Number of past ticks simulated again
+ */
+uint32_t rollback_advance(Rollback_t* rollback);
+/**
+ * @brief Returns the state checksum after a recent tick
+ *
+ * @param[in] rollback Session
+ * @param[in] frame Completed tick, at most ROLLBACK_WINDOW - 1 back
+ * @param[out] checksum State checksum
+ * @return false if the tick is not in the ring
+ */
+bool rollback_checksum(const Rollback_t* rollback, uint32_t frame,
+                       uint64_t* checksum);
+
+#endif
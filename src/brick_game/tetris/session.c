@@ -0,0 +1,333 @@
+#include "./session.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void session_relink(TetrisSession_t* session) {
+  for (int i = 0; i < GAME_FIELD_HEIGHT; i++) {
+    session->field_rows[i] = session->cells[i];
+  }
+  for (int i = 0; i < BLOCK_SIZE; i++) {
+    session->next_rows[i] = session->next_cells[i];
+  }
+  session->info.field = session->field_rows;
+  session->info.next = session->next_rows;
+}
+
+void session_init(TetrisSession_t* session, uint64_t seed, PieceRngMode mode) {
+  memset(session, 0, sizeof(*session));
+  session_relink(session);
+
+  session->info.pause = PREVIEW;
+
+  session->block.name = -1;
+  session->block.y = GAME_FIELD_WIDTH / 2 - 2;
+
+  engine_context_init(&session->engine, seed, mode);
+  session->engine.persist = false;
+}
+
+static void autosave(TetrisSession_t* session) {
+  if (session->checkpoints &&
+      (session->engine.pieces != session->checkpoint_pieces ||
+       session->info.pause != session->checkpoint_pause)) {
+    CheckpointBody_t body;
+    session_checkpoint(session, &body);
+    checkpoint_store_save(session->checkpoints, session->checkpoint_slot,
+                          &body);
+    session->checkpoint_pieces = session->engine.pieces;
+    session->checkpoint_pause = session->info.pause;
+  }
+}
+
+static void record_history(TetrisSession_t* session) {
+  if (session->history &&
+      session->engine.pieces != session->history_pieces) {
+    GameSnapshot_t snapshot;
+    session_save(session, &snapshot);
+    // Без памяти история просто перестаёт расти, игра продолжается
+    undo_history_commit(session->history, &snapshot);
+    session->history_pieces = session->engine.pieces;
+  }
+}
+
+void session_clone(TetrisSession_t* clone, const TetrisSession_t* source) {
+  memcpy(clone, source, sizeof(*clone));
+  session_relink(clone);
+  clone->checkpoints = NULL;
+  clone->history = NULL;
+}
+
+void session_commit(TetrisSession_t* session, const TetrisSession_t* trial) {
+  CheckpointStore_t* checkpoints = session->checkpoints;
+  UndoHistory_t* history = session->history;
+  session_clone(session, trial);
+  session->checkpoints = checkpoints;
+  session->history = history;
+  autosave(session);
+  record_history(session);
+}
+
+void session_from_current(TetrisSession_t* session) {
+  GameSnapshot_t snapshot;
+  GameInfo_t* state = getCurrentState();
+  EngineContext_t* engine = getEngineContext(false);
+
+  // Временные клетки фигуры не попадают в снимок, поэтому состояние берём
+  // как есть, без updateCurrentState()
+  snapshot_capture(state, getCurrentBlock(false), engine, &snapshot);
+  session_init(session, 0, RNG_UNIFORM);
+  session_restore(session, &snapshot);
+  session->engine.game_start_tick = engine->game_start_tick;
+  session->engine.game_start_lines = engine->game_start_lines;
+}
+
+void session_input(TetrisSession_t* session, UserAction_t action) {
+  EngineContext_t* previous = engine_bind(&session->engine);
+
+  erase_temporary_figure(&session->info, &session->block);
+  apply_user_action(&session->info, &session->block, action);
+  draw_temporary_figure(&session->info, &session->block);
+
+  engine_bind(previous);
+  autosave(session);
+  record_history(session);
+}
+
+bool session_step(TetrisSession_t* session) {
+  if (session->info.pause != PAUSE_OFF) return false;
+
+  EngineContext_t* previous = engine_bind(&session->engine);
+
+  erase_temporary_figure(&session->info, &session->block);
+  engine_tick(&session->info, &session->block);
+  draw_temporary_figure(&session->info, &session->block);
+
+  engine_bind(previous);
+  autosave(session);
+  record_history(session);
+  return true;
+}
+
+void session_settle(TetrisSession_t* session) {
+  for (int i = 0; i < SESSION_SETTLE_TICKS && session->engine.fsm != MOVING;
+       i++) {
+    if (!session_step(session)) return;
+  }
+}
+
+bool session_place(TetrisSession_t* session, int rotation, int column) {
+  GameBlock_t* block = &session->block;
+  if (session->engine.fsm != MOVING || session->info.pause != PAUSE_OFF) {
+    return false;
+  }
+
+  for (int i = 0; i < 3 && block->rotation != rotation; i++) {
+    session_input(session, Up);
+  }
+  while (block->y != column) {
+    int before = block->y;
+    session_input(session, block->y < column ? Right : Left);
+    if (block->y == before) break;
+  }
+  if (block->rotation != rotation || block->y != column) return false;
+
+  uint32_t pieces = session->engine.pieces;
+  session_input(session, Action);
+  // Упавшая фигура фиксируется на следующих тиках
+  for (int i = 0; i < SESSION_SETTLE_TICKS && session->engine.pieces == pieces;
+       i++) {
+    if (!session_step(session)) break;
+  }
+  session_settle(session);
+  return session->engine.pieces != pieces;
+}
+
+void session_save(const TetrisSession_t* session, GameSnapshot_t* snapshot) {
+  snapshot_capture(&session->info, &session->block, &session->engine,
+                   snapshot);
+}
+
+void session_restore(TetrisSession_t* session, const GameSnapshot_t* snapshot) {
+  session_relink(session);
+  snapshot_restore(snapshot, &session->info, &session->block,
+                   &session->engine);
+}
+
+void session_checkpoint(const TetrisSession_t* session,
+                        CheckpointBody_t* body) {
+  memset(body, 0, sizeof(*body));
+  session_save(session, &body->state);
+  body->game_start_tick = session->engine.game_start_tick;
+  body->game_start_lines = session->engine.game_start_lines;
+}
+
+void session_load_checkpoint(TetrisSession_t* session,
+                             const CheckpointBody_t* body) {
+  session_init(session, 0, RNG_UNIFORM);
+  session_restore(session, &body->state);
+  session->engine.game_start_tick = body->game_start_tick;
+  session->engine.game_start_lines = body->game_start_lines;
+}
+
+void session_attach_checkpoints(TetrisSession_t* session,
+                                CheckpointStore_t* store, uint32_t slot) {
+  session->checkpoints = store;
+  session->checkpoint_slot = slot;
+  session->checkpoint_pieces = session->engine.pieces;
+  session->checkpoint_pause = session->info.pause;
+  if (store) {
+    CheckpointBody_t body;
+    session_checkpoint(session, &body);
+    checkpoint_store_save(store, slot, &body);
+  }
+}
+
+bool session_resume(TetrisSession_t* session, const CheckpointStore_t* store,
+                    uint32_t slot) {
+  CheckpointBody_t body;
+  if (!checkpoint_store_load(store, slot, &body)) return false;
+
+  session_load_checkpoint(session, &body);
+  return true;
+}
+
+void session_attach_history(TetrisSession_t* session, UndoHistory_t* history) {
+  session->history = history;
+  session->history_pieces = session->engine.pieces;
+  if (history) {
+    GameSnapshot_t snapshot;
+    session_save(session, &snapshot);
+    undo_history_init(history, &snapshot);
+  }
+}
+
+static bool travel(TetrisSession_t* session, bool (*step)(UndoHistory_t*)) {
+  if (!session->history || !step(session->history)) return false;
+
+  session_restore(session, &session->history->current);
+  session->history_pieces = session->engine.pieces;
+  autosave(session);
+  return true;
+}
+
+bool session_undo(TetrisSession_t* session) {
+  return travel(session, undo_history_undo);
+}
+
+bool session_redo(TetrisSession_t* session) {
+  return travel(session, undo_history_redo);
+}
+
+bool session_run_replay(const Replay_t* replay, TetrisSession_t* session) {
+  session_init(session, replay->seed, (PieceRngMode)replay->ruleset);
+
+  bool ok = true;
+  for (size_t i = 0; ok && i < replay->count; i++) {
+    const ReplayEvent_t* event = &replay->events[i];
+    while (ok && session->engine.tick < event->tick) {
+      ok = session_step(session);
+    }
+    if (ok) session_input(session, (UserAction_t)event->action);
+  }
+
+  while (ok && session->info.pause != STOP &&
+         session->engine.tick < replay->summary.final_tick) {
+    ok = session_step(session);
+  }
+  return ok;
+}
+
+bool session_seek(const ReplayIndex_t* index, uint32_t piece,
+                  TetrisSession_t* session) {
+  const ReplayKeyframe_t* keyframe = replay_index_find(index, piece);
+  ReplayCursor_t cursor;
+
+  session_init(session, index->seed, (PieceRngMode)index->ruleset);
+  if (keyframe) {
+    session_restore(session, &keyframe->state);
+    replay_cursor_init(&cursor, index->map, index->size,
+                       keyframe->event_offset, keyframe->last_tick);
+  } else {
+    replay_cursor_init(&cursor, index->map, index->size, index->events_offset,
+                       0);
+  }
+
+  ReplayEvent_t event;
+  bool has_event = replay_cursor_next(&cursor, &event);
+  bool ok = true;
+  while (ok && session->engine.pieces < piece) {
+    if (has_event && event.tick <= session->engine.tick) {
+      session_input(session, (UserAction_t)event.action);
+      has_event = replay_cursor_next(&cursor, &event);
+    } else if (has_event || session->engine.tick < index->final_tick) {
+      ok = session_step(session);
+    } else {
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void session_summary(const TetrisSession_t* session, ReplaySummary_t* summary) {
+  summary->final_tick = session->engine.tick;
+  summary->score = session->info.score;
+  summary->lines = session->engine.lines;
+  summary->pieces = session->engine.pieces;
+  summary->checksum = session->engine.checksum;
+}
+
+static SessionShare_t* share_create(const TetrisSession_t* session) {
+  SessionShare_t* share = (SessionShare_t*)malloc(sizeof(SessionShare_t));
+  if (share) {
+    session_clone(&share->session, session);
+    atomic_init(&share->refs, 1);
+  }
+  return share;
+}
+
+static void share_release(SessionShare_t* share) {
+  if (share &&
+      atomic_fetch_sub_explicit(&share->refs, 1, memory_order_acq_rel) == 1) {
+    free(share);
+  }
+}
+
+bool session_branch_init(SessionBranch_t* branch,
+                         const TetrisSession_t* session) {
+  branch->share = share_create(session);
+  return branch->share != NULL;
+}
+
+void session_branch_fork(SessionBranch_t* fork, const SessionBranch_t* branch) {
+  fork->share = branch->share;
+  if (fork->share) {
+    atomic_fetch_add_explicit(&fork->share->refs, 1, memory_order_relaxed);
+  }
+}
+
+const TetrisSession_t* session_branch_view(const SessionBranch_t* branch) {
+  return branch->share ? &branch->share->session : NULL;
+}
+
+TetrisSession_t* session_branch_edit(SessionBranch_t* branch) {
+  SessionShare_t* share = branch->share;
+  if (!share) return NULL;
+
+  // Единственный владелец может менять состояние на месте: новых ссылок
+  // взять уже не у кого
+  if (atomic_load_explicit(&share->refs, memory_order_acquire) == 1) {
+    return &share->session;
+  }
+
+  SessionShare_t* copy = share_create(&share->session);
+  if (!copy) return NULL;
+  share_release(share);
+  branch->share = copy;
+  return &copy->session;
+}
+
+void session_branch_release(SessionBranch_t* branch) {
+  share_release(branch->share);
+  branch->share = NULL;
+}
@@ -0,0 +1,289 @@
+/**
+ * @file session.h
+ * @brief Headless game sessions independent of the interactive singleton
+ */
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdatomic.h>
+
+#include "./backend.h"
+#include "./checkpoint.h"
+#include "./replay.h"
+#include "./undo.h"
+
+#define SESSION_SETTLE_TICKS 8
+
+/**
+ * @brief Complete state of one headless game
+ *
+ * All storage lives inside the structure: GameInfo_t points into cells
+ * and next_cells through the row tables, so a session never allocates.
+ */
+typedef struct {
+  int cells[GAME_FIELD_HEIGHT][GAME_FIELD_WIDTH];
+  int next_cells[BLOCK_SIZE][BLOCK_SIZE];
+  int* field_rows[GAME_FIELD_HEIGHT];
+  int* next_rows[BLOCK_SIZE];
+  GameInfo_t info;
+  GameBlock_t block;
+  EngineContext_t engine;
+  CheckpointStore_t* checkpoints;  // Куда сохранять после каждой фиксации
+  uint32_t checkpoint_slot;
+  uint32_t checkpoint_pieces;  // pieces на момент последнего сохранения
+  int checkpoint_pause;        // info.pause на момент последнего сохранения
+  UndoHistory_t* history;      // Куда записывать каждую фиксацию фигуры
+  uint32_t history_pieces;     // pieces на момент последней записи
+} TetrisSession_t;
+
+/**
+ * @brief Reference-counted read-only session shared by branches
+ */
+typedef struct {
+  TetrisSession_t session;
+  atomic_uint refs;
+} SessionShare_t;
+
+/**
+ * @brief Copy-on-write handle to a session
+ *
+ * Forking a branch only takes a reference; the session is copied the first
+ * time a branch that shares it is edited.
+ */
+typedef struct {
+  SessionShare_t* share;
+} SessionBranch_t;
+
+/**
+ * @brief Starts a session in the same state as a freshly launched game
+ *
+ * The session waits on the PREVIEW screen until it receives Start. It never
+ * writes the high score file.
+ *
+ * @param[out] session Session to initialize
+ * @param[in] seed Piece generator seed
+ * @param[in] mode Piece generator mode
+ */
+void session_init(TetrisSession_t* session, uint64_t seed, PieceRngMode mode);
+/**
+ * @brief Points the GameInfo_t row tables at the session's own storage
+ *
+ * Needed after the structure was copied or moved as raw bytes.
+ *
+ * @param[in,out] session Session to fix up
+ */
+void session_relink(TetrisSession_t* session);
+/**
+ * @brief Makes an independent copy of a session
+ *
+ * One memcpy of the flat structure plus fixing the row tables; never
+ * allocates. The copy is not attached to the checkpoint slot or the undo
+ * history of the source.
+ *
+ * @param[out] clone Destination session, may not overlap source
+ * @param[in] source Session to copy
+ */
+void session_clone(TetrisSession_t* clone, const TetrisSession_t* source);
+/**
+ * @brief Replaces the game of a session with a changed clone of it
+ *
+ * The session keeps its checkpoint slot and undo history and records the
+ * new state into them, as if the clone's moves had been made on it.
+ *
+ * @param[in,out] session Session the clone was made from
+ * @param[in] trial Clone that was played on
+ */
+void session_commit(TetrisSession_t* session, const TetrisSession_t* trial);
+/**
+ * @brief Copies the interactive game into an independent session
+ *
+ * updateCurrentState() returns a GameInfo_t that shares its field and next
+ * matrices with the singleton; this gives a copy that can be changed.
+ *
+ * @param[out] session Session holding the current game
+ */
+void session_from_current(TetrisSession_t* session);
+/**
+ * @brief Applies one user action, like userInput() does for the singleton
+ *
+ * @param[in,out] session Session
+ * @param[in] action User action
+ */
+void session_input(TetrisSession_t* session, UserAction_t action);
+/**
+ * @brief Runs one game tick, like an expired GameTimer() in getCurrentState()
+ *
+ * @param[in,out] session Session
+ * @return false if the session is paused and no tick was run
+ */
+bool session_step(TetrisSession_t* session);
+/**
+ * @brief Runs ticks until a piece is falling or the game stops
+ *
+ * At most SESSION_SETTLE_TICKS ticks, enough to get from Start or from a
+ * lock to the next spawned piece.
+ *
+ * @param[in,out] session Session
+ */
+void session_settle(TetrisSession_t* session);
+/**
+ * @brief Drops the falling piece at a rotation and column
+ *
+ * Rotates with Up, shifts with Left and Right, drops with Action and then
+ * settles on the next piece. If the pose cannot be reached nothing is
+ * dropped, but the piece may be left rotated or shifted.
+ *
+ * @param[in,out] session Session with a falling piece
+ * @param[in] rotation Target rotation state, 0..3
+ * @param[in] column Target column of the piece anchor (block.y)
+ * @return true if the piece was locked
+ */
+bool session_place(TetrisSession_t* session, int rotation, int column);
+/**
+ * @brief Captures the session into a fixed-layout snapshot
+ *
+ * @param[in] session Session
+ * @param[out] snapshot Destination snapshot
+ */
+void session_save(const TetrisSession_t* session, GameSnapshot_t* snapshot);
+/**
+ * @brief Continues a game from a snapshot
+ *
+ * @param[out] session Session, initialized with session_init() before
+ * @param[in] snapshot Source snapshot
+ */
+void session_restore(TetrisSession_t* session, const GameSnapshot_t* snapshot);
+/**
+ * @brief Fills a checkpoint body from the session
+ *
+ * Headless sessions advance only on ticks, so the timer phase is always 0.
+ *
+ * @param[in] session Session
+ * @param[out] body Checkpoint body
+ */
+void session_checkpoint(const TetrisSession_t* session, CheckpointBody_t* body);
+/**
+ * @brief Starts a session from a checkpoint body
+ *
+ * @param[out] session Session to initialize
+ * @param[in] body Decoded checkpoint
+ */
+void session_load_checkpoint(TetrisSession_t* session,
+                             const CheckpointBody_t* body);
+/**
+ * @brief Saves the session into a slot after every locked piece
+ *
+ * The current state is saved right away, later states after every lock and
+ * every change of info.pause (start, pause, game over).
+ *
+ * @param[in,out] session Session
+ * @param[in] store Open slot file, NULL to stop saving
+ * @param[in] slot Slot of this session
+ */
+void session_attach_checkpoints(TetrisSession_t* session,
+                                CheckpointStore_t* store, uint32_t slot);
+/**
+ * @brief Continues a session from the newest checkpoint of a slot
+ *
+ * @param[out] session Session to initialize
+ * @param[in] store Open slot file
+ * @param[in] slot Slot index
+ * @return false if the slot holds no valid checkpoint
+ */
+bool session_resume(TetrisSession_t* session, const CheckpointStore_t* store,
+                    uint32_t slot);
+/**
+ * @brief Records every placement of a session into an undo history
+ *
+ * The history is restarted at the current state of the session. Pass NULL
+ * to stop recording.
+ *
+ * @param[in,out] session Session
+ * @param[out] history History owned by the caller
+ */
+void session_attach_history(TetrisSession_t* session, UndoHistory_t* history);
+/**
+ * @brief Returns the session to the state after the previous placement
+ *
+ * @param[in,out] session Session with an attached history
+ * @return false if there is nothing to undo
+ */
+bool session_undo(TetrisSession_t* session);
+/**
+ * @brief Repeats the placement that was undone last
+ *
+ * @param[in,out] session Session with an attached history
+ * @return false if there is nothing to redo
+ */
+bool session_redo(TetrisSession_t* session);
+/**
+ * @brief Re-simulates a replay from its first event to its final tick
+ *
+ * @param[in] replay Decoded replay
+ * @param[out] session Session holding the final state
+ * @return false if the replay needs ticks while the game is paused
+ */
+bool session_run_replay(const Replay_t* replay, TetrisSession_t* session);
+/**
+ * @brief Positions a session right after the given number of locked pieces
+ *
+ * Restores the nearest keyframe at or before the piece and simulates only
+ * the ticks after it.
+ *
+ * @param[in] index Mapped replay index
+ * @param[in] piece Number of locked pieces to seek to
+ * @param[out] session Session holding the state at that piece
+ * @return false if the replay ends before the piece is locked
+ */
+bool session_seek(const ReplayIndex_t* index, uint32_t piece,
+                  TetrisSession_t* session);
+/**
+ * @brief Fills a replay summary from the session state
+ *
+ * @param[in] session Session
+ * @param[out] summary Summary with tick, score, lines, pieces and checksum
+ */
+void session_summary(const TetrisSession_t* session, ReplaySummary_t* summary);
+
+/**
+ * @brief Starts a copy-on-write branch from a session
+ *
+ * @param[out] branch Branch to initialize
+ * @param[in] session Starting state, copied once
+ * @return false if memory could not be allocated
+ */
+bool session_branch_init(SessionBranch_t* branch,
+                         const TetrisSession_t* session);
+/**
+ * @brief Makes another branch that shares the state of an existing one
+ *
+ * Takes no copy and never allocates.
+ *
+ * @param[out] fork New branch
+ * @param[in] branch Source branch
+ */
+void session_branch_fork(SessionBranch_t* fork, const SessionBranch_t* branch);
+/**
+ * @brief Read access to the state of a branch
+ *
+ * @param[in] branch Branch
+ * @return const TetrisSession_t* Shared state, do not modify
+ */
+const TetrisSession_t* session_branch_view(const SessionBranch_t* branch);
+/**
+ * @brief Write access to the state of a branch
+ *
+ * Copies the state if it is still shared with other branches.
+ *
+ * @param[in,out] branch Branch
+ * @return TetrisSession_t* Private state or NULL if the copy failed
+ */
+TetrisSession_t* session_branch_edit(SessionBranch_t* branch);
+/**
+ * @brief Drops the reference of a branch
+ *
+ * @param[in,out] branch Branch to release
+ */
+void session_branch_release(SessionBranch_t* branch);
+
+#endif
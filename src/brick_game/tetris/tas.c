@@ -0,0 +1,236 @@
+#include "./tas.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void save_tick(Tas_t* tas) {
+  TasRewind_t* rewind = &tas->rewind;
+  if (rewind->count) rewind->head = (rewind->head + 1) % TAS_REWIND_TICKS;
+  if (rewind->count < TAS_REWIND_TICKS) rewind->count++;
+  session_save(&tas->session, &rewind->states[rewind->head]);
+}
+
+void tas_init(Tas_t* tas, uint64_t seed, PieceRngMode mode) {
+  session_init(&tas->session, seed, mode);
+  tas->rewind.head = 0;
+  tas->rewind.count = 0;
+  save_tick(tas);
+}
+
+void tas_input(Tas_t* tas, UserAction_t action) {
+  session_input(&tas->session, action);
+}
+
+bool tas_step(Tas_t* tas) {
+  if (!session_step(&tas->session)) return false;
+  save_tick(tas);
+  return true;
+}
+
+uint32_t tas_rewind(Tas_t* tas, uint32_t ticks) {
+  TasRewind_t* rewind = &tas->rewind;
+  if (ticks > rewind->count - 1) ticks = rewind->count - 1;
+
+  rewind->head =
+      (rewind->head + TAS_REWIND_TICKS - ticks) % TAS_REWIND_TICKS;
+  rewind->count -= ticks;
+  session_restore(&tas->session, &rewind->states[rewind->head]);
+  return ticks;
+}
+
+static const char* const action_names[] = {
+    "start", "pause", "terminate", "left", "right", "up", "down", "action"};
+
+static int parse_action(const char* word) {
+  for (int i = 0; i < (int)(sizeof(action_names) / sizeof(*action_names));
+       i++) {
+    if (strcmp(word, action_names[i]) == 0) return i;
+  }
+  return strcmp(word, "drop") == 0 ? Action : -1;
+}
+
+static bool parse_count(const char* word, uint32_t* value) {
+  if (!word) {
+    *value = 1;
+    return true;
+  }
+  char* end;
+  unsigned long parsed = strtoul(word, &end, 10);
+  if (*end != '\0' || parsed > UINT32_MAX) return false;
+  *value = (uint32_t)parsed;
+  return true;
+}
+
+static bool parse_row(const char* index, const char* cells,
+                      TasCommand_t* command) {
+  uint32_t row;
+  if (!index || !cells || !parse_count(index, &row) ||
+      row >= GAME_FIELD_HEIGHT || strlen(cells) != GAME_FIELD_WIDTH) {
+    return false;
+  }
+
+  uint32_t mask = 0;
+  for (int col = 0; col < GAME_FIELD_WIDTH; col++) {
+    if (cells[col] == '#' || cells[col] == 'x') {
+      mask |= 1u << col;
+    } else if (cells[col] != '.') {
+      return false;
+    }
+  }
+  command->kind = TAS_COMMAND_ROW;
+  command->row = (uint16_t)row;
+  command->value = mask;
+  return true;
+}
+
+static bool push_command(TasScript_t* script, const TasCommand_t* command) {
+  if (script->count == script->capacity) {
+    size_t capacity = script->capacity ? script->capacity * 2 : 64;
+    TasCommand_t* grown = (TasCommand_t*)realloc(
+        script->commands, capacity * sizeof(TasCommand_t));
+    if (!grown) return false;
+    script->commands = grown;
+    script->capacity = capacity;
+  }
+  script->commands[script->count++] = *command;
+  return true;
+}
+
+/**
+ * Parses one line already split into words, comments are skipped by the
+ * caller. Header commands are accepted only before any other command.
+ */
+static bool parse_line(char** words, int count, TasScript_t* script) {
+  if (count == 0) return true;
+
+  TasCommand_t command = {0};
+  const char* argument = count > 1 ? words[1] : NULL;
+  bool ok = false;
+  int action = parse_action(words[0]);
+
+  if (strcmp(words[0], "seed") == 0) {
+    ok = count == 2 && script->count == 0;
+    if (ok) {
+      char* end;
+      script->seed = strtoull(argument, &end, 10);
+      ok = *end == '\0';
+    }
+  } else if (strcmp(words[0], "rng") == 0) {
+    ok = count == 2 && script->count == 0;
+    if (ok && strcmp(argument, "bag") == 0) {
+      script->mode = RNG_BAG;
+    } else if (ok && strcmp(argument, "uniform") == 0) {
+      script->mode = RNG_UNIFORM;
+    } else {
+      ok = false;
+    }
+  } else if (strcmp(words[0], "row") == 0) {
+    ok = count == 3 && parse_row(words[1], words[2], &command) &&
+         push_command(script, &command);
+  } else if (strcmp(words[0], "wait") == 0 || action >= 0) {
+    command.kind = action >= 0 ? TAS_COMMAND_ACTION : TAS_COMMAND_WAIT;
+    command.action = action >= 0 ? (uint8_t)action : 0;
+    ok = count <= 2 && parse_count(argument, &command.value) &&
+         push_command(script, &command);
+  }
+  return ok;
+}
+
+bool tas_script_parse(const char* text, TasScript_t* script) {
+  memset(script, 0, sizeof(*script));
+  script->mode = RNG_UNIFORM;
+
+  int line_number = 0;
+  bool ok = true;
+  while (ok && *text) {
+    const char* end = strchr(text, '\n');
+    size_t length = end ? (size_t)(end - text) : strlen(text);
+    line_number++;
+
+    char line[TAS_LINE_MAX];
+    char* words[4];
+    int count = 0;
+    ok = length < sizeof(line);
+    if (ok) {
+      memcpy(line, text, length);
+      line[length] = '\0';
+      for (char* word = strtok(line, " \t\r"); word && count < 4;
+           word = strtok(NULL, " \t\r")) {
+        words[count++] = word;
+      }
+      bool comment = count > 0 && words[0][0] == '#';
+      ok = comment || (count < 4 && parse_line(words, count, script));
+    }
+    if (!ok) script->error_line = line_number;
+
+    text += length;
+    if (*text == '\n') text++;
+  }
+
+  if (!ok) tas_script_free(script);
+  return ok;
+}
+
+bool tas_script_load(const char* path, TasScript_t* script) {
+  memset(script, 0, sizeof(*script));
+  FILE* file = fopen(path, "r");
+  if (!file) return false;
+
+  char* text = NULL;
+  size_t length = 0, capacity = 0, got = 0;
+  do {
+    if (length + 1 >= capacity) {
+      capacity = capacity ? capacity * 2 : 4096;
+      char* grown = (char*)realloc(text, capacity);
+      if (!grown) break;
+      text = grown;
+    }
+    got = fread(text + length, 1, capacity - length - 1, file);
+    length += got;
+  } while (got > 0);
+  fclose(file);
+
+  bool ok = false;
+  if (text) {
+    text[length] = '\0';
+    ok = tas_script_parse(text, script);
+  }
+  free(text);
+  return ok;
+}
+
+void tas_script_free(TasScript_t* script) {
+  free(script->commands);
+  script->commands = NULL;
+  script->count = 0;
+  script->capacity = 0;
+}
+
+static void set_row(TetrisSession_t* session, int row, uint32_t mask) {
+  erase_temporary_figure(&session->info, &session->block);
+  for (int col = 0; col < GAME_FIELD_WIDTH; col++) {
+    session->cells[row][col] = (int)((mask >> col) & 1);
+  }
+  draw_temporary_figure(&session->info, &session->block);
+}
+
+void tas_run_script(Tas_t* tas, const TasScript_t* script) {
+  tas_init(tas, script->seed, script->mode);
+
+  for (size_t i = 0; i < script->count; i++) {
+    const TasCommand_t* command = &script->commands[i];
+    if (command->kind == TAS_COMMAND_ROW) {
+      set_row(&tas->session, command->row, command->value);
+      // Поле задаётся до хода, поэтому входит в начало текущего тика
+      session_save(&tas->session, &tas->rewind.states[tas->rewind.head]);
+    } else if (command->kind == TAS_COMMAND_ACTION) {
+      for (uint32_t n = 0; n < command->value; n++) {
+        tas_input(tas, (UserAction_t)command->action);
+      }
+    } else {
+      uint32_t n = 0;
+      while (n < command->value && tas_step(tas)) n++;
+    }
+  }
+}
@@ -0,0 +1,143 @@
+/**
+ * @file tas.h
+ * @brief Tool-assisted play: tick stepping, rewind and input scripts
+ *
+ * A Tas_t drives a headless TetrisSession_t one tick at a time and keeps
+ * the GameSnapshot_t of the start of every recent tick in a ring, so any of
+ * the last TAS_REWIND_TICKS ticks can be restored with a single copy.
+ *
+ * Input scripts are text files with one command per line:
+ *
+ *   seed N             piece generator seed, only before other commands
+ *   rng uniform|bag    piece generator mode, only before other commands
+ *   row R ##..#.....   sets locked cells of field row R ('#' or 'x'); the
+ *                      first tick after start clears the field, so rows
+ *                      go after it
+ *   left [N]           applies an action N times in the current tick;
+ *                      also start, pause, terminate, right, up, down,
+ *                      action and its alias drop
+ *   wait [N]           advances N ticks, one by default
+ *
+ * Empty lines and lines starting with '#' are ignored.
+ */
+#ifndef TAS_H
+#define TAS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./session.h"
+
+#define TAS_REWIND_TICKS 4096
+#define TAS_LINE_MAX 128
+
+/**
+ * @brief Ring of tick start states, head is the current tick
+ */
+typedef struct {
+  GameSnapshot_t states[TAS_REWIND_TICKS];
+  uint32_t head;
+  uint32_t count;
+} TasRewind_t;
+
+/**
+ * @brief Session under tool-assisted control
+ */
+typedef struct {
+  TetrisSession_t session;
+  TasRewind_t rewind;
+} Tas_t;
+
+typedef enum {
+  TAS_COMMAND_ACTION,
+  TAS_COMMAND_WAIT,
+  TAS_COMMAND_ROW
+} TasCommandKind;
+
+/**
+ * @brief One parsed script command
+ */
+typedef struct {
+  uint8_t kind;    // TasCommandKind
+  uint8_t action;  // UserAction_t для TAS_COMMAND_ACTION
+  uint16_t row;    // Номер строки для TAS_COMMAND_ROW
+  uint32_t value;  // Повторы, тики или маска клеток строки
+} TasCommand_t;
+
+/**
+ * @brief Parsed input script
+ */
+typedef struct {
+  uint64_t seed;
+  PieceRngMode mode;
+  TasCommand_t* commands;
+  size_t count;
+  size_t capacity;
+  int error_line;  // Номер строки с ошибкой, 0 если её нет
+} TasScript_t;
+
+/**
+ * @brief Starts a tool-assisted session
+ *
+ * @param[out] tas State to initialize
+ * @param[in] seed Piece generator seed
+ * @param[in] mode Piece generator mode
+ */
+void tas_init(Tas_t* tas, uint64_t seed, PieceRngMode mode);
+/**
+ * @brief Applies a user action in the current tick
+ *
+ * @param[in,out] tas Session
+ * @param[in] action Action to apply
+ */
+void tas_input(Tas_t* tas, UserAction_t action);
+/**
+ * @brief Advances the game by one tick and saves the new tick start
+ *
+ * @param[in,out] tas Session
+ * @return false if the game is paused and no tick passed
+ */
+bool tas_step(Tas_t* tas);
+/**
+ * @brief Restores the start of an earlier tick
+ *
+ * Rewinding by 0 ticks drops the input applied in the current tick.
+ *
+ * @param[in,out] tas Session
+ * @param[in] ticks How many ticks to go back
+ * @return uint32_t Ticks actually rewound, limited by the saved history
+ */
+uint32_t tas_rewind(Tas_t* tas, uint32_t ticks);
+
+/**
+ * @brief Parses a script from text
+ *
+ * @param[in] text Script, lines separated by '\n'
+ * @param[out] script Parsed script, release with tas_script_free()
+ * @return false on a syntax error (see error_line) or allocation failure
+ */
+bool tas_script_parse(const char* text, TasScript_t* script);
+/**
+ * @brief Reads and parses a script file
+ *
+ * @param[in] path Script file path
+ * @param[out] script Parsed script, release with tas_script_free()
+ * @return false if the file cannot be read or has a syntax error
+ */
+bool tas_script_load(const char* path, TasScript_t* script);
+/**
+ * @brief Releases the commands of a script
+ *
+ * @param[in,out] script Script to release
+ */
+void tas_script_free(TasScript_t* script);
+/**
+ * @brief Starts a session with the seed of a script and runs its commands
+ *
+ * @param[out] tas Session to initialize
+ * @param[in] script Parsed script
+ */
+void tas_run_script(Tas_t* tas, const TasScript_t* script);
+
+#endif
@@ -0,0 +1,187 @@
+#include "./undo.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Контрольная сумма, остаток мешка, три 32-битных и один 64-битный варинт
+#define UNDO_COUNTERS_MAX (8 + 1 + 3 * 5 + 10)
+// Худший случай: каждый второй байт изменён, по три байта на байт снимка
+#define UNDO_RECORD_MAX \
+  (2 + UNDO_COUNTERS_MAX + sizeof(GameSnapshot_t) / 2 * 3)
+
+_Static_assert(UNDO_RECORD_MAX - 2 <= UINT8_MAX,
+               "record length must fit its length byte");
+
+static size_t put_varint(uint8_t* out, uint64_t value) {
+  size_t length = 0;
+  while (value >= 0x80) {
+    out[length++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[length++] = (uint8_t)value;
+  return length;
+}
+
+static size_t get_varint(const uint8_t* in, uint64_t* value) {
+  size_t length = 0;
+  *value = 0;
+  do {
+    *value |= (uint64_t)(in[length] & 0x7F) << (7 * length);
+  } while (in[length++] & 0x80);
+  return length;
+}
+
+/**
+ * Writes the XOR of the counters that change with every placement and
+ * clears them in both copies, so they do not become runs of their own.
+ */
+static size_t encode_counters(GameSnapshot_t* from, GameSnapshot_t* to,
+                              uint8_t* out) {
+  uint64_t checksum = from->checksum ^ to->checksum;
+  size_t length = 0;
+  for (int i = 0; i < 8; i++) out[length++] = (uint8_t)(checksum >> (i * 8));
+  out[length++] = from->rng.bag_left ^ to->rng.bag_left;
+  length += put_varint(out + length, from->tick ^ to->tick);
+  length += put_varint(out + length, from->lines ^ to->lines);
+  length += put_varint(out + length, from->pieces ^ to->pieces);
+  length += put_varint(out + length, from->rng.counter ^ to->rng.counter);
+
+  GameSnapshot_t* copies[] = {from, to};
+  for (int i = 0; i < 2; i++) {
+    copies[i]->checksum = 0;
+    copies[i]->tick = copies[i]->lines = copies[i]->pieces = 0;
+    copies[i]->rng.counter = 0;
+    copies[i]->rng.bag_left = 0;
+  }
+  return length;
+}
+
+static size_t apply_counters(GameSnapshot_t* snapshot, const uint8_t* in) {
+  size_t length = 0;
+  for (int i = 0; i < 8; i++) {
+    snapshot->checksum ^= (uint64_t)in[length++] << (i * 8);
+  }
+  snapshot->rng.bag_left ^= in[length++];
+  uint64_t value;
+  length += get_varint(in + length, &value);
+  snapshot->tick ^= (uint32_t)value;
+  length += get_varint(in + length, &value);
+  snapshot->lines ^= (uint32_t)value;
+  length += get_varint(in + length, &value);
+  snapshot->pieces ^= (uint32_t)value;
+  length += get_varint(in + length, &value);
+  snapshot->rng.counter ^= value;
+  return length;
+}
+
+/**
+ * Packs the XOR of two snapshots into the counters and runs. Single
+ * unchanged bytes inside a changed area are kept in the run, they cost less
+ * than a new run header.
+ */
+static size_t encode_delta(const GameSnapshot_t* before,
+                           const GameSnapshot_t* after, uint8_t* out) {
+  GameSnapshot_t from_copy = *before, to_copy = *after;
+  size_t length = encode_counters(&from_copy, &to_copy, out);
+
+  const uint8_t* from = (const uint8_t*)&from_copy;
+  const uint8_t* to = (const uint8_t*)&to_copy;
+  const size_t size = sizeof(GameSnapshot_t);
+  size_t last = 0, i = 0;
+
+  while (i < size) {
+    if (from[i] == to[i]) {
+      i++;
+      continue;
+    }
+
+    size_t end = i + 1;
+    while (end < size) {
+      if (from[end] != to[end]) {
+        end++;
+      } else if (end + 1 < size && from[end + 1] != to[end + 1]) {
+        end += 2;
+      } else {
+        break;
+      }
+    }
+
+    out[length++] = (uint8_t)(i - last);
+    out[length++] = (uint8_t)(end - i);
+    for (size_t k = i; k < end; k++) out[length++] = from[k] ^ to[k];
+    last = end;
+    i = end;
+  }
+  return length;
+}
+
+static void apply_delta(GameSnapshot_t* snapshot, const uint8_t* runs,
+                        size_t length) {
+  uint8_t* bytes = (uint8_t*)snapshot;
+  size_t offset = 0, i = apply_counters(snapshot, runs);
+
+  while (i + 2 <= length) {
+    offset += runs[i];
+    size_t count = runs[i + 1];
+    i += 2;
+    for (size_t k = 0; k < count; k++) bytes[offset + k] ^= runs[i + k];
+    offset += count;
+    i += count;
+  }
+}
+
+void undo_history_init(UndoHistory_t* history, const GameSnapshot_t* start) {
+  memset(history, 0, sizeof(*history));
+  history->current = *start;
+}
+
+void undo_history_free(UndoHistory_t* history) {
+  free(history->data);
+  history->data = NULL;
+  history->size = history->capacity = history->cursor = 0;
+  history->undo_count = history->redo_count = 0;
+}
+
+bool undo_history_commit(UndoHistory_t* history, const GameSnapshot_t* state) {
+  if (history->cursor + UNDO_RECORD_MAX > history->capacity) {
+    size_t capacity = history->capacity ? history->capacity * 2 : 4096;
+    uint8_t* data = (uint8_t*)realloc(history->data, capacity);
+    if (!data) return false;
+    history->data = data;
+    history->capacity = capacity;
+  }
+
+  uint8_t* record = history->data + history->cursor;
+  size_t length = encode_delta(&history->current, state, record + 1);
+  record[0] = (uint8_t)length;
+  record[length + 1] = (uint8_t)length;
+
+  history->cursor += length + 2;
+  history->size = history->cursor;
+  history->undo_count++;
+  history->redo_count = 0;
+  history->current = *state;
+  return true;
+}
+
+bool undo_history_undo(UndoHistory_t* history) {
+  if (history->undo_count == 0) return false;
+
+  size_t length = history->data[history->cursor - 1];
+  history->cursor -= length + 2;
+  apply_delta(&history->current, history->data + history->cursor + 1, length);
+  history->undo_count--;
+  history->redo_count++;
+  return true;
+}
+
+bool undo_history_redo(UndoHistory_t* history) {
+  if (history->redo_count == 0) return false;
+
+  size_t length = history->data[history->cursor];
+  apply_delta(&history->current, history->data + history->cursor + 1, length);
+  history->cursor += length + 2;
+  history->redo_count--;
+  history->undo_count++;
+  return true;
+}
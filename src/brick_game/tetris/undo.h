@@ -0,0 +1,82 @@
+/**
+ * @file undo.h
+ * @brief Unlimited undo and redo of piece placements
+ *
+ * The history keeps only the current GameSnapshot_t in full. Every other
+ * state is stored as the byte-wise XOR difference to its neighbour, so all
+ * states share the parts of the snapshot that did not change. The counters
+ * that change with every placement go into a small header, the rest is
+ * packed as runs of changed bytes. A placement usually touches a few rows
+ * and the piece pose, which gives records of about two dozen bytes, a third
+ * of them the checksum, which cannot be derived from the other fields. Undo
+ * and redo apply one record and never depend on the length of the history.
+ *
+ * Record layout: [length][counters][runs][length], where length is the
+ * size of counters and runs in bytes. Counters are the XOR of the checksum
+ * in 8 bytes and of the generator bag_left in one byte, then the XOR of
+ * tick, lines, pieces and the generator counter as varints. Every run is
+ * [skip][count][count XOR bytes]. Storing the length at both ends lets the
+ * history be walked in both directions.
+ */
+#ifndef UNDO_H
+#define UNDO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./frame.h"
+
+/**
+ * @brief Linear history of game states with a cursor
+ *
+ * Records before cursor lead back to older states, records after it are
+ * available for redo until the next commit drops them.
+ */
+typedef struct {
+  GameSnapshot_t current;  // Состояние в позиции курсора
+  uint8_t* data;
+  size_t size;
+  size_t capacity;
+  size_t cursor;
+  uint32_t undo_count;
+  uint32_t redo_count;
+} UndoHistory_t;
+
+/**
+ * @brief Starts an empty history at the given state
+ *
+ * @param[out] history History to initialize
+ * @param[in] start Initial state
+ */
+void undo_history_init(UndoHistory_t* history, const GameSnapshot_t* start);
+/**
+ * @brief Releases the records of a history
+ *
+ * @param[in,out] history History to release
+ */
+void undo_history_free(UndoHistory_t* history);
+/**
+ * @brief Appends a new state after the cursor, dropping the redo part
+ *
+ * @param[in,out] history History
+ * @param[in] state New current state
+ * @return false if memory could not be allocated, the history is unchanged
+ */
+bool undo_history_commit(UndoHistory_t* history, const GameSnapshot_t* state);
+/**
+ * @brief Steps back to the previous state
+ *
+ * @param[in,out] history History
+ * @return false if there is nothing to undo
+ */
+bool undo_history_undo(UndoHistory_t* history);
+/**
+ * @brief Steps forward to the state that was undone last
+ *
+ * @param[in,out] history History
+ * @return false if there is nothing to redo
+ */
+bool undo_history_redo(UndoHistory_t* history);
+
+#endif
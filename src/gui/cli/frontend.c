@@ -1,5 +1,9 @@
 #include "./frontend.h"
 
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
 /**
  * @brief Initializes ncurses library with default game settings
  *
@@ -23,9 +27,56 @@ void initialize_ncurses() {
   mouseinterval(1);
 }
 
-UserAction_t readInput() {
+UserAction_t readInput() { return action_for_key(getch()); }
+
+int getWakeTimer(bool reset) {
+  static int timer = -1;
+  if (reset) {
+    if (timer >= 0) close(timer);
+    timer = -1;
+  } else if (timer < 0) {
+    timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  }
+  return timer;
+}
+
+bool wait_input(uint64_t deadline) {
+  struct pollfd fds[2] = {{.fd = STDIN_FILENO, .events = POLLIN},
+                          {.fd = -1, .events = POLLIN}};
+  int timeout = -1;
+
+  if (deadline) {
+    struct itimerspec spec = {
+        .it_interval = {0, 0},
+        .it_value = {(time_t)(deadline / 1000000000ULL),
+                     (long)(deadline % 1000000000ULL)}};
+    int timer = getWakeTimer(false);
+    if (timer >= 0 &&
+        timerfd_settime(timer, TFD_TIMER_ABSTIME, &spec, NULL) == 0) {
+      fds[1].fd = timer;
+    } else {
+      // Без timerfd спим с точностью до миллисекунды
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      uint64_t current =
+          (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+      timeout =
+          deadline > current ? (int)((deadline - current + 999999) / 1000000)
+                             : 0;
+    }
+  }
+
+  int ready = poll(fds, 2, timeout);
+  if (ready > 0 && (fds[1].revents & POLLIN)) {
+    uint64_t expirations;
+    ssize_t n = read(fds[1].fd, &expirations, sizeof(expirations));
+    (void)n;
+  }
+  return ready > 0 && (fds[0].revents & (POLLIN | POLLHUP | POLLERR));
+}
+
+UserAction_t action_for_key(int ch) {
   UserAction_t action = NO_ACTION;
-  int ch = getch();
 
   switch (ch) {
     case 's':
@@ -58,7 +109,6 @@ UserAction_t readInput() {
 
 void render(GameInfo_t CurrentState) {
   clear();
-  napms(50);
   if (CurrentState.field != NULL) {
     if (CurrentState.pause == PREVIEW) {
       draw_common_banner("START NEW GAME", true);
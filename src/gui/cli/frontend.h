@@ -11,12 +11,40 @@
 #define PREVIEW -2
 #define NO_ACTION -1
 #define PAUSE_ON 1
+#define BANNER_FRAME_NS 250000000ULL  // Кадр баннеров паузы и превью
 
 #include <ncurses.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 #include "../../common/common.h"
 
 void initialize_ncurses();
+/**
+ * @brief Maps a key code returned by getch() to a game action
+ *
+ * @param[in] ch Key code
+ * @return UserAction_t Action or NO_ACTION for other keys
+ */
+UserAction_t action_for_key(int ch);
+/**
+ * @brief Gets or closes the timerfd used by wait_input()
+ *
+ * @param[in] reset true to close the timer
+ * @return int Timer descriptor, -1 if closed or not available
+ */
+int getWakeTimer(bool reset);
+/**
+ * @brief Sleeps until a key arrives on stdin or the deadline passes
+ *
+ * The deadline is armed on a timerfd, so the sleep ends on the exact
+ * nanosecond instead of a rounded poll() timeout. Keys already buffered by
+ * ncurses are not seen, so the caller drains getch() before sleeping again.
+ *
+ * @param[in] deadline CLOCK_MONOTONIC time in nanoseconds, 0 for none
+ * @return true if stdin has input
+ */
+bool wait_input(uint64_t deadline);
 void render(GameInfo_t CurrentState);
 void render_game_field(int** filed);
 void render_cell(int row, int col, bool is_filled);
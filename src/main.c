@@ -1,24 +1,182 @@
 #include "main.h"
 
+#include <errno.h>
+#include <fcntl.h>
+
 #include "brick_game/tetris/backend.h"
+#include "brick_game/tetris/bot_protocol.h"
+#include "brick_game/tetris/input_queue.h"
+#include "brick_game/tetris/leaderboard.h"
+#include "brick_game/tetris/persist.h"
+#include "brick_game/tetris/replay.h"
+#include "brick_game/tetris/rng.h"
+#include "brick_game/tetris/tas.h"
 #include "gui/cli/frontend.h"
 
-int main() {
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--protocol") == 0) {
+    return bot_protocol_serve(STDIN_FILENO, STDOUT_FILENO) ? 0 : 1;
+  }
+  if (argc > 1 && strcmp(argv[1], "--tas") == 0) {
+    return tas_game(argc > 2 ? argv[2] : NULL) ? 0 : 1;
+  }
   game();
   return 0;
 }
 
+static uint64_t monotonic_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t env_ms(const char* name, uint64_t fallback) {
+  const char* value = getenv(name);
+  char* end = NULL;
+  unsigned long long ms = value ? strtoull(value, &end, 10) : 0;
+  return value && end != value && *end == '\0' ? ms * 1000000ULL : fallback;
+}
+
+static uint64_t earliest(uint64_t a, uint64_t b) {
+  return !a || (b && b < a) ? b : a;
+}
+
+/**
+ * Picks a replay file in the data directory that no other game uses: two
+ * games started in the same second get different suffixes instead of
+ * truncating each other's file.
+ */
+static bool reserve_replay_path(uint64_t seed, char* path, size_t size) {
+  for (int attempt = 0; attempt < GAME_REPLAY_ATTEMPTS; attempt++) {
+    char name[64];
+    if (attempt) {
+      snprintf(name, sizeof(name), "replay_%llu_%d.bgr",
+               (unsigned long long)seed, attempt);
+    } else {
+      snprintf(name, sizeof(name), "replay_%llu.bgr",
+               (unsigned long long)seed);
+    }
+    if (!persist_path(name, path, size)) return false;
+
+    // Пустой файл занимает имя, recorder затем откроет его заново
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+      close(fd);
+      return true;
+    }
+    if (errno != EEXIST) return false;
+  }
+  return false;
+}
+
 void game() {
-  srand(time(NULL));
+  uint64_t seed = (uint64_t)time(NULL);
+  piece_rng_seed(getPieceRng(false), seed, RNG_UNIFORM);
   initialize_ncurses();
   GameInfo_t CurrentState = updateCurrentState();
 
+  ReplayRecorder_t recorder;
+  char replay_path[PERSIST_PATH_MAX];
+  if (reserve_replay_path(seed, replay_path, sizeof(replay_path))) {
+    replay_recorder_open(&recorder, replay_path, seed, RNG_UNIFORM);
+  } else {
+    memset(&recorder, 0, sizeof(recorder));
+  }
+  EngineContext_t* engine = getEngineContext(false);
+  InputQueue_t input;
+  input_queue_init(&input, env_ms(GAME_DAS_ENV, INPUT_DAS_DEFAULT_NS),
+                   env_ms(GAME_ARR_ENV, INPUT_ARR_DEFAULT_NS));
+
+  render(CurrentState);
+  uint64_t banner_deadline = monotonic_ns() + BANNER_FRAME_NS;
+
   do {
-    userInput(readInput(), true);
+    uint64_t deadline = GameTimerDeadline(CurrentState.pause);
+    // На паузе и превью просыпаемся только ради анимации баннера
+    if (!deadline) deadline = banner_deadline;
+    deadline = earliest(deadline, input_queue_deadline(&input));
+    if (wait_input(deadline)) {
+      uint64_t now = monotonic_ns();
+      for (int ch = getch(); ch != ERR; ch = getch()) {
+        UserAction_t action = action_for_key(ch);
+        if ((int)action != NO_ACTION) input_queue_key(&input, action, now);
+      }
+    }
+    input_queue_advance(&input, monotonic_ns());
+
+    // Всё, что накопилось, применяется до следующего кадра
+    InputEvent_t event;
+    while (CurrentState.pause != STOP && input_queue_pop(&input, &event)) {
+      userInput(event.action, event.repeat);
+      replay_recorder_add(&recorder, getCurrentTick(), event.action);
+      if (event.action == Terminate) CurrentState.pause = STOP;
+    }
     CurrentState = updateCurrentState();
+    if (replay_recorder_keyframe_due(&recorder, engine->pieces)) {
+      GameSnapshot_t snapshot;
+      snapshot_capture(&CurrentState, getCurrentBlock(false), engine,
+                       &snapshot);
+      replay_recorder_keyframe(&recorder, &snapshot);
+    }
     render(CurrentState);
+    banner_deadline = monotonic_ns() + BANNER_FRAME_NS;
   } while (CurrentState.pause != STOP);
 
+  ReplaySummary_t summary = {engine->tick, CurrentState.score, engine->lines,
+                             engine->pieces, engine->checksum};
+  replay_recorder_close(&recorder, &summary);
+  getIoWriter(true);
+  getRecordWriter(true);
+  getLeaderboard(true);
+
   free_resourse();
+  getWakeTimer(true);
+  endwin();
+}
+
+bool tas_game(const char* script_path) {
+  // Кольцо сохранений занимает полмегабайта, на стеке ему не место
+  static Tas_t tas;
+
+  if (script_path) {
+    TasScript_t script;
+    if (!tas_script_load(script_path, &script)) {
+      fprintf(stderr, "%s: cannot load script (line %d)\n", script_path,
+              script.error_line);
+      return false;
+    }
+    tas_run_script(&tas, &script);
+    tas_script_free(&script);
+  } else {
+    tas_init(&tas, (uint64_t)time(NULL), RNG_UNIFORM);
+  }
+
+  initialize_ncurses();
+  do {
+    // Игра стоит, пока нет нажатий, поэтому спим без дедлайна
+    for (int ch = wait_input(0) ? getch() : ERR; ch != ERR; ch = getch()) {
+      if (ch == '.') {
+        tas_step(&tas);
+      } else if (ch == '>') {
+        int steps = 0;
+        while (steps < TAS_FAST_TICKS && tas_step(&tas)) steps++;
+      } else if (ch == ',') {
+        tas_rewind(&tas, 1);
+      } else if (ch == '<') {
+        tas_rewind(&tas, TAS_FAST_TICKS);
+      } else {
+        UserAction_t action = action_for_key(ch);
+        if ((int)action != NO_ACTION) tas_input(&tas, action);
+      }
+      if (tas.session.info.pause == STOP) break;
+    }
+
+    render(tas.session.info);
+    mvprintw(GAME_FIELD_HEIGHT + 1, 0, "TICK %u  REWIND %u",
+             tas.session.engine.tick, tas.rewind.count - 1);
+    refresh();
+  } while (tas.session.info.pause != STOP);
+
   endwin();
-}
\ No newline at end of file
+  return true;
+}
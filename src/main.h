@@ -5,8 +5,35 @@
 #ifndef MAIN_H
 #define MAIN_H
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
+#define TAS_FAST_TICKS 60
+#define GAME_DAS_ENV "BRICK_GAME_DAS_MS"  // Задержка автоповтора, мс
+#define GAME_ARR_ENV "BRICK_GAME_ARR_MS"  // Период автоповтора, мс
+#define GAME_REPLAY_ATTEMPTS 100          // Имён записи на одну секунду
+
+/**
+ * @brief Runs the real-time game
+ *
+ * Sleeps until a key, a gravity tick or an auto-repeat is due. Auto-repeat
+ * timing is read from GAME_DAS_ENV and GAME_ARR_ENV in milliseconds.
+ */
 void game();
+/**
+ * @brief Runs the tool-assisted mode instead of the real-time game
+ *
+ * The game only advances on key presses: '.' steps one tick, '>' steps
+ * TAS_FAST_TICKS ticks, ',' and '<' rewind as far. Other keys are the
+ * usual game controls.
+ *
+ * @param[in] script_path Input script to start from, may be NULL
+ * @return false if the script could not be loaded
+ */
+bool tas_game(const char* script_path);
 
 #endif
\ No newline at end of file
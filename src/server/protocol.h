@@ -0,0 +1,91 @@
+/**
+ * @file protocol.h
+ * @brief Messages between the game server and its clients
+ *
+ * Every message has a fixed size and is sent in host byte order: the
+ * server only listens on a Unix socket or the loopback interface. Each
+ * request is answered by exactly one reply carrying the same sequence
+ * number, so clients may send several requests before reading.
+ *
+ * After SERVER_REQUEST_WATCH and its reply a connection becomes a
+ * spectator: it only receives variable-sized frames, each a
+ * ServerFrameHeader_t followed by the changed rows, and anything it sends
+ * is discarded. The first frame is always a keyframe.
+ */
+#ifndef SERVER_PROTOCOL_H
+#define SERVER_PROTOCOL_H
+
+#include <stdint.h>
+
+typedef enum {
+  SERVER_REQUEST_START = 1,  // Новая партия с seed и mode
+  SERVER_REQUEST_INPUT,      // Действие игрока
+  SERVER_REQUEST_STATE,      // Только прислать состояние
+  SERVER_REQUEST_HOLD,       // Действие с автоповтором, пока не отпущено
+  SERVER_REQUEST_RELEASE,    // Остановить автоповтор
+  SERVER_REQUEST_WATCH,      // Смотреть сессию с id в seed
+} ServerRequestType;
+
+typedef enum {
+  SERVER_REPLY_STATE = 1,
+  SERVER_REPLY_ERROR,
+} ServerReplyType;
+
+/**
+ * @brief Client request
+ */
+typedef struct {
+  uint8_t type;       // ServerRequestType
+  uint8_t action;     // UserAction_t для INPUT и HOLD
+  uint8_t mode;       // PieceRngMode для SERVER_REQUEST_START
+  uint8_t reserved;
+  uint32_t sequence;  // Возвращается в ответе
+  uint64_t seed;      // Для SERVER_REQUEST_START
+} ServerRequest_t;
+
+/**
+ * @brief Server reply with the session state after the request
+ */
+typedef struct {
+  uint8_t type;  // ServerReplyType
+  uint8_t reserved;
+  int16_t pause;
+  uint32_t sequence;
+  uint64_t session_id;
+  uint32_t tick;  // engine.tick сессии
+  int32_t score;
+  int32_t level;
+  uint32_t lines;
+  uint32_t pieces;
+  uint32_t late_ticks;  // Опоздавшие тики цикла этой сессии
+  uint64_t checksum;  // engine.checksum сессии
+} ServerReply_t;
+
+typedef enum {
+  SERVER_FRAME_DELTA = 1,  // Только строки, изменившиеся с прошлого кадра
+  SERVER_FRAME_KEY,        // Все строки поля
+} ServerFrameType;
+
+/**
+ * @brief Header of a spectator frame
+ *
+ * Followed by one uint16_t bitmask per changed row, in ascending row
+ * order. The piece pose and the score fields are always present.
+ */
+typedef struct {
+  uint16_t size;      // Размер кадра вместе со строками
+  uint8_t type;       // ServerFrameType
+  uint8_t changed;    // Число строк после заголовка
+  uint32_t sequence;  // Номер кадра сессии
+  uint32_t row_mask;  // Бит r - строка r есть в кадре
+  uint32_t tick;
+  int32_t score;
+  int8_t piece;
+  int8_t rotation;
+  int8_t x, y;
+  int8_t next;
+  int8_t level;
+  int16_t pause;
+} ServerFrameHeader_t;
+
+#endif
@@ -0,0 +1,1134 @@
+#define _GNU_SOURCE
+#include "./server.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../brick_game/tetris/handoff.h"
+
+#define SERVER_EVENTS_MAX 256
+#define SERVER_READS_PER_EVENT 4  // recv() одного клиента за пробуждение
+
+// Метки служебных дескрипторов в epoll; сессии передаются указателем
+#define EVENT_TIMER 1
+#define EVENT_WAKE 2
+#define EVENT_LISTEN 3
+
+#define SESSION_OF(timer, field)                                \
+  ((ServerSession_t*)((char*)(timer) - offsetof(ServerSession_t, field)))
+
+#define KEYFRAME_ROWS ((1u << GAME_FIELD_HEIGHT) - 1)
+#define HANDOFF_OUTPUT_MAX (HANDOFF_CLIENT_SIZE - 32)  // Без полей ниже
+
+/**
+ * Connection state stored next to the game of a session when the sessions
+ * are handed over to a new process.
+ */
+typedef struct {
+  uint64_t watch_id;
+  uint8_t started;
+  uint8_t held_action;
+  uint8_t repeating;  // Автоповтор был запущен
+  uint8_t input_len;
+  uint8_t input[sizeof(ServerRequest_t)];
+  uint32_t output_len;
+  uint8_t output[HANDOFF_OUTPUT_MAX];  // Неотправленный хвост потока
+} ServerHandoffClient_t;
+
+_Static_assert(sizeof(ServerHandoffClient_t) <= HANDOFF_CLIENT_SIZE,
+               "client state does not fit the handoff segment");
+
+uint32_t server_ms_to_ticks(uint32_t ms, uint32_t tick_hz) {
+  uint32_t ticks = (uint32_t)(((uint64_t)ms * tick_hz + 500) / 1000);
+  return ticks ? ticks : 1;
+}
+
+uint32_t server_gravity_ticks(int level, uint32_t tick_hz) {
+  uint64_t ticks =
+      (game_tick_interval(level) * tick_hz + 500000000ULL) / 1000000000ULL;
+  return ticks ? (uint32_t)ticks : 1;
+}
+
+static ServerFrame_t* frame_alloc(ServerLoop_t* loop) {
+  if (!loop->frame_pool) {
+    ServerFrameBlock_t* block =
+        (ServerFrameBlock_t*)malloc(sizeof(ServerFrameBlock_t));
+    if (!block) return NULL;
+    block->next = loop->frame_blocks;
+    loop->frame_blocks = block;
+    for (int i = SERVER_FRAME_BLOCK - 1; i >= 0; i--) {
+      block->frames[i].next = loop->frame_pool;
+      loop->frame_pool = &block->frames[i];
+    }
+  }
+
+  ServerFrame_t* frame = loop->frame_pool;
+  loop->frame_pool = frame->next;
+  frame->refs = 1;
+  return frame;
+}
+
+static void frame_release(ServerLoop_t* loop, ServerFrame_t* frame) {
+  if (frame && --frame->refs == 0) {
+    frame->next = loop->frame_pool;
+    loop->frame_pool = frame;
+  }
+}
+
+/**
+ * Encodes the last frame of the session: only the rows that differ from
+ * previous, or every row if previous is NULL.
+ */
+static ServerFrame_t* frame_encode(ServerLoop_t* loop,
+                                   const ServerSession_t* session,
+                                   const TetrisFrame_t* previous) {
+  ServerFrame_t* buffer = frame_alloc(loop);
+  if (!buffer) return NULL;
+
+  const TetrisFrame_t* frame = &session->last_frame;
+  ServerFrameHeader_t header;
+  memset(&header, 0, sizeof(header));
+  header.type = previous ? SERVER_FRAME_DELTA : SERVER_FRAME_KEY;
+  header.sequence = session->frame_sequence;
+  header.tick = session->game.engine.tick;
+  header.score = frame->score;
+  header.piece = frame->piece;
+  header.rotation = frame->rotation;
+  header.x = frame->x;
+  header.y = frame->y;
+  header.next = frame->next;
+  header.level = frame->level;
+  header.pause = frame->pause;
+
+  uint16_t rows[GAME_FIELD_HEIGHT];
+  for (int r = 0; r < GAME_FIELD_HEIGHT; r++) {
+    if (!previous || previous->rows[r] != frame->rows[r]) {
+      header.row_mask |= 1u << r;
+      rows[header.changed++] = frame->rows[r];
+    }
+  }
+  header.size =
+      (uint16_t)(sizeof(header) + header.changed * sizeof(uint16_t));
+
+  memcpy(buffer->data, &header, sizeof(header));
+  memcpy(buffer->data + sizeof(header), rows,
+         header.changed * sizeof(uint16_t));
+  buffer->size = header.size;
+  atomic_fetch_add_explicit(previous ? &loop->frames : &loop->keyframes, 1,
+                            memory_order_relaxed);
+  return buffer;
+}
+
+static void enqueue_frame(ServerSession_t* spectator, ServerFrame_t* frame) {
+  uint32_t slot = (spectator->queue_head + spectator->queue_count) %
+                  SERVER_SPECTATOR_QUEUE;
+  spectator->queue[slot] = frame;
+  spectator->queue_count++;
+  frame->refs++;
+}
+
+/**
+ * Releases the queued frames, except a partly sent one: its tail still
+ * has to go out or the stream loses its framing.
+ */
+static void drop_frames(ServerLoop_t* loop, ServerSession_t* spectator,
+                        bool all) {
+  uint32_t keep = !all && spectator->queue_offset ? 1 : 0;
+  while (spectator->queue_count > keep) {
+    spectator->queue_count--;
+    uint32_t slot = (spectator->queue_head + spectator->queue_count) %
+                    SERVER_SPECTATOR_QUEUE;
+    frame_release(loop, spectator->queue[slot]);
+  }
+  if (!spectator->queue_count) spectator->queue_offset = 0;
+}
+
+/**
+ * Sends the queued frames with one sendmsg() per batch, straight from the
+ * shared buffers.
+ */
+static bool flush_frames(ServerLoop_t* loop, ServerSession_t* spectator) {
+  while (spectator->queue_count) {
+    struct iovec iov[SERVER_SPECTATOR_QUEUE];
+    for (uint32_t i = 0; i < spectator->queue_count; i++) {
+      ServerFrame_t* frame =
+          spectator->queue[(spectator->queue_head + i) %
+                           SERVER_SPECTATOR_QUEUE];
+      uint32_t skip = i == 0 ? spectator->queue_offset : 0;
+      iov[i].iov_base = frame->data + skip;
+      iov[i].iov_len = frame->size - skip;
+    }
+    struct msghdr message = {0};
+    message.msg_iov = iov;
+    message.msg_iovlen = spectator->queue_count;
+
+    ssize_t n = sendmsg(spectator->fd, &message, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+
+    size_t left = (size_t)n;
+    while (left && spectator->queue_count) {
+      ServerFrame_t* frame = spectator->queue[spectator->queue_head];
+      size_t rest = frame->size - spectator->queue_offset;
+      if (left < rest) {
+        spectator->queue_offset += (uint32_t)left;
+        break;
+      }
+      left -= rest;
+      frame_release(loop, frame);
+      spectator->queue_head =
+          (spectator->queue_head + 1) % SERVER_SPECTATOR_QUEUE;
+      spectator->queue_count--;
+      spectator->queue_offset = 0;
+    }
+  }
+  return true;
+}
+
+static bool watch(ServerLoop_t* loop, int fd, uint32_t events, uint64_t tag,
+                  int op) {
+  struct epoll_event event = {.events = events, .data.u64 = tag};
+  return epoll_ctl(loop->epoll_fd, op, fd, &event) == 0;
+}
+
+/**
+ * Sends what is buffered, replies before spectator frames. Returns false
+ * if the client is gone or reads too slowly to keep its replies within
+ * SERVER_OUTPUT_MAX.
+ */
+static bool flush_output(ServerLoop_t* loop, ServerSession_t* session) {
+  size_t sent = 0;
+  while (sent < session->output_len) {
+    ssize_t n = send(session->fd, session->output + sent,
+                     session->output_len - sent, MSG_NOSIGNAL);
+    if (n > 0) {
+      sent += (size_t)n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    } else {
+      return false;
+    }
+  }
+  memmove(session->output, session->output + sent,
+          session->output_len - sent);
+  session->output_len -= sent;
+  if (session->output_len == 0 && !flush_frames(loop, session)) return false;
+
+  bool want_write = session->output_len > 0 || session->queue_count > 0;
+  if (want_write != session->want_write) {
+    uint32_t events = EPOLLIN | EPOLLRDHUP | (want_write ? EPOLLOUT : 0);
+    watch(loop, session->fd, events, (uint64_t)(uintptr_t)session,
+          EPOLL_CTL_MOD);
+    session->want_write = want_write;
+  }
+  return true;
+}
+
+/**
+ * Sends the current board to the spectators of a session if it changed.
+ * Costs nothing for sessions without spectators.
+ */
+static void publish(ServerLoop_t* loop, ServerSession_t* session) {
+  if (!session->spectators) return;
+
+  TetrisFrame_t frame;
+  frame_capture(&session->game.info, &session->game.block, &frame);
+  if (memcmp(&frame, &session->last_frame, sizeof(frame)) == 0) return;
+
+  TetrisFrame_t previous = session->last_frame;
+  session->last_frame = frame;
+  session->frame_sequence++;
+
+  ServerFrame_t* delta = frame_encode(loop, session, &previous);
+  ServerFrame_t* keyframe = NULL;
+  for (ServerSession_t* spectator = session->spectators; spectator;
+       spectator = spectator->spectator_next) {
+    if (!delta || spectator->queue_count == SERVER_SPECTATOR_QUEUE) {
+      spectator->need_keyframe = true;
+    }
+    if (spectator->need_keyframe) {
+      // Медленный зритель теряет дельты и получает поле целиком
+      drop_frames(loop, spectator, false);
+      if (!keyframe) keyframe = frame_encode(loop, session, NULL);
+      if (!keyframe) continue;
+      enqueue_frame(spectator, keyframe);
+      spectator->need_keyframe = false;
+    } else {
+      enqueue_frame(spectator, delta);
+    }
+    // Ошибку отправки заметит epoll по EPOLLERR и закроет зрителя
+    flush_output(loop, spectator);
+  }
+  frame_release(loop, delta);
+  frame_release(loop, keyframe);
+}
+
+/**
+ * Keeps the gravity timer pending exactly while the game runs, so paused
+ * and finished games leave the wheel.
+ */
+static void update_gravity(ServerLoop_t* loop, ServerSession_t* session) {
+  bool running = session->started && session->game.info.pause == PAUSE_OFF;
+  if (running && !timer_pending(&session->gravity)) {
+    uint32_t ticks = server_gravity_ticks(session->game.info.level,
+                                          loop->server->config.tick_hz);
+    timer_schedule(&loop->wheel, &session->gravity, loop->tick + ticks);
+  } else if (!running) {
+    timer_cancel(&loop->wheel, &session->gravity);
+  }
+}
+
+static void on_gravity(TimerNode_t* timer, void* context) {
+  ServerLoop_t* loop = (ServerLoop_t*)context;
+  ServerSession_t* session = SESSION_OF(timer, gravity);
+
+  session_step(&session->game);
+  atomic_fetch_add_explicit(&loop->steps, 1, memory_order_relaxed);
+  update_gravity(loop, session);
+  publish(loop, session);
+}
+
+static void on_repeat(TimerNode_t* timer, void* context) {
+  ServerLoop_t* loop = (ServerLoop_t*)context;
+  ServerSession_t* session = SESSION_OF(timer, repeat);
+
+  session_input(&session->game, (UserAction_t)session->held_action);
+  timer_schedule(&loop->wheel, &session->repeat,
+                 loop->tick + server_ms_to_ticks(
+                                  SERVER_ARR_MS, loop->server->config.tick_hz));
+  update_gravity(loop, session);
+  publish(loop, session);
+}
+
+static ServerSession_t* session_alloc(ServerLoop_t* loop) {
+  if (!loop->free_list) {
+    ServerSlab_t* slab = (ServerSlab_t*)malloc(sizeof(ServerSlab_t));
+    if (!slab) return NULL;
+    slab->next = loop->slabs;
+    loop->slabs = slab;
+    for (int i = SERVER_SLAB_SESSIONS - 1; i >= 0; i--) {
+      slab->sessions[i].next = loop->free_list;
+      loop->free_list = &slab->sessions[i];
+    }
+  }
+
+  ServerSession_t* session = loop->free_list;
+  loop->free_list = session->next;
+
+  // Ничего от прошлого соединения: ни номера кадра, ни зажатой клавиши
+  memset(session, 0, sizeof(*session));
+  session->prev = NULL;
+  session->next = loop->active;
+  if (loop->active) loop->active->prev = session;
+  loop->active = session;
+  return session;
+}
+
+static void session_close(ServerLoop_t* loop, ServerSession_t* session);
+
+/**
+ * Moves the context to the closed list, the descriptor stays open. The
+ * context is reused only after the current epoll batch, see
+ * recycle_closed().
+ */
+static void session_release(ServerLoop_t* loop, ServerSession_t* session) {
+  timer_cancel(&loop->wheel, &session->gravity);
+  timer_cancel(&loop->wheel, &session->repeat);
+  epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, session->fd, NULL);
+  session->fd = -1;
+
+  // Без игры зрителям смотреть нечего
+  while (session->spectators) session_close(loop, session->spectators);
+  ServerSession_t* watched = session->watching;
+  if (watched) {
+    if (session->spectator_prev) {
+      session->spectator_prev->spectator_next = session->spectator_next;
+    } else {
+      watched->spectators = session->spectator_next;
+    }
+    if (session->spectator_next) {
+      session->spectator_next->spectator_prev = session->spectator_prev;
+    }
+    session->watching = NULL;
+  }
+  drop_frames(loop, session, true);
+
+  if (session->prev) {
+    session->prev->next = session->next;
+  } else {
+    loop->active = session->next;
+  }
+  if (session->next) session->next->prev = session->prev;
+
+  session->next = loop->closed;
+  loop->closed = session;
+  atomic_fetch_sub(&loop->sessions, 1);
+}
+
+/**
+ * Returns the contexts closed during an epoll batch to the free list. Until
+ * then a later event of the same batch for a closed session still finds
+ * fd == -1 and is skipped, instead of reaching a new client that got the
+ * same context.
+ */
+static void recycle_closed(ServerLoop_t* loop) {
+  while (loop->closed) {
+    ServerSession_t* session = loop->closed;
+    loop->closed = session->next;
+    session->next = loop->free_list;
+    loop->free_list = session;
+  }
+}
+
+static void session_close(ServerLoop_t* loop, ServerSession_t* session) {
+  int fd = session->fd;
+  session_release(loop, session);
+  close(fd);
+  atomic_fetch_sub(&loop->server->sessions, 1);
+}
+
+static ServerSession_t* find_player(ServerLoop_t* loop, uint64_t id) {
+  for (ServerSession_t* session = loop->active; session;
+       session = session->next) {
+    if (session->id == id && !session->watch_id) return session;
+  }
+  return NULL;
+}
+
+/**
+ * Subscribes a spectator and queues a keyframe of the current board.
+ */
+static void attach_spectator(ServerLoop_t* loop, ServerSession_t* spectator,
+                             ServerSession_t* player) {
+  if (!player->spectators) {
+    // Без зрителей кадры не снимались, начинаем с текущего поля
+    frame_capture(&player->game.info, &player->game.block,
+                  &player->last_frame);
+    player->frame_sequence++;
+  }
+  spectator->watching = player;
+  spectator->spectator_prev = NULL;
+  spectator->spectator_next = player->spectators;
+  if (player->spectators) player->spectators->spectator_prev = spectator;
+  player->spectators = spectator;
+
+  ServerFrame_t* keyframe = frame_encode(loop, player, NULL);
+  spectator->need_keyframe = keyframe == NULL;
+  if (keyframe) {
+    enqueue_frame(spectator, keyframe);
+    frame_release(loop, keyframe);
+  }
+}
+
+/**
+ * Creates the context of a new connection and watches its socket. Closes
+ * the descriptor if that fails.
+ */
+static ServerSession_t* session_open(ServerLoop_t* loop, int fd, uint64_t id,
+                                     uint64_t watch_id) {
+  ServerSession_t* session = session_alloc(loop);
+  if (!session) {
+    close(fd);
+    atomic_fetch_sub(&loop->server->sessions, 1);
+    return NULL;
+  }
+
+  session->id = id;
+  session->fd = fd;
+  session->watch_id = watch_id;
+  timer_init(&session->gravity, on_gravity);
+  timer_init(&session->repeat, on_repeat);
+  session_init(&session->game, id, RNG_UNIFORM);
+  atomic_fetch_add(&loop->sessions, 1);
+
+  if (!watch(loop, fd, EPOLLIN | EPOLLRDHUP, (uint64_t)(uintptr_t)session,
+             EPOLL_CTL_ADD)) {
+    session_close(loop, session);
+    return NULL;
+  }
+  return session;
+}
+
+/**
+ * Subscribes a spectator to its session on this loop and sends what it
+ * has queued, or closes it if the session is not here.
+ */
+static void subscribe(ServerLoop_t* loop, ServerSession_t* session) {
+  ServerSession_t* player = find_player(loop, session->watch_id);
+  if (player) {
+    attach_spectator(loop, session, player);
+    if (!flush_output(loop, session)) session_close(loop, session);
+  } else {
+    session_close(loop, session);
+  }
+}
+
+static void adopt(ServerLoop_t* loop, int fd, uint64_t id, uint64_t watch_id) {
+  ServerSession_t* session = session_open(loop, fd, id, watch_id);
+  if (session && watch_id) subscribe(loop, session);
+}
+
+/**
+ * Describes the connection of a session for the handoff segment. Returns
+ * false if the unsent tail of its stream does not fit there.
+ */
+static bool handoff_client(const ServerSession_t* session,
+                           ServerHandoffClient_t* client) {
+  memset(client, 0, sizeof(*client));
+  const ServerFrame_t* started_frame =
+      session->queue_offset ? session->queue[session->queue_head] : NULL;
+  size_t rest = started_frame ? started_frame->size - session->queue_offset
+                              : 0;
+  if (session->output_len + rest > HANDOFF_OUTPUT_MAX) return false;
+
+  client->watch_id = session->watch_id;
+  client->started = session->started;
+  client->held_action = session->held_action;
+  client->repeating = timer_pending(&session->repeat);
+  client->input_len = (uint8_t)session->input_len;
+  memcpy(client->input, session->input, session->input_len);
+  // Начатый кадр надо дописать, остальные заменит новый ключевой кадр
+  memcpy(client->output, session->output, session->output_len);
+  if (rest) {
+    memcpy(client->output + session->output_len,
+           started_frame->data + session->queue_offset, rest);
+  }
+  client->output_len = (uint32_t)(session->output_len + rest);
+  return true;
+}
+
+/**
+ * Recreates a session handed over by the old process on the loop that owns
+ * it, or on the loop of the watched session for a spectator.
+ */
+static void resume(Server_t* server, const Handoff_t* handoff,
+                   uint32_t index, int fd,
+                   const ServerHandoffClient_t* client) {
+  uint64_t id = handoff->sessions[index].id;
+  uint64_t shard = client->watch_id ? client->watch_id : id;
+  ServerLoop_t* loop = &server->loops[shard % (uint64_t)server->loop_count];
+  if (id > server->next_id) server->next_id = id;
+  atomic_fetch_add(&server->sessions, 1);
+
+  ServerSession_t* session = session_open(loop, fd, id, client->watch_id);
+  if (!session) return;
+  if (!handoff_take_session(handoff, index, &id, &session->game) ||
+      client->input_len > sizeof(session->input) ||
+      client->output_len > HANDOFF_OUTPUT_MAX) {
+    session_close(loop, session);
+    return;
+  }
+
+  session->started = client->started;
+  session->held_action = client->held_action;
+  session->input_len = client->input_len;
+  memcpy(session->input, client->input, client->input_len);
+  session->output_len = client->output_len;
+  memcpy(session->output, client->output, client->output_len);
+  if (client->repeating) {
+    timer_schedule(&loop->wheel, &session->repeat,
+                   loop->tick + server_ms_to_ticks(SERVER_ARR_MS,
+                                                   server->config.tick_hz));
+  }
+  update_gravity(loop, session);
+
+  if (session->watch_id) {
+    subscribe(loop, session);
+  } else if (!flush_output(loop, session)) {
+    session_close(loop, session);
+  }
+}
+
+static bool reply(ServerLoop_t* loop, ServerSession_t* session, uint8_t type,
+                  uint32_t sequence) {
+  if (session->output_len + sizeof(ServerReply_t) > SERVER_OUTPUT_MAX) {
+    return false;
+  }
+
+  const TetrisSession_t* game = &session->game;
+  ServerReply_t message;
+  memset(&message, 0, sizeof(message));
+  message.type = type;
+  message.pause = (int16_t)game->info.pause;
+  message.sequence = sequence;
+  message.session_id = session->id;
+  message.tick = game->engine.tick;
+  message.score = game->info.score;
+  message.level = game->info.level;
+  message.lines = game->engine.lines;
+  message.pieces = game->engine.pieces;
+  message.checksum = game->engine.checksum;
+  message.late_ticks = (uint32_t)atomic_load_explicit(&loop->late_ticks,
+                                                      memory_order_relaxed);
+
+  memcpy(session->output + session->output_len, &message, sizeof(message));
+  session->output_len += sizeof(message);
+  return true;
+}
+
+static bool handle_request(ServerLoop_t* loop, ServerSession_t* session,
+                           const ServerRequest_t* request) {
+  if (session->watch_id) return true;  // Зрители только получают кадры
+
+  uint8_t type = SERVER_REPLY_STATE;
+  atomic_fetch_add_explicit(&loop->requests, 1, memory_order_relaxed);
+
+  if (request->type == SERVER_REQUEST_START && request->mode <= RNG_BAG) {
+    session_init(&session->game, request->seed,
+                 (PieceRngMode)request->mode);
+    session_input(&session->game, Start);
+    session->started = true;
+    timer_cancel(&loop->wheel, &session->gravity);
+    timer_cancel(&loop->wheel, &session->repeat);
+  } else if ((request->type == SERVER_REQUEST_INPUT ||
+              request->type == SERVER_REQUEST_HOLD) &&
+             session->started && request->action <= Action) {
+    session_input(&session->game, (UserAction_t)request->action);
+    if (request->type == SERVER_REQUEST_HOLD) {
+      session->held_action = request->action;
+      uint32_t das = server_ms_to_ticks(SERVER_DAS_MS,
+                                        loop->server->config.tick_hz);
+      timer_schedule(&loop->wheel, &session->repeat, loop->tick + das);
+    }
+  } else if (request->type == SERVER_REQUEST_RELEASE) {
+    timer_cancel(&loop->wheel, &session->repeat);
+  } else if (request->type == SERVER_REQUEST_WATCH && request->seed &&
+             request->seed != session->id && !session->spectators) {
+    // Чужой шард проверит сессию после переезда зрителя
+    Server_t* server = loop->server;
+    ServerLoop_t* target =
+        &server->loops[request->seed % (uint64_t)server->loop_count];
+    ServerSession_t* player =
+        target == loop ? find_player(loop, request->seed) : NULL;
+    if (target != loop || player) {
+      session->watch_id = request->seed;
+      session->started = false;
+      timer_cancel(&loop->wheel, &session->repeat);
+      if (player) attach_spectator(loop, session, player);
+    } else {
+      type = SERVER_REPLY_ERROR;
+    }
+  } else if (request->type != SERVER_REQUEST_STATE) {
+    type = SERVER_REPLY_ERROR;
+  }
+  update_gravity(loop, session);
+  publish(loop, session);
+  return reply(loop, session, type, request->sequence);
+}
+
+/**
+ * Handles what the client sent, at most SERVER_READS_PER_EVENT buffers, so
+ * one flooding client cannot hold up the other sockets of the batch. The
+ * socket is level-triggered: whatever is left unread reports it again on
+ * the next epoll_wait().
+ */
+static bool read_requests(ServerLoop_t* loop, ServerSession_t* session) {
+  uint8_t buffer[64 * sizeof(ServerRequest_t)];
+
+  for (int reads = 0; reads < SERVER_READS_PER_EVENT;) {
+    ssize_t n = recv(session->fd, buffer, sizeof(buffer), 0);
+    if (n == 0) return false;
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    reads++;
+
+    size_t pos = 0;
+    while (pos < (size_t)n) {
+      size_t take = sizeof(ServerRequest_t) - session->input_len;
+      if (take > (size_t)n - pos) take = (size_t)n - pos;
+      memcpy(session->input + session->input_len, buffer + pos, take);
+      session->input_len += take;
+      pos += take;
+
+      if (session->input_len == sizeof(ServerRequest_t)) {
+        ServerRequest_t request;
+        memcpy(&request, session->input, sizeof(request));
+        session->input_len = 0;
+        if (!handle_request(loop, session, &request)) return false;
+      }
+    }
+    // Ответы на всю пачку запросов уходят одним send()
+    if (!flush_output(loop, session)) return false;
+  }
+  return true;
+}
+
+static void run_tick(ServerLoop_t* loop) {
+  loop->tick++;
+  timer_wheel_advance(&loop->wheel, loop->tick, loop);
+  atomic_fetch_add_explicit(&loop->ticks, 1, memory_order_relaxed);
+}
+
+/**
+ * Queues a connection for another loop and wakes that loop up.
+ */
+static bool hand_off(ServerLoop_t* target, int fd, uint64_t id,
+                     uint64_t watch_id) {
+  pthread_mutex_lock(&target->lock);
+  bool queued = true;
+  if (target->incoming_count == target->incoming_capacity) {
+    size_t capacity =
+        target->incoming_capacity ? target->incoming_capacity * 2 : 64;
+    ServerHandoff_t* grown = (ServerHandoff_t*)realloc(
+        target->incoming, capacity * sizeof(ServerHandoff_t));
+    if (grown) {
+      target->incoming = grown;
+      target->incoming_capacity = capacity;
+    } else {
+      queued = false;
+    }
+  }
+  if (queued) {
+    target->incoming[target->incoming_count++] =
+        (ServerHandoff_t){fd, id, watch_id};
+  }
+  pthread_mutex_unlock(&target->lock);
+
+  if (queued) {
+    uint64_t one_event = 1;
+    ssize_t written = write(target->wake_fd, &one_event, sizeof(one_event));
+    (void)written;
+  }
+  return queued;
+}
+
+/**
+ * Moves a spectator to the loop that owns the watched session.
+ */
+static void migrate(ServerLoop_t* loop, ServerSession_t* session) {
+  Server_t* server = loop->server;
+  int fd = session->fd;
+  uint64_t id = session->id;
+  uint64_t watch_id = session->watch_id;
+  session_release(loop, session);
+
+  ServerLoop_t* target =
+      &server->loops[watch_id % (uint64_t)server->loop_count];
+  if (!hand_off(target, fd, id, watch_id)) {
+    close(fd);
+    atomic_fetch_sub(&server->sessions, 1);
+  }
+}
+
+static void accept_clients(Server_t* server, int listen_fd) {
+  for (;;) {
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+
+    uint32_t limit = server->config.max_sessions;
+    if (limit && atomic_load(&server->sessions) >= limit) {
+      close(fd);
+      continue;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    atomic_fetch_add(&server->sessions, 1);
+
+    uint64_t id = ++server->next_id;
+    ServerLoop_t* target = &server->loops[id % (uint64_t)server->loop_count];
+    if (target == &server->loops[0]) {
+      adopt(target, fd, id, 0);
+    } else if (!hand_off(target, fd, id, 0)) {
+      close(fd);
+      atomic_fetch_sub(&server->sessions, 1);
+    }
+  }
+}
+
+static void take_incoming(ServerLoop_t* loop) {
+  uint64_t value;
+  ssize_t got = read(loop->wake_fd, &value, sizeof(value));
+  (void)got;
+
+  pthread_mutex_lock(&loop->lock);
+  for (size_t i = 0; i < loop->incoming_count; i++) {
+    ServerHandoff_t* handoff = &loop->incoming[i];
+    adopt(loop, handoff->fd, handoff->id, handoff->watch);
+  }
+  loop->incoming_count = 0;
+  pthread_mutex_unlock(&loop->lock);
+}
+
+static void* loop_thread(void* arg) {
+  ServerLoop_t* loop = (ServerLoop_t*)arg;
+  Server_t* server = loop->server;
+  struct epoll_event events[SERVER_EVENTS_MAX];
+
+  while (!atomic_load(&server->stop)) {
+    int count = epoll_wait(loop->epoll_fd, events, SERVER_EVENTS_MAX, -1);
+    for (int i = 0; i < count; i++) {
+      uint64_t tag = events[i].data.u64;
+      if (tag == EVENT_TIMER) {
+        uint64_t expirations = 0;
+        if (read(loop->timer_fd, &expirations, sizeof(expirations)) !=
+            (ssize_t)sizeof(expirations)) {
+          continue;
+        }
+        // Пропущенные тики догоняем, а не теряем
+        for (uint64_t t = 0; t < expirations; t++) run_tick(loop);
+        if (expirations > 1) {
+          atomic_fetch_add_explicit(&loop->late_ticks, expirations - 1,
+                                    memory_order_relaxed);
+        }
+      } else if (tag == EVENT_WAKE) {
+        take_incoming(loop);
+      } else if (tag >= EVENT_LISTEN && tag < EVENT_LISTEN + 2) {
+        accept_clients(server, server->listen_fds[tag - EVENT_LISTEN]);
+      } else {
+        ServerSession_t* session = (ServerSession_t*)(uintptr_t)tag;
+        if (session->fd < 0) continue;  // Закрыта раньше в этой же пачке
+        bool alive = !(events[i].events & (EPOLLERR | EPOLLHUP));
+        if (alive && (events[i].events & EPOLLOUT)) {
+          alive = flush_output(loop, session);
+        }
+        if (alive && (events[i].events & (EPOLLIN | EPOLLRDHUP))) {
+          alive = read_requests(loop, session);
+        }
+        if (!alive) {
+          session_close(loop, session);
+        } else if (session->watch_id && !session->watching &&
+                   session->output_len == 0) {
+          migrate(loop, session);
+        }
+      }
+    }
+    recycle_closed(loop);
+  }
+  return NULL;
+}
+
+static int listen_unix(const char* path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) return -1;
+  strcpy(address.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  unlink(path);
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int listen_tcp(int port) {
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons((uint16_t)port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static bool loop_open(Server_t* server, ServerLoop_t* loop, int index) {
+  memset(loop, 0, sizeof(*loop));
+  loop->server = server;
+  loop->index = index;
+  loop->timer_fd = -1;
+  loop->wake_fd = -1;
+  pthread_mutex_init(&loop->lock, NULL);
+  timer_wheel_init(&loop->wheel, 0);
+
+  loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (loop->epoll_fd < 0 || loop->timer_fd < 0 || loop->wake_fd < 0) {
+    return false;
+  }
+
+  long period_ns = 1000000000L / (long)server->config.tick_hz;
+  struct itimerspec spec = {.it_interval = {0, period_ns},
+                            .it_value = {0, period_ns}};
+  if (period_ns >= 1000000000L) {
+    spec.it_interval = (struct timespec){1, 0};
+    spec.it_value = spec.it_interval;
+  }
+  return timerfd_settime(loop->timer_fd, 0, &spec, NULL) == 0 &&
+         watch(loop, loop->timer_fd, EPOLLIN, EVENT_TIMER, EPOLL_CTL_ADD) &&
+         watch(loop, loop->wake_fd, EPOLLIN, EVENT_WAKE, EPOLL_CTL_ADD);
+}
+
+static void loop_close(ServerLoop_t* loop) {
+  while (loop->active) session_close(loop, loop->active);
+  for (size_t i = 0; i < loop->incoming_count; i++) {
+    close(loop->incoming[i].fd);
+  }
+  free(loop->incoming);
+  while (loop->frame_blocks) {
+    ServerFrameBlock_t* next = loop->frame_blocks->next;
+    free(loop->frame_blocks);
+    loop->frame_blocks = next;
+  }
+
+  while (loop->slabs) {
+    ServerSlab_t* next = loop->slabs->next;
+    free(loop->slabs);
+    loop->slabs = next;
+  }
+  if (loop->epoll_fd >= 0) close(loop->epoll_fd);
+  if (loop->timer_fd >= 0) close(loop->timer_fd);
+  if (loop->wake_fd >= 0) close(loop->wake_fd);
+  pthread_mutex_destroy(&loop->lock);
+}
+
+static int configured_loops(const ServerConfig_t* config) {
+  return config->loops < 1 ? 1
+         : config->loops > SERVER_MAX_LOOPS ? SERVER_MAX_LOOPS
+                                            : config->loops;
+}
+
+static void setup(Server_t* server, const ServerConfig_t* config) {
+  memset(server, 0, sizeof(*server));
+  server->config = *config;
+  if (server->config.tick_hz == 0) {
+    server->config.tick_hz = SERVER_DEFAULT_TICK_HZ;
+  }
+}
+
+/**
+ * Opens count loops and lets loop 0 watch the listening sockets. On
+ * failure loop_count covers only the loops that have to be closed.
+ */
+static bool open_loops(Server_t* server, int count) {
+  bool ok = true;
+  int opened = 0;
+  for (; ok && opened < count; opened++) {
+    ok = loop_open(server, &server->loops[opened], opened);
+  }
+  server->loop_count = opened;
+  for (int i = 0; ok && i < server->listen_count; i++) {
+    ok = watch(&server->loops[0], server->listen_fds[i], EPOLLIN,
+               EVENT_LISTEN + (uint64_t)i, EPOLL_CTL_ADD);
+  }
+  return ok;
+}
+
+static bool start_loops(Server_t* server) {
+  atomic_store(&server->stop, false);
+  bool ok = true;
+  for (int i = 0; ok && i < server->loop_count; i++) {
+    ServerLoop_t* loop = &server->loops[i];
+    loop->running =
+        pthread_create(&loop->thread, NULL, loop_thread, loop) == 0;
+    ok = loop->running;
+  }
+  return ok;
+}
+
+/**
+ * Stops the loop threads, the sessions stay as they are.
+ */
+static void join_loops(Server_t* server) {
+  atomic_store(&server->stop, true);
+  for (int i = 0; i < server->loop_count; i++) {
+    ServerLoop_t* loop = &server->loops[i];
+    if (loop->running) {
+      uint64_t one = 1;
+      ssize_t written = write(loop->wake_fd, &one, sizeof(one));
+      (void)written;
+      pthread_join(loop->thread, NULL);
+      loop->running = false;
+    }
+  }
+}
+
+bool server_start(Server_t* server, const ServerConfig_t* config) {
+  setup(server, config);
+  if (config->unix_path) {
+    server->listen_fds[server->listen_count++] = listen_unix(config->unix_path);
+  }
+  if (config->tcp_port) {
+    server->listen_fds[server->listen_count++] = listen_tcp(config->tcp_port);
+  }
+
+  bool ok = server->listen_count > 0;
+  for (int i = 0; i < server->listen_count; i++) {
+    ok = ok && server->listen_fds[i] >= 0;
+  }
+  ok = ok && open_loops(server, configured_loops(config)) &&
+       start_loops(server);
+  if (!ok) server_stop(server);
+  return ok;
+}
+
+void server_stop(Server_t* server) {
+  join_loops(server);
+  for (int i = 0; i < server->loop_count; i++) loop_close(&server->loops[i]);
+  server->loop_count = 0;
+
+  for (int i = 0; i < server->listen_count; i++) {
+    if (server->listen_fds[i] >= 0) close(server->listen_fds[i]);
+  }
+  server->listen_count = 0;
+  if (server->config.unix_path) unlink(server->config.unix_path);
+}
+
+bool server_handoff(Server_t* server, int listen_fd) {
+  join_loops(server);
+
+  ServerHandoffClient_t client;
+  uint32_t count = 0;
+  for (int i = 0; i < server->loop_count; i++) {
+    ServerLoop_t* loop = &server->loops[i];
+    // Соединения, которые цикл ещё не забрал из очереди
+    take_incoming(loop);
+    for (ServerSession_t* session = loop->active; session;
+         session = session->next) {
+      // Ушедшего клиента новый процесс заметит сам
+      flush_output(loop, session);
+      count += handoff_client(session, &client);
+    }
+  }
+
+  int fd_count = server->listen_count + (int)count;
+  int* fds = (int*)malloc((size_t)fd_count * sizeof(int));
+  Handoff_t handoff;
+  bool ok = fds && handoff_create(&handoff, count);
+  if (ok) {
+    memcpy(fds, server->listen_fds,
+           (size_t)server->listen_count * sizeof(int));
+    uint32_t index = 0;
+    for (int i = 0; i < server->loop_count; i++) {
+      for (ServerSession_t* session = server->loops[i].active; session;
+           session = session->next) {
+        if (!handoff_client(session, &client)) continue;
+        handoff_put_session(&handoff, index, session->id, &session->game);
+        memcpy(handoff.sessions[index].client, &client, sizeof(client));
+        fds[server->listen_count + (int)index++] = session->fd;
+      }
+    }
+    ok = handoff_send(&handoff, listen_fd, fds, fd_count);
+    handoff_close(&handoff);
+  }
+  free(fds);
+
+  if (ok) {
+    // Сокеты и путь Unix-сокета теперь у нового процесса, закрываем только
+    // свои копии дескрипторов
+    server->config.unix_path = NULL;
+    server_stop(server);
+  } else {
+    start_loops(server);
+  }
+  return ok;
+}
+
+bool server_resume(Server_t* server, const ServerConfig_t* config,
+                   const char* path) {
+  setup(server, config);
+  Handoff_t handoff;
+  if (!handoff_receive(&handoff, path)) return false;
+
+  uint32_t count = handoff.header->session_count;
+  int listen_count = handoff.fd_count - (int)count;
+  bool ok = count <= (uint32_t)handoff.fd_count && listen_count >= 1 &&
+            listen_count <= 2;
+  if (ok) {
+    memcpy(server->listen_fds, handoff.fds,
+           (size_t)listen_count * sizeof(int));
+    server->listen_count = listen_count;
+    ok = open_loops(server, configured_loops(config));
+  }
+
+  if (ok) {
+    // Игроки раньше зрителей, чтобы зрителю было на кого подписаться
+    for (int pass = 0; pass < 2; pass++) {
+      for (uint32_t i = 0; i < count; i++) {
+        ServerHandoffClient_t client;
+        memcpy(&client, handoff.sessions[i].client, sizeof(client));
+        if ((client.watch_id != 0) != (pass == 1)) continue;
+        resume(server, &handoff, i, handoff.fds[listen_count + (int)i],
+               &client);
+      }
+    }
+  } else {
+    for (int i = server->listen_count; i < handoff.fd_count; i++) {
+      close(handoff.fds[i]);
+    }
+  }
+  handoff_close(&handoff);
+
+  ok = ok && start_loops(server);
+  if (!ok) server_stop(server);
+  return ok;
+}
+
+void server_stats(Server_t* server, ServerStats_t* stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->sessions = atomic_load(&server->sessions);
+  for (int i = 0; i < server->loop_count; i++) {
+    ServerLoop_t* loop = &server->loops[i];
+    stats->ticks += atomic_load(&loop->ticks);
+    stats->late_ticks += atomic_load(&loop->late_ticks);
+    stats->steps += atomic_load(&loop->steps);
+    stats->requests += atomic_load(&loop->requests);
+    stats->frames += atomic_load(&loop->frames);
+    stats->keyframes += atomic_load(&loop->keyframes);
+  }
+}
+
+bool server_frame_apply(const uint8_t* data, size_t size,
+                        TetrisFrame_t* frame) {
+  ServerFrameHeader_t header;
+  if (size < sizeof(header)) return false;
+  memcpy(&header, data, sizeof(header));
+  if (header.size != size ||
+      header.size != sizeof(header) + header.changed * sizeof(uint16_t) ||
+      (header.row_mask & ~KEYFRAME_ROWS) ||
+      __builtin_popcount(header.row_mask) != header.changed ||
+      (header.type == SERVER_FRAME_KEY && header.row_mask != KEYFRAME_ROWS) ||
+      (header.type != SERVER_FRAME_KEY && header.type != SERVER_FRAME_DELTA)) {
+    return false;
+  }
+
+  const uint8_t* rows = data + sizeof(header);
+  for (int r = 0; r < GAME_FIELD_HEIGHT; r++) {
+    if (header.row_mask & (1u << r)) {
+      memcpy(&frame->rows[r], rows, sizeof(uint16_t));
+      rows += sizeof(uint16_t);
+    }
+  }
+  frame->piece = header.piece;
+  frame->rotation = header.rotation;
+  frame->x = header.x;
+  frame->y = header.y;
+  frame->next = header.next;
+  frame->level = header.level;
+  frame->pause = header.pause;
+  frame->score = header.score;
+  return true;
+}
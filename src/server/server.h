@@ -0,0 +1,280 @@
+/**
+ * @file server.h
+ * @brief Game server hosting many headless sessions in one process
+ *
+ * A fixed number of event-loop threads each own a shard of the sessions:
+ * a session with id N lives on loop N % loop_count and is only touched by
+ * that thread. Loop 0 also accepts connections and passes them to their
+ * loop. Every loop waits in epoll_wait() for client sockets, its tick
+ * timerfd and a wake-up eventfd. Session contexts come from per-loop slabs
+ * and are reused through a free list, so a running server does not
+ * allocate per connection.
+ *
+ * Gravity steps and key auto-repeat are timers in a per-loop TimerWheel_t,
+ * so a tick only touches the sessions that are due and a paused or idle
+ * session costs nothing.
+ *
+ * Spectators are moved to the loop of the session they watch. Every change
+ * of the board is encoded once, as a delta from the previous frame, into a
+ * reference-counted ServerFrame_t, and the same buffer is queued for all
+ * spectators and sent with sendmsg() from their queues. A spectator whose
+ * queue is full loses its unsent deltas and gets a keyframe instead.
+ *
+ * server_handoff() passes every session, its socket and the listening
+ * sockets to a new process that calls server_resume(), so the server can
+ * be replaced without dropping its clients.
+ */
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../brick_game/tetris/frame.h"
+#include "../brick_game/tetris/session.h"
+#include "./protocol.h"
+#include "./timer_wheel.h"
+
+#define SERVER_MAX_LOOPS 64
+#define SERVER_SLAB_SESSIONS 256
+#define SERVER_OUTPUT_MAX 4096
+#define SERVER_DEFAULT_TICK_HZ 60
+#define SERVER_DAS_MS 167  // Задержка перед автоповтором
+#define SERVER_ARR_MS 33   // Период автоповтора
+#define SERVER_SPECTATOR_QUEUE 16
+#define SERVER_FRAME_BLOCK 64
+#define SERVER_FRAME_MAX \
+  (sizeof(ServerFrameHeader_t) + GAME_FIELD_HEIGHT * sizeof(uint16_t))
+
+/**
+ * @brief Server settings
+ */
+typedef struct {
+  const char* unix_path;  // Unix-сокет или NULL
+  int tcp_port;           // Порт на 127.0.0.1 или 0
+  int loops;              // Число потоков цикла событий
+  uint32_t tick_hz;       // Тиков в секунду
+  uint32_t max_sessions;  // 0 - без ограничения
+} ServerConfig_t;
+
+/**
+ * @brief Encoded frame shared by the spectators of one session
+ *
+ * Only the loop that owns the session touches it, so the reference count
+ * is a plain integer.
+ */
+typedef struct ServerFrame {
+  struct ServerFrame* next;  // Список свободных буферов
+  uint32_t refs;
+  uint32_t size;
+  uint8_t data[SERVER_FRAME_MAX];
+} ServerFrame_t;
+
+/**
+ * @brief Block of frame buffers
+ */
+typedef struct ServerFrameBlock {
+  struct ServerFrameBlock* next;
+  ServerFrame_t frames[SERVER_FRAME_BLOCK];
+} ServerFrameBlock_t;
+
+typedef struct ServerSession ServerSession_t;
+
+/**
+ * @brief One client and its game
+ */
+struct ServerSession {
+  TetrisSession_t game;
+  uint64_t id;
+  int fd;
+  bool started;
+  bool want_write;      // Ждём EPOLLOUT
+  uint8_t held_action;  // Действие с автоповтором
+  TimerNode_t gravity;
+  TimerNode_t repeat;
+  uint8_t input[sizeof(ServerRequest_t)];
+  size_t input_len;
+  uint8_t output[SERVER_OUTPUT_MAX];
+  size_t output_len;
+  ServerSession_t* prev;
+  ServerSession_t* next;  // Список активных или свободных сессий
+
+  uint64_t watch_id;            // Сессия, которую смотрит зритель, или 0
+  ServerSession_t* watching;    // Она же после подписки
+  ServerSession_t* spectators;  // Зрители этой сессии
+  ServerSession_t* spectator_prev;
+  ServerSession_t* spectator_next;
+  TetrisFrame_t last_frame;  // Последний разосланный кадр
+  uint32_t frame_sequence;
+  bool need_keyframe;
+  ServerFrame_t* queue[SERVER_SPECTATOR_QUEUE];
+  uint32_t queue_head;
+  uint32_t queue_count;
+  uint32_t queue_offset;  // Уже отправленные байты первого кадра
+};
+
+/**
+ * @brief Block of session contexts
+ */
+typedef struct ServerSlab {
+  struct ServerSlab* next;
+  ServerSession_t sessions[SERVER_SLAB_SESSIONS];
+} ServerSlab_t;
+
+typedef struct Server Server_t;
+
+/**
+ * @brief Connection accepted by loop 0 for another loop
+ */
+typedef struct {
+  int fd;
+  uint64_t id;
+  uint64_t watch;  // Сессия для зрителя или 0
+} ServerHandoff_t;
+
+/**
+ * @brief One event-loop thread and its shard
+ */
+typedef struct {
+  Server_t* server;
+  int index;
+  pthread_t thread;
+  bool running;
+  int epoll_fd;
+  int timer_fd;
+  int wake_fd;
+
+  pthread_mutex_t lock;  // Защищает только очередь incoming
+  ServerHandoff_t* incoming;
+  size_t incoming_count;
+  size_t incoming_capacity;
+
+  ServerSlab_t* slabs;
+  ServerSession_t* free_list;
+  ServerSession_t* closed;  // Закрыты в текущей пачке событий epoll
+  ServerSession_t* active;
+  TimerWheel_t wheel;
+  uint64_t tick;
+  ServerFrameBlock_t* frame_blocks;
+  ServerFrame_t* frame_pool;
+
+  _Atomic uint32_t sessions;
+  _Atomic uint64_t ticks;
+  _Atomic uint64_t late_ticks;  // Тики, выполненные с опозданием
+  _Atomic uint64_t steps;
+  _Atomic uint64_t requests;
+  _Atomic uint64_t frames;  // Закодированные кадры для зрителей
+  _Atomic uint64_t keyframes;
+} ServerLoop_t;
+
+/**
+ * @brief Running server
+ */
+struct Server {
+  ServerConfig_t config;
+  ServerLoop_t loops[SERVER_MAX_LOOPS];
+  int loop_count;
+  int listen_fds[2];
+  int listen_count;
+  uint64_t next_id;
+  _Atomic uint32_t sessions;
+  atomic_bool stop;
+};
+
+/**
+ * @brief Counters summed over all loops
+ */
+typedef struct {
+  uint32_t sessions;
+  uint64_t ticks;
+  uint64_t late_ticks;
+  uint64_t steps;
+  uint64_t requests;
+  uint64_t frames;
+  uint64_t keyframes;
+} ServerStats_t;
+
+/**
+ * @brief Opens the listening sockets and starts the event loops
+ *
+ * @param[out] server Server to start
+ * @param[in] config Settings, at least one socket must be given
+ * @return false if a socket or a thread could not be created
+ */
+bool server_start(Server_t* server, const ServerConfig_t* config);
+/**
+ * @brief Disconnects every client and stops the loops
+ *
+ * @param[in,out] server Running server
+ */
+void server_stop(Server_t* server);
+/**
+ * @brief Hands every session and socket over to a new process
+ *
+ * Stops the loops, stores the sessions with handoff_put_session() and
+ * sends the listening and client sockets to the process that connects to
+ * listen_fd. A client whose unsent data does not fit the segment is not
+ * handed over and gets disconnected. If the new process refuses, the
+ * loops are started again and keep serving.
+ *
+ * @param[in,out] server Running server
+ * @param[in] listen_fd Socket from handoff_listen()
+ * @return true if the new process took over, the server is stopped then
+ * and the Unix socket is left in place
+ */
+bool server_handoff(Server_t* server, int listen_fd);
+/**
+ * @brief Starts the server with the sessions and sockets of an old process
+ *
+ * The listening sockets come from the old process, so config only gives
+ * the loops, the tick rate and the Unix socket to remove on stop.
+ *
+ * @param[out] server Server to start
+ * @param[in] config Settings
+ * @param[in] path Socket path the old process waits on
+ * @return false if nothing was handed over or the loops could not start
+ */
+bool server_resume(Server_t* server, const ServerConfig_t* config,
+                   const char* path);
+/**
+ * @brief Reads the counters of a running server
+ *
+ * @param[in] server Server
+ * @param[out] stats Current counters
+ */
+void server_stats(Server_t* server, ServerStats_t* stats);
+/**
+ * @brief Converts milliseconds to loop ticks, at least one
+ *
+ * @param[in] ms Duration
+ * @param[in] tick_hz Loop tick rate
+ * @return uint32_t Ticks
+ */
+uint32_t server_ms_to_ticks(uint32_t ms, uint32_t tick_hz);
+/**
+ * @brief Number of loop ticks between two gravity steps
+ *
+ * game_tick_interval() rounded to whole loop ticks, the same interval as
+ * GameTimer() uses for the interactive game. Each step moves the piece by
+ * the gravity of the level, as in the interactive game.
+ *
+ * @param[in] level Game level
+ * @param[in] tick_hz Loop tick rate
+ * @return uint32_t At least 1
+ */
+uint32_t server_gravity_ticks(int level, uint32_t tick_hz);
+/**
+ * @brief Applies a received spectator frame to the board of the client
+ *
+ * @param[in] data Whole frame, ServerFrameHeader_t.size bytes
+ * @param[in] size Number of bytes in data
+ * @param[in,out] frame Board after the previous frame
+ * @return false if the frame is malformed
+ */
+bool server_frame_apply(const uint8_t* data, size_t size,
+                        TetrisFrame_t* frame);
+
+#endif
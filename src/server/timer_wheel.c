@@ -0,0 +1,132 @@
+#include "./timer_wheel.h"
+
+static void list_init(TimerNode_t* head) {
+  head->prev = head;
+  head->next = head;
+}
+
+static void list_add(TimerNode_t* head, TimerNode_t* timer) {
+  timer->prev = head->prev;
+  timer->next = head;
+  head->prev->next = timer;
+  head->prev = timer;
+}
+
+static void list_remove(TimerNode_t* timer) {
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->prev = NULL;
+  timer->next = NULL;
+}
+
+void timer_wheel_init(TimerWheel_t* wheel, uint64_t now) {
+  for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+    for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+      list_init(&wheel->slots[level][slot]);
+    }
+  }
+  wheel->now = now;
+  wheel->pending = 0;
+}
+
+void timer_init(TimerNode_t* timer, TimerCallback callback) {
+  timer->prev = NULL;
+  timer->next = NULL;
+  timer->expires = 0;
+  timer->callback = callback;
+}
+
+bool timer_pending(const TimerNode_t* timer) { return timer->next != NULL; }
+
+/**
+ * Lowest level whose slot range holds both now and expires: above its own
+ * bits the two ticks are equal.
+ */
+static void place(TimerWheel_t* wheel, TimerNode_t* timer) {
+  int level = 0;
+  while (level < TIMER_WHEEL_LEVELS - 1 &&
+         (timer->expires >> (TIMER_WHEEL_BITS * (level + 1))) !=
+             (wheel->now >> (TIMER_WHEEL_BITS * (level + 1)))) {
+    level++;
+  }
+  int slot = (int)(timer->expires >> (TIMER_WHEEL_BITS * level)) &
+             (TIMER_WHEEL_SLOTS - 1);
+  list_add(&wheel->slots[level][slot], timer);
+}
+
+void timer_schedule(TimerWheel_t* wheel, TimerNode_t* timer,
+                    uint64_t expires) {
+  if (timer_pending(timer)) {
+    list_remove(timer);
+    wheel->pending--;
+  }
+  if (expires <= wheel->now) expires = wheel->now + 1;
+  if (expires - wheel->now > TIMER_WHEEL_HORIZON) {
+    expires = wheel->now + TIMER_WHEEL_HORIZON;
+  }
+
+  timer->expires = expires;
+  place(wheel, timer);
+  wheel->pending++;
+}
+
+void timer_cancel(TimerWheel_t* wheel, TimerNode_t* timer) {
+  if (timer_pending(timer)) {
+    list_remove(timer);
+    wheel->pending--;
+  }
+}
+
+static void cascade(TimerWheel_t* wheel, int level) {
+  int slot = (int)(wheel->now >> (TIMER_WHEEL_BITS * level)) &
+             (TIMER_WHEEL_SLOTS - 1);
+  TimerNode_t* head = &wheel->slots[level][slot];
+
+  while (head->next != head) {
+    TimerNode_t* timer = head->next;
+    list_remove(timer);
+    place(wheel, timer);
+  }
+}
+
+size_t timer_wheel_advance(TimerWheel_t* wheel, uint64_t now, void* context) {
+  size_t fired = 0;
+
+  while (wheel->now < now) {
+    // Пустое колесо можно перевести сразу, разносить нечего
+    if (wheel->pending == 0) {
+      wheel->now = now;
+      break;
+    }
+    wheel->now++;
+
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+      uint64_t low_mask = (1ULL << (TIMER_WHEEL_BITS * level)) - 1;
+      if ((wheel->now & low_mask) != 0) break;
+      cascade(wheel, level);
+    }
+
+    TimerNode_t* head =
+        &wheel->slots[0][wheel->now & (TIMER_WHEEL_SLOTS - 1)];
+    // Колбэк может снова поставить таймер в этот же слот, поэтому
+    // сначала забираем весь список
+    TimerNode_t due;
+    list_init(&due);
+    if (head->next != head) {
+      due.next = head->next;
+      due.prev = head->prev;
+      due.next->prev = &due;
+      due.prev->next = &due;
+      list_init(head);
+    }
+
+    while (due.next != &due) {
+      TimerNode_t* timer = due.next;
+      list_remove(timer);
+      wheel->pending--;
+      fired++;
+      timer->callback(timer, context);
+    }
+  }
+  return fired;
+}
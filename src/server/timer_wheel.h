@@ -0,0 +1,108 @@
+/**
+ * @file timer_wheel.h
+ * @brief Hierarchical timing wheel for per-session timers
+ *
+ * Time is counted in loop ticks. Level L has TIMER_WHEEL_SLOTS slots of
+ * 64^L ticks each; a timer sits in the lowest level whose slot range
+ * contains both the current tick and its expiry. When the lower level
+ * wraps around, the next slot of the level above is spread over the levels
+ * below. Scheduling and cancelling are O(1), advancing touches only the
+ * timers that are due or cascade, and a session without pending timers
+ * costs nothing.
+ *
+ * Timers are intrusive: a TimerNode_t is embedded in the structure it
+ * belongs to and needs no allocation.
+ */
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+// Дальше этого срабатывание переносится на границу горизонта
+#define TIMER_WHEEL_HORIZON \
+  ((1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+typedef struct TimerNode TimerNode_t;
+
+/**
+ * @brief Called when a timer expires, the timer is no longer pending
+ *
+ * @param[in] timer Expired timer, may be scheduled again
+ * @param[in] context Pointer given to timer_wheel_advance()
+ */
+typedef void (*TimerCallback)(TimerNode_t* timer, void* context);
+
+/**
+ * @brief Timer embedded in its owner
+ */
+struct TimerNode {
+  TimerNode_t* prev;
+  TimerNode_t* next;
+  uint64_t expires;
+  TimerCallback callback;
+};
+
+/**
+ * @brief Wheel with the current tick
+ */
+typedef struct {
+  TimerNode_t slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];  // Заголовки
+  uint64_t now;
+  size_t pending;
+} TimerWheel_t;
+
+/**
+ * @brief Starts an empty wheel
+ *
+ * @param[out] wheel Wheel to initialize
+ * @param[in] now Current tick
+ */
+void timer_wheel_init(TimerWheel_t* wheel, uint64_t now);
+/**
+ * @brief Prepares a timer that is not scheduled yet
+ *
+ * @param[out] timer Timer to initialize
+ * @param[in] callback Function called on expiry
+ */
+void timer_init(TimerNode_t* timer, TimerCallback callback);
+/**
+ * @brief Schedules a timer, moving it if it is already pending
+ *
+ * A tick that has already passed fires on the next advance.
+ *
+ * @param[in,out] wheel Wheel
+ * @param[in,out] timer Timer
+ * @param[in] expires Tick of expiry
+ */
+void timer_schedule(TimerWheel_t* wheel, TimerNode_t* timer,
+                    uint64_t expires);
+/**
+ * @brief Removes a pending timer, does nothing for an idle one
+ *
+ * @param[in,out] wheel Wheel
+ * @param[in,out] timer Timer
+ */
+void timer_cancel(TimerWheel_t* wheel, TimerNode_t* timer);
+/**
+ * @brief Tells whether a timer is scheduled
+ *
+ * @param[in] timer Timer
+ * @return true if the timer waits in a wheel
+ */
+bool timer_pending(const TimerNode_t* timer);
+/**
+ * @brief Moves the wheel to a new tick and fires every timer due by then
+ *
+ * @param[in,out] wheel Wheel
+ * @param[in] now New current tick, not less than the previous one
+ * @param[in] context Passed to the callbacks
+ * @return size_t Number of fired timers
+ */
+size_t timer_wheel_advance(TimerWheel_t* wheel, uint64_t now, void* context);
+
+#endif
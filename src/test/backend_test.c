@@ -256,9 +256,9 @@ START_TEST(test_level_up_boundary) {
 END_TEST
 
 START_TEST(test_level_up_max_level) {
-  ck_assert_int_eq(lvl_up(10000), 10);
-  ck_assert_int_eq(lvl_up(20000), 10);
-  ck_assert_int_eq(lvl_up(30000), 10);
+  ck_assert_int_eq(lvl_up(10000), 16);
+  ck_assert_int_eq(lvl_up(20000), GAME_LEVEL_MAX);
+  ck_assert_int_eq(lvl_up(30000), GAME_LEVEL_MAX);
 }
 END_TEST
 
@@ -1068,6 +1068,2089 @@ END_TEST
 // }
 // END_TEST
 
+START_TEST(test_frame_capture_expand_roundtrip) {
+  GameInfo_t* state = create_test_state();
+  GameBlock_t* block = create_test_block(T, 1);
+  block->x = 5;
+  block->y = 5;
+
+  state->field[GAME_FIELD_HEIGHT - 1][0] = 1;
+  state->field[GAME_FIELD_HEIGHT - 1][9] = 1;
+  place_next_figure(state, S);
+  draw_temporary_figure(state, block);
+
+  TetrisFrame_t frame;
+  frame_capture(state, block, &frame);
+  ck_assert_int_eq(frame.rows[GAME_FIELD_HEIGHT - 1], (1 << 0) | (1 << 9));
+  ck_assert_int_eq(frame.rows[5], 0);
+  ck_assert_int_eq(frame.piece, T);
+  ck_assert_int_eq(frame.next, S);
+
+  GameInfo_t* copy = create_test_state();
+  frame_expand(&frame, copy);
+  for (int i = 0; i < GAME_FIELD_HEIGHT; i++) {
+    for (int j = 0; j < GAME_FIELD_WIDTH; j++) {
+      ck_assert_int_eq(copy->field[i][j], state->field[i][j]);
+    }
+  }
+  ck_assert_int_eq(next_figure_type(copy->next), S);
+
+  free_test_objects(copy, NULL);
+  free_test_objects(state, block);
+}
+END_TEST
+
+START_TEST(test_frame_history_view_order) {
+  FrameHistory_t history;
+  frame_history_init(&history, 3);
+
+  TetrisFrame_t frame = {0};
+  for (int i = 0; i < 5; i++) {
+    frame.score = i;
+    frame_history_push(&history, &frame);
+
+    FrameStackView_t view = frame_history_view(&history);
+    int expected = i < 3 ? i + 1 : 3;
+    ck_assert_int_eq(view.depth, expected);
+    for (int k = 0; k < view.depth; k++) {
+      const TetrisFrame_t* f =
+          (const TetrisFrame_t*)((const char*)view.frames + k * view.stride);
+      ck_assert_int_eq(f->score, i - view.depth + 1 + k);
+    }
+  }
+}
+END_TEST
+
+START_TEST(test_frame_history_clamps_depth) {
+  FrameHistory_t history;
+  frame_history_init(&history, 0);
+  ck_assert_int_eq(history.depth, 1);
+  frame_history_init(&history, FRAME_HISTORY_MAX + 10);
+  ck_assert_int_eq(history.depth, FRAME_HISTORY_MAX);
+  ck_assert_int_eq(frame_history_view(&history).depth, 0);
+}
+END_TEST
+
+START_TEST(test_piece_rng_reproducible) {
+  PieceRng_t a, b, c;
+  piece_rng_seed(&a, 42, RNG_UNIFORM);
+  piece_rng_seed(&b, 42, RNG_UNIFORM);
+  piece_rng_seed(&c, 43, RNG_UNIFORM);
+
+  bool differs = false;
+  for (int i = 0; i < 100; i++) {
+    int pa = piece_rng_next(&a);
+    ck_assert_int_eq(pa, piece_rng_next(&b));
+    ck_assert(pa >= I && pa <= Z);
+    if (pa != piece_rng_next(&c)) differs = true;
+  }
+  ck_assert(differs);
+}
+END_TEST
+
+START_TEST(test_piece_rng_batch_matches_single) {
+  enum { SESSIONS = 100 };
+  PieceRng_t batch[SESSIONS], single[SESSIONS];
+  for (int i = 0; i < SESSIONS; i++) {
+    PieceRngMode mode = i % 2 ? RNG_BAG : RNG_UNIFORM;
+    piece_rng_seed(&batch[i], (uint64_t)i, mode);
+    piece_rng_seed(&single[i], (uint64_t)i, mode);
+  }
+
+  int pieces[SESSIONS];
+  for (int step = 0; step < 20; step++) {
+    piece_rng_next_batch(batch, pieces, SESSIONS);
+    for (int i = 0; i < SESSIONS; i++) {
+      ck_assert_int_eq(pieces[i], piece_rng_next(&single[i]));
+    }
+  }
+}
+END_TEST
+
+START_TEST(test_piece_rng_bag_has_every_piece) {
+  PieceRng_t rng;
+  piece_rng_seed(&rng, 7, RNG_BAG);
+
+  for (int bag = 0; bag < 10; bag++) {
+    int seen[TETROMINO_COUNT] = {0};
+    for (int i = 0; i < TETROMINO_COUNT; i++) {
+      seen[piece_rng_next(&rng)]++;
+    }
+    for (int p = 0; p < TETROMINO_COUNT; p++) {
+      ck_assert_int_eq(seen[p], 1);
+    }
+  }
+}
+END_TEST
+
+START_TEST(test_piece_rng_uniform_distribution) {
+  PieceRng_t rng;
+  piece_rng_seed(&rng, 1, RNG_UNIFORM);
+
+  int seen[TETROMINO_COUNT] = {0};
+  for (int i = 0; i < 7000; i++) {
+    seen[piece_rng_next(&rng)]++;
+  }
+  for (int p = 0; p < TETROMINO_COUNT; p++) {
+    ck_assert_int_gt(seen[p], 850);
+    ck_assert_int_lt(seen[p], 1150);
+  }
+}
+END_TEST
+
+START_TEST(test_replay_roundtrip) {
+  const char* path = "./test/replay_test.bgr";
+  ReplayRecorder_t recorder;
+  ck_assert(replay_recorder_open(&recorder, path, 0x1234567890ULL, RNG_BAG));
+
+  UserAction_t actions[] = {Start, Left, Left, Left, Down, Down, Action, Up};
+  uint32_t ticks[] = {0, 3, 3, 3, 10, 11, 11, 300};
+  for (int i = 0; i < 8; i++) {
+    replay_recorder_add(&recorder, ticks[i], actions[i]);
+  }
+  replay_recorder_add(&recorder, 301, (UserAction_t)-1);
+  ReplaySummary_t summary = {400, 1500, 12, 30, 0xDEADBEEFCAFEULL};
+  ck_assert(replay_recorder_close(&recorder, &summary));
+
+  Replay_t replay;
+  ck_assert(replay_load(path, &replay));
+  ck_assert_int_eq(replay.engine_version, TETRIS_ENGINE_VERSION);
+  ck_assert_int_eq(replay.ruleset, RNG_BAG);
+  ck_assert(replay.seed == 0x1234567890ULL);
+  ck_assert_int_eq(replay.count, 8);
+  for (int i = 0; i < 8; i++) {
+    ck_assert_int_eq(replay.events[i].tick, ticks[i]);
+    ck_assert_int_eq(replay.events[i].action, actions[i]);
+  }
+  ck_assert_int_eq(replay.summary.final_tick, 400);
+  ck_assert_int_eq(replay.summary.score, 1500);
+  ck_assert_int_eq(replay.summary.lines, 12);
+  ck_assert_int_eq(replay.summary.pieces, 30);
+  ck_assert(replay.summary.checksum == 0xDEADBEEFCAFEULL);
+
+  replay_free(&replay);
+  remove(path);
+}
+END_TEST
+
+START_TEST(test_replay_long_game_stays_small) {
+  const char* path = "./test/replay_long.bgr";
+  ReplayRecorder_t recorder;
+  ck_assert(replay_recorder_open(&recorder, path, 1, RNG_UNIFORM));
+
+  uint32_t tick = 0;
+  for (int i = 0; i < 100000; i++) {
+    tick += i % 3 == 0;
+    replay_recorder_add(&recorder, tick, (UserAction_t)(Left + i % 2));
+  }
+  ReplaySummary_t summary = {tick, 0, 0, 0, 0};
+  ck_assert(replay_recorder_close(&recorder, &summary));
+
+  FILE* file = fopen(path, "rb");
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fclose(file);
+  ck_assert_int_lt(size, 300000);
+
+  Replay_t replay;
+  ck_assert(replay_load(path, &replay));
+  ck_assert_int_eq(replay.count, 100000);
+  ck_assert_int_eq(replay.events[99999].tick, tick);
+  replay_free(&replay);
+  remove(path);
+}
+END_TEST
+
+START_TEST(test_replay_rejects_garbage) {
+  const uint8_t data[] = {'B', 'G', 'X', 'P', 1, 1, 0};
+  Replay_t replay;
+  ck_assert(!replay_decode(data, sizeof(data), &replay));
+  ck_assert(!replay_load("./test/no_such_replay.bgr", &replay));
+}
+END_TEST
+
+static void play_scripted_session(TetrisSession_t* session,
+                                  ReplayRecorder_t* recorder, int ticks) {
+  uint32_t lcg = 12345;
+  session_input(session, Start);
+  replay_recorder_add(recorder, session->engine.tick, Start);
+
+  for (int i = 0; i < ticks && session->info.pause != STOP; i++) {
+    lcg = lcg * 1103515245u + 12345u;
+    UserAction_t action = (UserAction_t)(Left + (lcg >> 16) % 5);
+    if ((lcg >> 8) % 3 == 0) {
+      session_input(session, action);
+      replay_recorder_add(recorder, session->engine.tick, action);
+    }
+    if (session->info.pause == PREVIEW) {
+      session_input(session, Start);
+      replay_recorder_add(recorder, session->engine.tick, Start);
+    }
+    session_step(session);
+  }
+}
+
+START_TEST(test_session_replay_reproduces_game) {
+  const char* path = "./test/session_replay.bgr";
+  TetrisSession_t played;
+  session_init(&played, 99, RNG_BAG);
+
+  ReplayRecorder_t recorder;
+  ck_assert(replay_recorder_open(&recorder, path, 99, RNG_BAG));
+  play_scripted_session(&played, &recorder, 5000);
+
+  ReplaySummary_t summary;
+  session_summary(&played, &summary);
+  ck_assert(replay_recorder_close(&recorder, &summary));
+  ck_assert_int_gt(summary.pieces, 0);
+
+  Replay_t replay;
+  ck_assert(replay_load(path, &replay));
+  TetrisSession_t replayed;
+  ck_assert(session_run_replay(&replay, &replayed));
+
+  ReplaySummary_t actual;
+  session_summary(&replayed, &actual);
+  ck_assert_int_eq(actual.final_tick, summary.final_tick);
+  ck_assert_int_eq(actual.score, summary.score);
+  ck_assert_int_eq(actual.lines, summary.lines);
+  ck_assert_int_eq(actual.pieces, summary.pieces);
+  ck_assert(actual.checksum == summary.checksum);
+  ck_assert_mem_eq(replayed.cells, played.cells, sizeof(played.cells));
+
+  replay_free(&replay);
+  remove(path);
+}
+END_TEST
+
+START_TEST(test_session_keeps_singleton_untouched) {
+  TetrisSession_t session;
+  session_init(&session, 1, RNG_UNIFORM);
+  session_input(&session, Start);
+  for (int i = 0; i < 50; i++) session_step(&session);
+
+  ck_assert_int_eq(session.engine.tick, 50);
+  ck_assert_int_eq(getEngineContext(false)->tick, 0);
+  ck_assert_int_eq(getEngineContext(false)->fsm, GAME_START);
+}
+END_TEST
+
+START_TEST(test_session_step_paused) {
+  TetrisSession_t session;
+  session_init(&session, 1, RNG_UNIFORM);
+  ck_assert(!session_step(&session));
+  session_input(&session, Start);
+  ck_assert(session_step(&session));
+  session_input(&session, Pause);
+  ck_assert(!session_step(&session));
+  ck_assert_int_eq(session.engine.tick, 1);
+}
+END_TEST
+
+static void record_keyframed_session(const char* path, TetrisSession_t* played,
+                                     int ticks) {
+  ReplayRecorder_t recorder;
+  session_init(played, 2024, RNG_UNIFORM);
+  ck_assert(replay_recorder_open(&recorder, path, 2024, RNG_UNIFORM));
+
+  uint32_t lcg = 777;
+  session_input(played, Start);
+  replay_recorder_add(&recorder, played->engine.tick, Start);
+  for (int i = 0; i < ticks; i++) {
+    lcg = lcg * 1103515245u + 12345u;
+    if ((lcg >> 8) % 2 == 0) {
+      UserAction_t action = (UserAction_t)(Left + (lcg >> 16) % 5);
+      session_input(played, action);
+      replay_recorder_add(&recorder, played->engine.tick, action);
+    }
+    if (played->info.pause == PREVIEW) {
+      session_input(played, Start);
+      replay_recorder_add(&recorder, played->engine.tick, Start);
+    }
+    session_step(played);
+    if (replay_recorder_keyframe_due(&recorder, played->engine.pieces)) {
+      GameSnapshot_t snapshot;
+      session_save(played, &snapshot);
+      replay_recorder_keyframe(&recorder, &snapshot);
+    }
+  }
+
+  ReplaySummary_t summary;
+  session_summary(played, &summary);
+  ck_assert(replay_recorder_close(&recorder, &summary));
+}
+
+START_TEST(test_replay_index_seek_matches_full_simulation) {
+  const char* path = "./test/replay_index.bgr";
+  TetrisSession_t played;
+  record_keyframed_session(path, &played, 20000);
+  ck_assert_int_gt(played.engine.pieces, 3 * REPLAY_KEYFRAME_INTERVAL);
+
+  ReplayIndex_t index;
+  ck_assert(replay_index_open(path, &index));
+  ck_assert_int_eq(index.count,
+                   played.engine.pieces / REPLAY_KEYFRAME_INTERVAL);
+  ck_assert_int_eq(index.keyframes[1].state.pieces,
+                   2 * REPLAY_KEYFRAME_INTERVAL);
+
+  uint32_t targets[] = {1, 49, 50, 51, 137, played.engine.pieces};
+  for (int t = 0; t < 6; t++) {
+    TetrisSession_t seeked, linear;
+    ck_assert(session_seek(&index, targets[t], &seeked));
+
+    ReplayIndex_t no_keyframes = index;
+    no_keyframes.count = 0;
+    ck_assert(session_seek(&no_keyframes, targets[t], &linear));
+
+    GameSnapshot_t a, b;
+    session_save(&seeked, &a);
+    session_save(&linear, &b);
+    ck_assert_int_eq(a.pieces, targets[t]);
+    ck_assert_mem_eq(&a, &b, sizeof(a));
+  }
+  ck_assert(!session_seek(&index, played.engine.pieces + 1, &played));
+
+  replay_index_close(&index);
+
+  Replay_t replay;
+  ck_assert(replay_load(path, &replay));
+  ck_assert(session_run_replay(&replay, &played));
+  ck_assert(played.engine.checksum == replay.summary.checksum);
+  replay_free(&replay);
+  remove(path);
+}
+END_TEST
+
+START_TEST(test_snapshot_restore_roundtrip) {
+  TetrisSession_t session, copy;
+  session_init(&session, 5, RNG_BAG);
+  session_input(&session, Start);
+  for (int i = 0; i < 300; i++) {
+    if (i % 7 == 0) session_input(&session, Action);
+    session_step(&session);
+  }
+
+  GameSnapshot_t snapshot, again;
+  session_save(&session, &snapshot);
+  session_init(&copy, 0, RNG_UNIFORM);
+  session_restore(&copy, &snapshot);
+  session_save(&copy, &again);
+  ck_assert_mem_eq(&snapshot, &again, sizeof(snapshot));
+  ck_assert_mem_eq(copy.cells, session.cells, sizeof(session.cells));
+
+  for (int i = 0; i < 300; i++) {
+    session_step(&session);
+    session_step(&copy);
+  }
+  ck_assert(copy.engine.checksum == session.engine.checksum);
+}
+END_TEST
+
+static void check_io_writer_backend(IoBackend backend) {
+  IoWriter_t writer;
+  if (!io_writer_start(&writer, backend)) {
+    // Ядро без io_uring: проверять нечего, AUTO уйдёт в поток
+    ck_assert_int_eq(backend, IO_BACKEND_URING);
+    return;
+  }
+
+  const char* paths[] = {"./test/io_a.bin", "./test/io_b.bin"};
+  IoStream_t streams[2];
+  for (int s = 0; s < 2; s++) {
+    ck_assert(io_stream_open(&writer, &streams[s], paths[s], 4096));
+  }
+
+  // Больше ёмкости кольца, чтобы писатель ждал освобождения места
+  uint8_t chunk[1000];
+  size_t total = 0;
+  for (int i = 0; i < 40; i++) {
+    for (int s = 0; s < 2; s++) {
+      for (size_t j = 0; j < sizeof(chunk); j++) {
+        chunk[j] = (uint8_t)((total + j) * (s + 3));
+      }
+      io_stream_write(&streams[s], chunk, sizeof(chunk));
+    }
+    total += sizeof(chunk);
+  }
+  for (int s = 0; s < 2; s++) ck_assert(io_stream_close(&streams[s]));
+
+  IoStats_t stats;
+  io_writer_stats(&writer, &stats);
+  ck_assert_uint_eq(stats.bytes, 2 * total);
+  ck_assert_uint_ge(stats.writes, 2 * total / 4096);
+  ck_assert_uint_eq(stats.failures, 0);
+  ck_assert_uint_eq(stats.pending_bytes, 0);
+  ck_assert_uint_eq(stats.queue_depth, 0);
+  ck_assert_uint_ge(stats.max_queue_depth, 1);
+  ck_assert_uint_ge(stats.latency_max_ns, stats.latency_avg_ns);
+  io_writer_stop(&writer);
+
+  for (int s = 0; s < 2; s++) {
+    FILE* file = fopen(paths[s], "rb");
+    ck_assert_ptr_nonnull(file);
+    size_t pos = 0;
+    int byte;
+    while ((byte = fgetc(file)) != EOF) {
+      ck_assert_int_eq(byte, (uint8_t)(pos * (s + 3)));
+      pos++;
+    }
+    fclose(file);
+    ck_assert_uint_eq(pos, total);
+    remove(paths[s]);
+  }
+}
+
+START_TEST(test_io_writer_thread_backend) {
+  check_io_writer_backend(IO_BACKEND_THREAD);
+}
+END_TEST
+
+START_TEST(test_io_writer_uring_backend) {
+  check_io_writer_backend(IO_BACKEND_URING);
+}
+END_TEST
+
+START_TEST(test_io_writer_rejects_bad_path) {
+  IoWriter_t writer;
+  IoStream_t stream;
+  ck_assert(io_writer_start(&writer, IO_BACKEND_AUTO));
+  ck_assert(!io_stream_open(&writer, &stream, "./no/such/dir/file", 4096));
+  ck_assert(!io_stream_close(&stream));
+  io_writer_stop(&writer);
+}
+END_TEST
+
+START_TEST(test_persist_record_in_data_dir) {
+  const char* dir = "./test/persist_data";
+  mkdir(dir, 0755);
+  persist_set_data_dir("./test/persist_data//");
+  ck_assert_str_eq(persist_data_dir(), dir);
+
+  save_record(700, 900);
+  for (int score = 100; score <= 1200; score += 100) {
+    save_record(score, score);
+  }
+  ck_assert(persist_flush());
+  ck_assert_int_eq(load_high_score(), 1200);
+  // Пустая таблица ничего не добавляет к рекорду из файла
+  int best = -1;
+  persist_wait();
+  ck_assert(persist_best_take(&best));
+  ck_assert_int_eq(best, 0);
+
+  // Временные файлы не остаются рядом с рекордом
+  DIR* listing = opendir(dir);
+  ck_assert_ptr_nonnull(listing);
+  int files = 0;
+  for (struct dirent* entry; (entry = readdir(listing)) != NULL;) {
+    if (strncmp(entry->d_name, PERSIST_RECORD_FILE,
+                strlen(PERSIST_RECORD_FILE)) == 0) {
+      ck_assert_str_eq(entry->d_name, PERSIST_RECORD_FILE);
+      files++;
+    }
+  }
+  closedir(listing);
+  ck_assert_int_eq(files, 1);
+
+  getRecordWriter(true);
+  getLeaderboard(true);
+  const char* names[] = {PERSIST_RECORD_FILE, LEADERBOARD_INDEX_FILE,
+                         LEADERBOARD_LOG_FILE};
+  char path[PERSIST_PATH_MAX];
+  for (int i = 0; i < 3; i++) {
+    ck_assert(persist_path(names[i], path, sizeof(path)));
+    remove(path);
+  }
+  ck_assert_int_eq(rmdir(dir), 0);
+  persist_set_data_dir(NULL);
+}
+END_TEST
+
+START_TEST(test_persist_write_atomic_replaces_file) {
+  const char* path = "./test/persist_atomic.txt";
+  ck_assert(persist_write_atomic(path, "first version", 13));
+  ck_assert(persist_write_atomic(path, "second", 6));
+
+  char text[32] = {0};
+  FILE* file = fopen(path, "r");
+  ck_assert_ptr_nonnull(file);
+  ck_assert_uint_eq(fread(text, 1, sizeof(text) - 1, file), 6);
+  fclose(file);
+  ck_assert_str_eq(text, "second");
+  remove(path);
+
+  ck_assert(!persist_write_atomic("./no/such/dir/file", "x", 1));
+  persist_set_data_dir("./no/such/dir");
+  save_record(10, 10);
+  ck_assert(!persist_flush());
+  ck_assert(persist_flush());
+  persist_set_data_dir(NULL);
+}
+END_TEST
+
+static void fill_leaderboard(Leaderboard_t* board, int count) {
+  uint32_t lcg = 42;
+  for (int i = 0; i < count; i++) {
+    lcg = lcg * 1103515245u + 12345u;
+    LeaderboardEntry_t entry = {0};
+    snprintf(entry.player, sizeof(entry.player), "p%d", i);
+    entry.score = (int32_t)((lcg >> 16) % 500) * 100;
+    entry.lines = (uint32_t)i;
+    entry.replay_id = (uint64_t)i;
+    leaderboard_insert(board, 1, &entry);
+  }
+}
+
+static void check_leaderboard_sorted(const Leaderboard_t* board,
+                                     unsigned mode) {
+  for (int rank = 2; rank <= leaderboard_count(board, mode); rank++) {
+    const LeaderboardEntry_t* above = leaderboard_entry(board, mode, rank - 1);
+    const LeaderboardEntry_t* below = leaderboard_entry(board, mode, rank);
+    ck_assert_int_ge(above->score, below->score);
+    // Одинаковые очки остаются в порядке добавления
+    if (above->score == below->score) {
+      ck_assert_uint_lt(above->replay_id, below->replay_id);
+    }
+  }
+}
+
+START_TEST(test_leaderboard_insert_and_rank) {
+  const char* dir = "./test/leaderboard";
+  mkdir(dir, 0755);
+  Leaderboard_t board;
+  ck_assert(leaderboard_open(&board, dir));
+  ck_assert_int_eq(leaderboard_count(&board, 1), 0);
+  ck_assert_int_eq(leaderboard_rank(&board, 1, 100), 1);
+
+  fill_leaderboard(&board, 300);
+  ck_assert_int_eq(leaderboard_count(&board, 1), LEADERBOARD_CAPACITY);
+  ck_assert_int_eq(leaderboard_count(&board, 0), 0);
+  check_leaderboard_sorted(&board, 1);
+
+  const LeaderboardEntry_t* last =
+      leaderboard_entry(&board, 1, LEADERBOARD_CAPACITY);
+  ck_assert_ptr_null(leaderboard_entry(&board, 1, LEADERBOARD_CAPACITY + 1));
+  ck_assert_int_eq(leaderboard_rank(&board, 1, last->score),
+                   LEADERBOARD_CAPACITY + 1);
+  LeaderboardEntry_t low = {.player = "low", .score = last->score};
+  ck_assert_int_eq(leaderboard_insert(&board, 1, &low), 0);
+
+  LeaderboardEntry_t best = {.score = 1000000};
+  memset(best.player, 'x', sizeof(best.player));
+  ck_assert_int_eq(leaderboard_insert(&board, 1, &best), 1);
+  ck_assert_str_eq(leaderboard_entry(&board, 1, 1)->player, "xxxxxxxxxxxxxxx");
+  ck_assert_int_eq(leaderboard_insert(&board, LEADERBOARD_MODES, &best), 0);
+
+  LeaderboardTable_t before = board.file->tables[1];
+  leaderboard_close(&board);
+
+  ck_assert(leaderboard_open(&board, dir));
+  ck_assert_mem_eq(&board.file->tables[1], &before, sizeof(before));
+  leaderboard_close(&board);
+
+  char path[PERSIST_PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", dir, LEADERBOARD_INDEX_FILE);
+  remove(path);
+  snprintf(path, sizeof(path), "%s/%s", dir, LEADERBOARD_LOG_FILE);
+  remove(path);
+  rmdir(dir);
+}
+END_TEST
+
+START_TEST(test_leaderboard_recovers_from_log) {
+  const char* dir = "./test/leaderboard_crash";
+  mkdir(dir, 0755);
+  Leaderboard_t board;
+  ck_assert(leaderboard_open(&board, dir));
+  fill_leaderboard(&board, 150);
+  LeaderboardTable_t before = board.file->tables[1];
+
+  // Процесс упал посреди обновления таблицы
+  board.file->dirty = 1;
+  memset(&board.file->tables[1], 0xAB, sizeof(LeaderboardTable_t));
+  leaderboard_close(&board);
+
+  char log_path[PERSIST_PATH_MAX];
+  snprintf(log_path, sizeof(log_path), "%s/%s", dir, LEADERBOARD_LOG_FILE);
+  FILE* log = fopen(log_path, "ab");
+  ck_assert_ptr_nonnull(log);
+  fwrite("torn", 1, 4, log);
+  fclose(log);
+
+  ck_assert(leaderboard_open(&board, dir));
+  ck_assert_int_eq(board.file->dirty, 0);
+  ck_assert_uint_eq(board.file->applied_log_size, board.log_size);
+  ck_assert_uint_eq(board.log_size % sizeof(LeaderboardLogRecord_t), 0);
+  ck_assert_mem_eq(&board.file->tables[1], &before, sizeof(before));
+
+  // Таблица отстала от журнала: дописывается только хвост
+  board.file->applied_log_size -= 3 * sizeof(LeaderboardLogRecord_t);
+  board.file->tables[1] = (LeaderboardTable_t){0};
+  leaderboard_close(&board);
+  ck_assert(leaderboard_open(&board, dir));
+  ck_assert_int_eq(leaderboard_count(&board, 1), 3);
+  check_leaderboard_sorted(&board, 1);
+  leaderboard_close(&board);
+
+  remove(log_path);
+  snprintf(log_path, sizeof(log_path), "%s/%s", dir, LEADERBOARD_INDEX_FILE);
+  remove(log_path);
+  rmdir(dir);
+}
+END_TEST
+
+START_TEST(test_submit_result_and_load_high_score) {
+  const char* dir = "./test/leaderboard_game";
+  mkdir(dir, 0755);
+  persist_set_data_dir(dir);
+  engine_context_init(getEngineContext(false), 77, RNG_BAG);
+
+  GameInfo_t state = {0};
+  state.score = 4200;
+  state.level = 7;
+  submit_result(&state);
+  // Таблицу читает фоновый поток, рекорд забирается без ожидания
+  ck_assert_int_eq(load_high_score(), 0);
+  int best = 0;
+  persist_wait();
+  ck_assert(persist_best_take(&best));
+  ck_assert_int_eq(best, 4200);
+  ck_assert(!persist_best_take(&best));
+
+  const LeaderboardEntry_t* entry =
+      leaderboard_entry(getLeaderboard(false), RNG_BAG, 1);
+  ck_assert_ptr_nonnull(entry);
+  ck_assert_uint_eq(entry->replay_id, 77);
+  ck_assert_uint_eq(entry->level, 7);
+
+  // Очередь фонового потока переполняется, но ни одна партия не теряется
+  for (int i = 0; i < 3 * PERSIST_RESULT_QUEUE; i++) {
+    state.score = 10 * i;
+    submit_result(&state);
+  }
+  ck_assert(persist_flush());
+  ck_assert_int_eq(leaderboard_count(getLeaderboard(false), RNG_BAG),
+                   3 * PERSIST_RESULT_QUEUE + 1);
+  getLeaderboard(true);
+
+  char path[PERSIST_PATH_MAX];
+  ck_assert(persist_path(LEADERBOARD_INDEX_FILE, path, sizeof(path)));
+  remove(path);
+  ck_assert(persist_path(LEADERBOARD_LOG_FILE, path, sizeof(path)));
+  remove(path);
+  rmdir(dir);
+  persist_set_data_dir(NULL);
+}
+END_TEST
+
+START_TEST(test_checkpoint_encode_decode) {
+  TetrisSession_t session;
+  session_init(&session, 31, RNG_BAG);
+  session_input(&session, Start);
+  for (int i = 0; i < 200; i++) session_step(&session);
+
+  CheckpointBody_t body, decoded;
+  session_checkpoint(&session, &body);
+  CheckpointRecord_t record;
+  checkpoint_encode(&body, 7, &record);
+  ck_assert(checkpoint_decode(&record, &decoded));
+  ck_assert_mem_eq(&body, &decoded, sizeof(body));
+
+  CheckpointRecord_t broken = record;
+  broken.body.state.frame.rows[GAME_FIELD_HEIGHT - 1] ^= 1;
+  ck_assert(!checkpoint_decode(&broken, &decoded));
+  broken = record;
+  broken.version = CHECKPOINT_VERSION + 1;
+  ck_assert(!checkpoint_decode(&broken, &decoded));
+  checkpoint_encode(&body, 0, &broken);
+  ck_assert(!checkpoint_decode(&broken, &decoded));
+}
+END_TEST
+
+static void step_until_lock(TetrisSession_t* session) {
+  uint32_t pieces = session->engine.pieces;
+  while (session->engine.pieces == pieces && session_step(session)) {
+  }
+}
+
+START_TEST(test_checkpoint_store_resume_sessions) {
+  const char* path = "./test/checkpoints.bin";
+  enum { SESSIONS = 64 };
+  static TetrisSession_t live[SESSIONS];
+  CheckpointStore_t store;
+  ck_assert(checkpoint_store_open(&store, path, SESSIONS));
+
+  for (int s = 0; s < SESSIONS; s++) {
+    session_init(&live[s], (uint64_t)s, s % 2 ? RNG_BAG : RNG_UNIFORM);
+    session_attach_checkpoints(&live[s], &store, (uint32_t)s);
+    session_input(&live[s], Start);
+    for (int i = 0; i < 100 + s * 7; i++) {
+      if (i % 5 == 0) session_input(&live[s], (UserAction_t)(Left + s % 3));
+      session_step(&live[s]);
+    }
+    step_until_lock(&live[s]);
+    session_attach_checkpoints(&live[s], NULL, 0);
+  }
+  checkpoint_store_close(&store);
+
+  ck_assert(checkpoint_store_open(&store, path, SESSIONS));
+  for (int s = 0; s < SESSIONS; s++) {
+    TetrisSession_t resumed;
+    ck_assert(session_resume(&resumed, &store, (uint32_t)s));
+
+    GameSnapshot_t a, b;
+    session_save(&live[s], &a);
+    session_save(&resumed, &b);
+    ck_assert_mem_eq(&a, &b, sizeof(a));
+    for (int i = 0; i < 300; i++) {
+      session_step(&live[s]);
+      session_step(&resumed);
+    }
+    ck_assert(live[s].engine.checksum == resumed.engine.checksum);
+  }
+
+  // Обрыв записи новой копии: остаётся предыдущий checkpoint
+  CheckpointBody_t newest, previous;
+  ck_assert(checkpoint_store_load(&store, 3, &newest));
+  CheckpointRecord_t* copies = &store.records[3 * 2];
+  int torn = copies[0].sequence > copies[1].sequence ? 0 : 1;
+  copies[torn].body.state.frame.score ^= 1;
+  ck_assert(checkpoint_store_load(&store, 3, &previous));
+  ck_assert_uint_lt(previous.state.tick, newest.state.tick);
+
+  checkpoint_store_clear(&store, 3);
+  ck_assert(!checkpoint_store_load(&store, 3, &previous));
+  ck_assert(!checkpoint_store_load(&store, SESSIONS, &previous));
+  checkpoint_store_close(&store);
+
+  // Файл с другим числом слотов начинается с чистого листа
+  ck_assert(checkpoint_store_open(&store, path, SESSIONS * 2));
+  ck_assert(!checkpoint_store_load(&store, 0, &previous));
+  checkpoint_store_close(&store);
+  remove(path);
+}
+END_TEST
+
+typedef struct {
+  const Handoff_t* handoff;
+  int listen_fd;
+  int fds[1];
+  int fd_count;
+  bool adopted;
+} HandoffSender_t;
+
+static void* handoff_sender(void* arg) {
+  HandoffSender_t* sender = (HandoffSender_t*)arg;
+  sender->adopted =
+      handoff_send(sender->handoff, sender->listen_fd, sender->fds,
+                   sender->fd_count);
+  return NULL;
+}
+
+START_TEST(test_handoff_passes_sessions_and_fds) {
+  enum { SESSIONS = 10 };
+  static TetrisSession_t live[SESSIONS];
+  Handoff_t outgoing;
+  ck_assert(handoff_create(&outgoing, SESSIONS));
+  for (int s = 0; s < SESSIONS; s++) {
+    session_init(&live[s], (uint64_t)(s + 100), RNG_BAG);
+    session_input(&live[s], Start);
+    for (int i = 0; i < 50 * s; i++) session_step(&live[s]);
+    handoff_put_session(&outgoing, (uint32_t)s, (uint64_t)(1000 + s),
+                        &live[s]);
+  }
+
+  // Вместо слушающего сокета сервера передаём конец pipe
+  int pipe_fds[2];
+  ck_assert_int_eq(pipe(pipe_fds), 0);
+
+  const char* path = "./test/handoff.sock";
+  HandoffSender_t sender = {&outgoing, handoff_listen(path), {pipe_fds[1]},
+                            1, false};
+  ck_assert_int_ge(sender.listen_fd, 0);
+  pthread_t thread;
+  ck_assert_int_eq(pthread_create(&thread, NULL, handoff_sender, &sender), 0);
+
+  Handoff_t incoming;
+  ck_assert(handoff_receive(&incoming, path));
+  pthread_join(thread, NULL);
+  ck_assert(sender.adopted);
+  close(sender.listen_fd);
+  unlink(path);
+  handoff_close(&outgoing);
+
+  ck_assert_int_eq(incoming.fd_count, 1);
+  ck_assert_int_eq(write(incoming.fds[0], "go", 2), 2);
+  char text[2];
+  ck_assert_int_eq(read(pipe_fds[0], text, 2), 2);
+  ck_assert_mem_eq(text, "go", 2);
+  close(incoming.fds[0]);
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+
+  for (int s = 0; s < SESSIONS; s++) {
+    TetrisSession_t adopted;
+    uint64_t id = 0;
+    ck_assert(handoff_take_session(&incoming, (uint32_t)s, &id, &adopted));
+    ck_assert_uint_eq(id, (uint64_t)(1000 + s));
+    for (int i = 0; i < 200; i++) {
+      session_step(&live[s]);
+      session_step(&adopted);
+    }
+    ck_assert(live[s].engine.checksum == adopted.engine.checksum);
+    ck_assert_int_eq(live[s].info.score, adopted.info.score);
+  }
+  uint64_t id;
+  TetrisSession_t none;
+  ck_assert(!handoff_take_session(&incoming, SESSIONS, &id, &none));
+  handoff_close(&incoming);
+}
+END_TEST
+
+START_TEST(test_handoff_rejects_other_layout) {
+  Handoff_t outgoing, incoming;
+  ck_assert(handoff_create(&outgoing, 1));
+  outgoing.header->record_version = CHECKPOINT_VERSION + 1;
+
+  const char* path = "./test/handoff_old.sock";
+  HandoffSender_t sender = {&outgoing, handoff_listen(path), {-1}, 0, true};
+  pthread_t thread;
+  ck_assert_int_eq(pthread_create(&thread, NULL, handoff_sender, &sender), 0);
+  ck_assert(!handoff_receive(&incoming, path));
+  pthread_join(thread, NULL);
+  ck_assert(!sender.adopted);
+
+  close(sender.listen_fd);
+  unlink(path);
+  handoff_close(&outgoing);
+  ck_assert(!handoff_receive(&incoming, path));
+}
+END_TEST
+
+START_TEST(test_session_clone_is_independent) {
+  TetrisSession_t session, clone;
+  session_init(&session, 9, RNG_BAG);
+  session_input(&session, Start);
+  for (int i = 0; i < 40; i++) session_step(&session);
+
+  session_clone(&clone, &session);
+  ck_assert(clone.info.field[0] == clone.cells[0]);
+  ck_assert(clone.info.next[0] == clone.next_cells[0]);
+  ck_assert_mem_eq(clone.cells, session.cells, sizeof(session.cells));
+
+  TetrisSession_t before;
+  session_clone(&before, &session);
+  for (int i = 0; i < 50; i++) {
+    session_input(&clone, Left);
+    session_step(&clone);
+  }
+  ck_assert_mem_eq(session.cells, before.cells, sizeof(before.cells));
+  ck_assert(session.engine.tick == before.engine.tick);
+  ck_assert(clone.engine.tick != session.engine.tick);
+}
+END_TEST
+
+START_TEST(test_session_branch_copy_on_write) {
+  TetrisSession_t session;
+  session_init(&session, 4, RNG_UNIFORM);
+  session_input(&session, Start);
+
+  SessionBranch_t root, fork;
+  ck_assert(session_branch_init(&root, &session));
+  session_branch_fork(&fork, &root);
+  ck_assert_ptr_eq(session_branch_view(&fork), session_branch_view(&root));
+
+  TetrisSession_t* edited = session_branch_edit(&fork);
+  ck_assert_ptr_nonnull(edited);
+  ck_assert_ptr_ne(edited, session_branch_view(&root));
+  for (int i = 0; i < 100; i++) session_step(edited);
+  ck_assert(session_branch_view(&root)->engine.tick == session.engine.tick);
+
+  // Последний владелец правит на месте
+  session_branch_release(&root);
+  ck_assert_ptr_eq(session_branch_edit(&fork), edited);
+  session_branch_release(&fork);
+  ck_assert_ptr_null(session_branch_view(&fork));
+}
+END_TEST
+
+START_TEST(test_undo_history_walks_placements) {
+  enum { PLACEMENTS = 40 };
+  TetrisSession_t session;
+  UndoHistory_t history;
+  GameSnapshot_t states[PLACEMENTS + 1];
+
+  session_init(&session, 12, RNG_BAG);
+  session_input(&session, Start);
+  session_attach_history(&session, &history);
+  session_save(&session, &states[0]);
+
+  UserAction_t moves[] = {Left, Right, Up, Left, Right};
+  int placed = 0;
+  for (int i = 0; placed < PLACEMENTS && session.info.pause == PAUSE_OFF;
+       i++) {
+    session_input(&session, moves[i % 5]);
+    if (i % 3 == 0) session_input(&session, Action);
+    session_step(&session);
+    if (history.undo_count > (uint32_t)placed) {
+      placed++;
+      session_save(&session, &states[placed]);
+    }
+  }
+  ck_assert_int_gt(placed, 10);
+  // Пара десятков байт на фиксацию вместо полного снимка, счётчики не
+  // разбиваются на отдельные серии
+  for (size_t at = 0; at < history.size; at += history.data[at] + 2u) {
+    ck_assert_uint_le(history.data[at] + 2u, 40);
+  }
+  ck_assert_uint_le(history.size / (size_t)placed, 30);
+
+  GameSnapshot_t now;
+  for (int k = placed - 1; k >= 0; k--) {
+    ck_assert(session_undo(&session));
+    session_save(&session, &now);
+    ck_assert_mem_eq(&now, &states[k], sizeof(now));
+  }
+  ck_assert(!session_undo(&session));
+
+  for (int k = 1; k <= placed; k++) {
+    ck_assert(session_redo(&session));
+    session_save(&session, &now);
+    ck_assert_mem_eq(&now, &states[k], sizeof(now));
+  }
+  ck_assert(!session_redo(&session));
+
+  // Новая фиксация после отмены отбрасывает ветку redo
+  ck_assert(session_undo(&session));
+  ck_assert(session_undo(&session));
+  uint32_t depth = history.undo_count;
+  for (int i = 0; i < 100 && history.undo_count == depth; i++) {
+    session_input(&session, Action);
+    session_step(&session);
+  }
+  ck_assert_uint_eq(history.undo_count, depth + 1);
+  ck_assert_uint_eq(history.redo_count, 0);
+  ck_assert(!session_redo(&session));
+
+  undo_history_free(&history);
+}
+END_TEST
+
+START_TEST(test_tas_rewind_restores_tick_start) {
+  static Tas_t tas;
+  tas_init(&tas, 21, RNG_BAG);
+  tas_input(&tas, Start);
+  for (int i = 0; i < 400; i++) {
+    if (i % 9 == 0) tas_input(&tas, Left);
+    tas_step(&tas);
+  }
+
+  for (int i = 0; i < TAS_REWIND_TICKS + 100; i++) {
+    if (i % 9 == 0) tas_input(&tas, Up);
+    if (!tas_step(&tas)) tas_input(&tas, Start);
+  }
+  ck_assert_uint_eq(tas.rewind.count, TAS_REWIND_TICKS);
+  ck_assert_uint_eq(tas_rewind(&tas, 10), 10);
+  ck_assert_uint_eq(tas_rewind(&tas, TAS_REWIND_TICKS), TAS_REWIND_TICKS - 11);
+
+  // Перемотка к сохранённому тику и повтор дают то же состояние
+  tas_init(&tas, 21, RNG_BAG);
+  tas_input(&tas, Start);
+  for (int i = 0; i < 50; i++) tas_step(&tas);
+  GameSnapshot_t before, after;
+  session_save(&tas.session, &before);
+  for (int i = 0; i < 30; i++) {
+    tas_input(&tas, i % 2 ? Left : Up);
+    ck_assert(tas_step(&tas));
+  }
+  ck_assert_uint_eq(tas_rewind(&tas, 30), 30);
+  session_save(&tas.session, &after);
+  ck_assert_mem_eq(&before, &after, sizeof(before));
+
+  // Ввод внутри тика отменяется перемоткой на 0
+  tas_input(&tas, Left);
+  tas_rewind(&tas, 0);
+  session_save(&tas.session, &after);
+  ck_assert_mem_eq(&before, &after, sizeof(before));
+}
+END_TEST
+
+START_TEST(test_tas_script_builds_scenario) {
+  const char* text =
+      "# T-slot\n"
+      "seed 7\n"
+      "rng bag\n"
+      "start\n"
+      "wait 2\n"
+      "row 19 ###...####\n"
+      "row 18 ##....####\n"
+      "left 2\n"
+      "drop\n"
+      "wait 2\n";
+  TasScript_t script;
+  ck_assert(tas_script_parse(text, &script));
+  ck_assert_uint_eq(script.seed, 7);
+  ck_assert_int_eq(script.mode, RNG_BAG);
+  ck_assert_uint_eq(script.count, 7);
+
+  static Tas_t tas;
+  tas_run_script(&tas, &script);
+  ck_assert_uint_eq(tas.session.engine.tick, 4);
+  ck_assert_uint_eq(tas.session.engine.pieces, 1);
+  ck_assert_int_eq(tas.session.cells[19][0], 1);
+  ck_assert_int_eq(tas.session.cells[19][9], 1);
+  tas_script_free(&script);
+
+  ck_assert(!tas_script_parse("start\nseed 3\n", &script));
+  ck_assert_int_eq(script.error_line, 2);
+  ck_assert(!tas_script_parse("row 19 ###\n", &script));
+  ck_assert(!tas_script_parse("jump 2\n", &script));
+}
+END_TEST
+
+START_TEST(test_rollback_late_input_matches_on_time) {
+  static Rollback_t on_time, late;
+  rollback_init(&on_time, 17, RNG_BAG);
+  rollback_init(&late, 17, RNG_BAG);
+  UserAction_t actions[] = {Start, Left, Up, Right, Action, Down};
+
+  for (uint32_t f = 0; f < 600; f++) {
+    UserAction_t action = actions[f % 6];
+    ck_assert(rollback_input(&on_time, f, action));
+    rollback_advance(&on_time);
+
+    // Ввод второй копии приходит на 5 тиков позже
+    if (f >= 5) ck_assert(rollback_input(&late, f - 5, actions[(f - 5) % 6]));
+    uint32_t resimulated = rollback_advance(&late);
+    ck_assert_uint_eq(resimulated, f >= 5 ? 5 : 0);
+  }
+
+  uint64_t a, b;
+  for (uint32_t f = 600 - 5; f < 600; f++) {
+    // Последние 5 тиков второй копии ещё без ввода
+    ck_assert(rollback_checksum(&on_time, f, &a));
+    ck_assert(rollback_checksum(&late, f, &b));
+    ck_assert(a != b);
+  }
+  for (uint32_t f = 600 - 5; f < 600; f++) {
+    ck_assert(rollback_input(&late, f, actions[f % 6]));
+  }
+  ck_assert_uint_eq(rollback_advance(&late), 5);
+  ck_assert(rollback_input(&on_time, 600, Action));
+  rollback_advance(&on_time);
+  for (uint32_t f = 601 - ROLLBACK_WINDOW + 1; f < 601; f++) {
+    ck_assert(rollback_checksum(&on_time, f, &a));
+    ck_assert(rollback_checksum(&late, f, &b));
+    if (f < 600) ck_assert(a == b);
+  }
+  ck_assert(!rollback_input(&late, 601 - ROLLBACK_WINDOW, Left));
+  ck_assert(!rollback_input(&late, 602, Left));
+}
+END_TEST
+
+typedef struct {
+  uint32_t frame;
+  int32_t action;
+  uint64_t checksum;
+} RollbackMessage_t;
+
+static int rollback_bot_action(int player, uint32_t frame) {
+  static const int actions[] = {-1, Left, Right, Up, Down, Action, Start};
+  return actions[(frame * 7 + (uint32_t)player * 3 + frame / 5) % 7];
+}
+
+/**
+ * One side of a head-to-head game: simulates its own session and the
+ * opponent's one, whose input arrives over the socket with a delay.
+ */
+static int rollback_peer(int fd, int player) {
+  enum { FRAMES = 900, DELAY = 3 };
+  static Rollback_t local, remote;
+  rollback_init(&local, 100 + (uint64_t)player, RNG_BAG);
+  rollback_init(&remote, 100 + (uint64_t)!player, RNG_BAG);
+  int mismatches = 0, rollbacks = 0;
+
+  for (uint32_t f = 0; f < FRAMES + DELAY; f++) {
+    if (f < FRAMES) {
+      RollbackMessage_t out = {f, rollback_bot_action(player, f), 0};
+      if (out.action >= 0) {
+        rollback_input(&local, f, (UserAction_t)out.action);
+      }
+      rollback_advance(&local);
+      rollback_checksum(&local, f, &out.checksum);
+      if (write(fd, &out, sizeof(out)) != (ssize_t)sizeof(out)) return 2;
+    }
+
+    RollbackMessage_t in;
+    bool received = false;
+    if (f >= DELAY) {
+      if (read(fd, &in, sizeof(in)) != (ssize_t)sizeof(in)) return 2;
+      if (in.action >= 0) {
+        rollback_input(&remote, in.frame, (UserAction_t)in.action);
+      }
+      received = true;
+    }
+    rollbacks += rollback_advance(&remote) > 0;
+
+    uint64_t checksum;
+    if (received && (!rollback_checksum(&remote, in.frame, &checksum) ||
+                     checksum != in.checksum)) {
+      mismatches++;
+    }
+  }
+  return mismatches == 0 && rollbacks > 0 ? 0 : 1;
+}
+
+START_TEST(test_rollback_two_processes_stay_in_sync) {
+  int fds[2];
+  ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+  pid_t child = fork();
+  ck_assert_int_ge(child, 0);
+  if (child == 0) {
+    close(fds[0]);
+    _exit(rollback_peer(fds[1], 1));
+  }
+  close(fds[1]);
+  int result = rollback_peer(fds[0], 0);
+  close(fds[0]);
+
+  int status = 0;
+  ck_assert_int_eq(waitpid(child, &status, 0), child);
+  ck_assert_int_eq(result, 0);
+  ck_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+END_TEST
+
+static int server_client(const char* path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  ck_assert_int_ge(fd, 0);
+  ck_assert_int_eq(connect(fd, (struct sockaddr*)&address, sizeof(address)),
+                   0);
+  return fd;
+}
+
+static void server_call(int fd, uint8_t type, uint8_t value, uint64_t seed,
+                        uint32_t sequence, ServerReply_t* reply) {
+  ServerRequest_t request = {.type = type,
+                             .action = value,
+                             .mode = value,
+                             .sequence = sequence,
+                             .seed = seed};
+  ck_assert_int_eq(write(fd, &request, sizeof(request)), sizeof(request));
+  ck_assert_int_eq(read(fd, reply, sizeof(*reply)), sizeof(*reply));
+  ck_assert_uint_eq(reply->sequence, sequence);
+}
+
+static uint32_t server_wait_sessions(Server_t* server, uint32_t expected) {
+  ServerStats_t stats;
+  for (int i = 0; i < 200; i++) {
+    server_stats(server, &stats);
+    if (stats.sessions == expected) break;
+    usleep(5000);
+  }
+  return stats.sessions;
+}
+
+START_TEST(test_server_hosts_independent_sessions) {
+  const char* path = "./test/server.sock";
+  static Server_t server;
+  ServerConfig_t config = {.unix_path = path, .loops = 2, .tick_hz = 200};
+  ck_assert(server_start(&server, &config));
+
+  int fds[3];
+  ServerReply_t replies[3];
+  for (int i = 0; i < 3; i++) {
+    fds[i] = server_client(path);
+    server_call(fds[i], SERVER_REQUEST_START, RNG_BAG, 40 + (uint64_t)i,
+                (uint32_t)i + 1, &replies[i]);
+    ck_assert_int_eq(replies[i].type, SERVER_REPLY_STATE);
+    ck_assert_int_eq(replies[i].pause, PAUSE_OFF);
+  }
+  ck_assert(replies[0].session_id != replies[1].session_id);
+  ck_assert(replies[1].session_id != replies[2].session_id);
+  ck_assert_uint_eq(server_wait_sessions(&server, 3), 3);
+
+  // Гравитация идёт от таймера сервера без участия клиента
+  ServerReply_t reply;
+  for (int i = 0; i < 300; i++) {
+    server_call(fds[0], SERVER_REQUEST_STATE, 0, 0, 6, &reply);
+    if (reply.tick > 0) break;
+    usleep(10000);
+  }
+  ck_assert_uint_gt(reply.tick, 0);
+  server_call(fds[0], SERVER_REQUEST_INPUT, Action, 0, 7, &reply);
+  ck_assert_int_eq(reply.type, SERVER_REPLY_STATE);
+  server_call(fds[0], SERVER_REQUEST_HOLD, Left, 0, 9, &reply);
+  ck_assert_int_eq(reply.type, SERVER_REPLY_STATE);
+  server_call(fds[0], SERVER_REQUEST_RELEASE, 0, 0, 10, &reply);
+  ck_assert_int_eq(reply.type, SERVER_REPLY_STATE);
+  server_call(fds[0], 99, 0, 0, 8, &reply);
+  ck_assert_int_eq(reply.type, SERVER_REPLY_ERROR);
+
+  // Запросы можно слать пачкой, ответы приходят по порядку, даже если
+  // пачка не вычитывается за одно пробуждение цикла
+  enum { BATCH = 320 };
+  static ServerRequest_t batch[BATCH];
+  for (int i = 0; i < BATCH; i++) {
+    batch[i] = (ServerRequest_t){.type = SERVER_REQUEST_STATE,
+                                 .sequence = 100 + (uint32_t)i};
+  }
+  ck_assert_int_eq(write(fds[1], batch, sizeof(batch)), sizeof(batch));
+  for (int i = 0; i < BATCH; i++) {
+    size_t got = 0;
+    while (got < sizeof(reply)) {
+      ssize_t n = read(fds[1], (char*)&reply + got, sizeof(reply) - got);
+      ck_assert_int_gt(n, 0);
+      got += (size_t)n;
+    }
+    ck_assert_uint_eq(reply.sequence, 100 + (uint32_t)i);
+  }
+
+  for (int i = 0; i < 3; i++) close(fds[i]);
+  ck_assert_uint_eq(server_wait_sessions(&server, 0), 0);
+
+  ServerStats_t stats;
+  server_stats(&server, &stats);
+  ck_assert_uint_gt(stats.ticks, 0);
+  ck_assert_uint_gt(stats.steps, 0);
+  server_stop(&server);
+  ck_assert_int_ne(access(path, F_OK), 0);
+}
+END_TEST
+
+START_TEST(test_server_gravity_matches_game_timer) {
+  ck_assert_uint_eq(server_gravity_ticks(0, 60), 60);
+  ck_assert_uint_eq(server_gravity_ticks(2, 60), 30);
+  ck_assert_uint_eq(server_gravity_ticks(10, 60), 10);
+  ck_assert_uint_eq(server_gravity_ticks(10, 10), 2);
+  ck_assert_uint_eq(server_gravity_ticks(0, 1), 1);
+  ck_assert_uint_eq(server_gravity_ticks(GAME_LEVEL_CLASSIC + 1, 60), 3);
+
+  // Клеток в секунду на сервере столько же, сколько в GameTimer(), и с
+  // уровнем это число не падает
+  double previous = 0;
+  for (int level = 0; level <= GAME_LEVEL_MAX; level++) {
+    uint32_t ticks = server_gravity_ticks(level, 1000);
+    ck_assert_uint_eq(ticks, (game_tick_interval(level) + 500000) / 1000000);
+    double game = (double)level_gravity(level) / GRAVITY_ONE * 1e9 /
+                  (double)game_tick_interval(level);
+    double server = (double)level_gravity(level) / GRAVITY_ONE * 1000 / ticks;
+    ck_assert(server > game * 0.99 && server < game * 1.01);
+    ck_assert(server >= previous);
+    previous = server;
+  }
+}
+END_TEST
+
+typedef struct {
+  TimerNode_t node;
+  uint64_t fired_at;
+  int fired;
+} WheelProbe_t;
+
+static void wheel_probe_fire(TimerNode_t* timer, void* context) {
+  WheelProbe_t* probe = (WheelProbe_t*)timer;
+  probe->fired_at = ((TimerWheel_t*)context)->now;
+  probe->fired++;
+}
+
+START_TEST(test_timer_wheel_fires_on_time) {
+  enum { TIMERS = 4000 };
+  static TimerWheel_t wheel;
+  static WheelProbe_t probes[TIMERS];
+  timer_wheel_init(&wheel, 1000);
+
+  uint64_t state = 99;
+  for (int i = 0; i < TIMERS; i++) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    // Сроки на всех уровнях колеса, от следующего тика до сотен тысяч
+    uint64_t delay = 1 + (state >> 33) % (i % 4 == 0 ? 300000 : 5000);
+    timer_init(&probes[i].node, wheel_probe_fire);
+    timer_schedule(&wheel, &probes[i].node, wheel.now + delay);
+  }
+  ck_assert_uint_eq(wheel.pending, TIMERS);
+
+  // Отменённый и перенесённый таймеры
+  timer_cancel(&wheel, &probes[0].node);
+  ck_assert(!timer_pending(&probes[0].node));
+  timer_schedule(&wheel, &probes[1].node, wheel.now + 70000);
+
+  uint64_t target = wheel.now;
+  while (wheel.pending) {
+    target += 1 + (target % 7) * 13;
+    timer_wheel_advance(&wheel, target, &wheel);
+  }
+
+  ck_assert_int_eq(probes[0].fired, 0);
+  for (int i = 1; i < TIMERS; i++) {
+    ck_assert_int_eq(probes[i].fired, 1);
+    // Продвижение идёт шагами, поэтому таймер видит ровно свой тик
+    ck_assert_uint_eq(probes[i].fired_at, probes[i].node.expires);
+  }
+  ck_assert_uint_eq(probes[1].node.expires, 1000 + 70000);
+
+  // Прошедший срок срабатывает на следующем тике
+  timer_schedule(&wheel, &probes[2].node, 5);
+  ck_assert_uint_eq(timer_wheel_advance(&wheel, wheel.now + 1, &wheel), 1);
+  ck_assert_int_eq(probes[2].fired, 2);
+}
+END_TEST
+
+static void read_exact(int fd, void* buffer, size_t size) {
+  size_t got = 0;
+  while (got < size) {
+    ssize_t n = read(fd, (char*)buffer + got, size - got);
+    ck_assert_int_gt(n, 0);
+    got += (size_t)n;
+  }
+}
+
+START_TEST(test_server_spectator_follows_deltas) {
+  const char* path = "./test/server.sock";
+  static Server_t server;
+  ServerConfig_t config = {.unix_path = path, .loops = 2, .tick_hz = 200};
+  ck_assert(server_start(&server, &config));
+
+  int player = server_client(path);
+  ServerReply_t reply;
+  server_call(player, SERVER_REQUEST_START, RNG_BAG, 77, 1, &reply);
+  uint64_t player_id = reply.session_id;
+  TetrisSession_t replica;
+  session_init(&replica, 77, RNG_BAG);
+  session_input(&replica, Start);
+
+  // Зритель получает следующий id и живёт на другом цикле
+  int spectator = server_client(path);
+  server_call(spectator, SERVER_REQUEST_WATCH, 0, player_id, 2, &reply);
+  ck_assert_int_eq(reply.type, SERVER_REPLY_STATE);
+  ck_assert_uint_ne(reply.session_id % 2, player_id % 2);
+  struct timeval timeout = {.tv_sec = 2, .tv_usec = 0};
+  setsockopt(spectator, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  const UserAction_t actions[] = {Left, Left, Action, Right, Up, Action,
+                                  Right, Right, Right, Action, Down, Action};
+  for (uint32_t i = 0; i < sizeof(actions) / sizeof(actions[0]); i++) {
+    server_call(player, SERVER_REQUEST_INPUT, actions[i], 0, 10 + i, &reply);
+    while (replica.engine.tick < reply.tick) session_step(&replica);
+    session_input(&replica, actions[i]);
+    ck_assert_uint_eq(reply.checksum, replica.engine.checksum);
+    usleep(5000);
+  }
+  TetrisFrame_t expected;
+  frame_capture(&replica.info, &replica.block, &expected);
+
+  TetrisFrame_t board;
+  memset(&board, 0, sizeof(board));
+  uint8_t data[SERVER_FRAME_MAX];
+  ServerFrameHeader_t header;
+  uint32_t sequence = 0;
+  bool matched = false;
+  for (int i = 0; i < 200 && !matched; i++) {
+    read_exact(spectator, data, sizeof(header));
+    memcpy(&header, data, sizeof(header));
+    ck_assert_uint_le(header.size, sizeof(data));
+    read_exact(spectator, data + sizeof(header),
+               header.size - sizeof(header));
+    ck_assert_int_eq(header.type,
+                     i == 0 ? SERVER_FRAME_KEY : SERVER_FRAME_DELTA);
+    if (i > 0) ck_assert_uint_eq(header.sequence, sequence + 1);
+    sequence = header.sequence;
+    ck_assert(server_frame_apply(data, header.size, &board));
+    matched = memcmp(&board, &expected, sizeof(board)) == 0;
+  }
+  ck_assert(matched);
+
+  ServerStats_t stats;
+  server_stats(&server, &stats);
+  ck_assert_uint_eq(stats.keyframes, 1);
+  ck_assert_uint_gt(stats.frames, 0);
+
+  // Со сломанной маской кадр не применяется
+  header.row_mask = 1u << GAME_FIELD_HEIGHT;
+  memcpy(data, &header, sizeof(header));
+  ck_assert(!server_frame_apply(data, header.size, &board));
+
+  // Вместе с игрой закрываются и её зрители
+  close(player);
+  ck_assert_int_le(read(spectator, data, sizeof(data)), 0);
+  close(spectator);
+  ck_assert_uint_eq(server_wait_sessions(&server, 0), 0);
+
+  // Третий новый клиент получает на том же цикле контекст прежнего
+  // игрока, но нумерация кадров у него начинается заново
+  int clients[3];
+  for (int i = 0; i < 3; i++) {
+    clients[i] = server_client(path);
+    server_call(clients[i], SERVER_REQUEST_START, RNG_BAG, 5, 30 + i, &reply);
+  }
+  ck_assert_uint_eq(reply.session_id % 2, player_id % 2);
+  spectator = server_client(path);
+  setsockopt(spectator, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  server_call(spectator, SERVER_REQUEST_WATCH, 0, reply.session_id, 40,
+              &reply);
+  read_exact(spectator, data, sizeof(header));
+  memcpy(&header, data, sizeof(header));
+  ck_assert_int_eq(header.type, SERVER_FRAME_KEY);
+  ck_assert_uint_eq(header.sequence, 1);
+
+  close(spectator);
+  for (int i = 0; i < 3; i++) close(clients[i]);
+  ck_assert_uint_eq(server_wait_sessions(&server, 0), 0);
+  server_stop(&server);
+}
+END_TEST
+
+static void* battle_producer(void* arg) {
+  BattleQueue_t* queue = (BattleQueue_t*)arg;
+  static atomic_uint next_source;
+  uint16_t source = (uint16_t)atomic_fetch_add(&next_source, 1);
+  for (uint32_t i = 0; i < 30; i++) {
+    BattleAttack_t attack = {.tick = i, .source = source, .lines = 1};
+    while (!battle_queue_push(queue, &attack)) sched_yield();
+  }
+  return NULL;
+}
+
+START_TEST(test_battle_queue_and_garbage) {
+  static BattleQueue_t queue;
+  battle_queue_init(&queue);
+  BattleAttack_t attack = {.tick = 1, .source = 2, .lines = 3, .hole = 4};
+  for (int i = 0; i < BATTLE_QUEUE_SIZE; i++) {
+    ck_assert(battle_queue_push(&queue, &attack));
+  }
+  ck_assert(!battle_queue_push(&queue, &attack));
+  BattleAttack_t got;
+  for (int i = 0; i < BATTLE_QUEUE_SIZE; i++) {
+    ck_assert(battle_queue_pop(&queue, &got));
+  }
+  ck_assert(!battle_queue_pop(&queue, &got));
+
+  // Четыре отправителя сразу: ничего не теряется, порядок каждого сохранён
+  pthread_t threads[4];
+  for (int i = 0; i < 4; i++) {
+    ck_assert_int_eq(
+        pthread_create(&threads[i], NULL, battle_producer, &queue), 0);
+  }
+  uint32_t next_tick[4] = {0};
+  int received = 0;
+  while (received < 120) {
+    if (!battle_queue_pop(&queue, &got)) continue;
+    ck_assert_uint_lt(got.source, 4);
+    ck_assert_uint_eq(got.tick, next_tick[got.source]++);
+    received++;
+  }
+  for (int i = 0; i < 4; i++) pthread_join(threads[i], NULL);
+  ck_assert(!battle_queue_pop(&queue, &got));
+
+  ck_assert_int_eq(battle_garbage_lines(1), 0);
+  ck_assert_int_eq(battle_garbage_lines(2), 1);
+  ck_assert_int_eq(battle_garbage_lines(4), 5);
+
+  TetrisSession_t session;
+  session_init(&session, 3, RNG_BAG);
+  session.cells[GAME_FIELD_HEIGHT - 1][0] = 1;
+  ck_assert(battle_add_garbage(&session, 2, 7));
+  ck_assert_int_eq(session.cells[GAME_FIELD_HEIGHT - 3][0], 1);
+  for (int row = GAME_FIELD_HEIGHT - 2; row < GAME_FIELD_HEIGHT; row++) {
+    for (int col = 0; col < GAME_FIELD_WIDTH; col++) {
+      ck_assert_int_eq(session.cells[row][col], col != 7);
+    }
+  }
+  ck_assert(!battle_add_garbage(&session, GAME_FIELD_HEIGHT - 2, 0));
+}
+END_TEST
+
+/**
+ * Drops the current piece of board 0 upright and fills the rest of the
+ * rows it lands in, so the lock clears all of them.
+ */
+static int battle_prepare_clear(Battle_t* battle) {
+  TetrisSession_t* board = &battle->boards[0].session;
+  battle_input(battle, 0, Up);
+  battle_input(battle, 0, Action);
+
+  int rows = 0;
+  for (int row = 0; row < GAME_FIELD_HEIGHT; row++) {
+    bool piece = false;
+    for (int col = 0; col < GAME_FIELD_WIDTH; col++) {
+      piece = piece || board->cells[row][col] == 2;
+    }
+    if (!piece) continue;
+    rows++;
+    for (int col = 0; col < GAME_FIELD_WIDTH; col++) {
+      if (board->cells[row][col] == 0) board->cells[row][col] = 1;
+    }
+  }
+  return rows;
+}
+
+static uint64_t battle_run(int threads, uint32_t* received_by_first) {
+  static Battle_t battle;
+  ck_assert(battle_init(&battle, 5, threads, 500, RNG_BAG));
+  for (int i = 0; i < 3; i++) battle_tick(&battle);
+
+  int rows = battle_prepare_clear(&battle);
+  ck_assert_int_ge(rows, 2);
+  uint32_t pieces = battle.boards[0].session.engine.pieces;
+  for (int i = 0; i < 5 && battle.boards[0].session.engine.pieces == pieces;
+       i++) {
+    battle_tick(&battle);
+  }
+  ck_assert_int_eq(battle.boards[0].sent, battle_garbage_lines(rows));
+
+  uint32_t received = 0;
+  for (int i = 1; i < battle.count; i++) {
+    received += battle.boards[i].received;
+    if (!battle.boards[i].received) continue;
+    int bottom = GAME_FIELD_HEIGHT - 1;
+    int holes = 0;
+    for (int col = 0; col < GAME_FIELD_WIDTH; col++) {
+      holes += battle.boards[i].session.cells[bottom][col] == 0;
+    }
+    ck_assert_int_eq(holes, 1);
+  }
+  ck_assert_uint_eq(received, battle.boards[0].sent);
+
+  for (int i = 0; i < 40; i++) {
+    battle_input(&battle, i % battle.count, i % 3 ? Left : Action);
+    battle_tick(&battle);
+  }
+  ck_assert_int_eq(battle.alive, battle.count);
+
+  uint64_t checksum = 0;
+  for (int i = 0; i < battle.count; i++) {
+    GameSnapshot_t snapshot;
+    session_save(&battle.boards[i].session, &snapshot);
+    checksum = frame_checksum(&snapshot.frame, checksum);
+  }
+  *received_by_first = battle.boards[1].received;
+  battle_free(&battle);
+  return checksum;
+}
+
+START_TEST(test_battle_routes_attacks_deterministically) {
+  uint32_t inline_received, threaded_received;
+  uint64_t inline_checksum = battle_run(0, &inline_received);
+  uint64_t threaded_checksum = battle_run(2, &threaded_received);
+  ck_assert_uint_eq(inline_checksum, threaded_checksum);
+  ck_assert_uint_eq(inline_received, threaded_received);
+}
+END_TEST
+
+START_TEST(test_bot_protocol_answers_pipelined_commands) {
+  int commands[2], replies[2];
+  ck_assert_int_eq(pipe(commands), 0);
+  ck_assert_int_eq(pipe(replies), 0);
+  const char* script =
+      "state\nplace 0 0\nnew 7 bag\nstate\nplace 0 0\nplace 1 8\n"
+      "place 0 20\nstep 5\nbogus\nstate\nquit\nstate\n";
+  ck_assert_int_eq(write(commands[1], script, strlen(script)),
+                   (ssize_t)strlen(script));
+  close(commands[1]);
+  ck_assert(bot_protocol_serve(commands[0], replies[1]));
+  close(commands[0]);
+  close(replies[1]);
+
+  char output[4096];
+  ssize_t got = read(replies[0], output, sizeof(output) - 1);
+  close(replies[0]);
+  ck_assert_int_gt(got, 0);
+  output[got] = '\0';
+
+  char* lines[16];
+  int count = 0;
+  for (char* line = strtok(output, "\n"); line && count < 16;
+       line = strtok(NULL, "\n")) {
+    lines[count++] = line;
+  }
+  // На команду после quit ответа нет
+  ck_assert_int_eq(count, 11);
+  ck_assert(strncmp(lines[0], "state 0 ", 8) == 0);
+  ck_assert(strncmp(lines[1], "error ", 6) == 0);
+  ck_assert_str_eq(lines[2], "ok");
+  ck_assert(strncmp(lines[3], "state ", 6) == 0);
+  ck_assert_str_eq(lines[4], "ok 0");
+  ck_assert_str_eq(lines[5], "ok 0");
+  ck_assert(strncmp(lines[6], "error ", 6) == 0);
+  ck_assert(strncmp(lines[8], "error ", 6) == 0);
+  ck_assert_str_eq(lines[10], "bye");
+
+  unsigned tick, pieces;
+  int score, level, lines_cleared, pause;
+  ck_assert_int_eq(sscanf(lines[7], "ok %u", &tick), 1);
+  ck_assert_int_eq(sscanf(lines[9], "state %u %d %d %d %u %d", &tick,
+                          &score, &level, &lines_cleared, &pieces, &pause),
+                   6);
+  ck_assert_uint_eq(pieces, 2);
+  ck_assert_int_eq(pause, PAUSE_OFF);
+  const char* field = strrchr(lines[9], ' ') + 1;
+  ck_assert_uint_eq(strlen(field), GAME_FIELD_HEIGHT * 3);
+
+  // Тот же ввод через execute даёт то же состояние
+  BotProtocol_t bot;
+  char reply[BOT_REPLY_MAX];
+  bot_protocol_init(&bot);
+  bot_protocol_execute(&bot, "new 7 bag", reply, sizeof(reply));
+  bot_protocol_execute(&bot, "place 0 0", reply, sizeof(reply));
+  bot_protocol_execute(&bot, "place 1 8", reply, sizeof(reply));
+  bot_protocol_execute(&bot, "step 5", reply, sizeof(reply));
+  size_t length = bot_protocol_execute(&bot, "state", reply, sizeof(reply));
+  ck_assert_uint_eq(length, strlen(lines[9]) + 1);
+  ck_assert(strncmp(reply, lines[9], length - 1) == 0);
+}
+END_TEST
+
+START_TEST(test_bot_plugin_plays_from_board_view) {
+  static BotPlugin_t plugin;
+  static TetrisSession_t session;
+  char error[256] = "";
+  ck_assert(!bot_plugin_load(&plugin, "./no_such_bot.so", 1, 1, error,
+                             sizeof(error)));
+  ck_assert(error[0] != '\0');
+  ck_assert(bot_plugin_load(&plugin, "./greedy_bot.so", 1, 3, error,
+                            sizeof(error)));
+  ck_assert_str_eq(plugin.api->name, "greedy");
+
+  session_init(&session, 11, RNG_BAG);
+  ck_assert_int_eq(bot_plugin_move(&plugin, &session), BOT_MOVE_IDLE);
+  session_input(&session, Start);
+  session_settle(&session);
+
+  for (int i = 0; i < 60; i++) {
+    ck_assert_int_eq(bot_plugin_move(&plugin, &session), BOT_MOVE_PLACED);
+    // Бот видел ровно те фигуры, которые потом выпали
+    ck_assert_int_eq(session.block.name, plugin.queue[0]);
+    ck_assert_int_eq(next_figure_type(session.info.next), plugin.queue[1]);
+    ck_assert_ptr_eq(plugin.view.rows, plugin.frame.rows);
+  }
+  ck_assert_uint_eq(session.engine.pieces, 60);
+  ck_assert_uint_gt(session.engine.lines, 10);
+  bot_plugin_unload(&plugin);
+  ck_assert_ptr_null(plugin.handle);
+}
+END_TEST
+
+START_TEST(test_game_clock_keeps_fractional_time) {
+  GameClock_t clock = {0, false};
+  uint64_t interval = game_tick_interval(1);
+  ck_assert_uint_eq(interval, 666666666ULL);
+  ck_assert_uint_eq(game_tick_interval(40), GAME_TICK_MIN_NS);
+
+  uint64_t start = 1000000000ULL;
+  ck_assert_int_eq(game_clock_advance(&clock, start, 1, PAUSE_OFF), 1);
+  // Опрос с неровным шагом не сдвигает расписание тиков
+  int ticks = 0;
+  for (uint64_t now = start; now <= start + 1000 * interval; now += 7777777) {
+    ticks += game_clock_advance(&clock, now, 1, PAUSE_OFF);
+  }
+  ticks += game_clock_advance(&clock, start + 1000 * interval, 1, PAUSE_OFF);
+  ck_assert_int_eq(ticks, 1000);
+  ck_assert_uint_eq(clock.next_tick, start + 1001 * interval);
+
+  // Долгий кадр отдаёт тики пачками, не теряя ни одного
+  uint64_t late = clock.next_tick + 19 * interval;
+  ck_assert_int_eq(game_clock_advance(&clock, late, 1, PAUSE_OFF),
+                   GAME_TIMER_MAX_TICKS);
+  ck_assert_int_eq(game_clock_advance(&clock, late, 1, PAUSE_OFF),
+                   GAME_TIMER_MAX_TICKS);
+  ck_assert_int_eq(game_clock_advance(&clock, late, 1, PAUSE_OFF), 4);
+  ck_assert_int_eq(game_clock_advance(&clock, late, 1, PAUSE_OFF), 0);
+
+  ck_assert_int_eq(game_clock_advance(&clock, late * 2, 1, PAUSE_ON), 0);
+  ck_assert_int_eq(game_clock_advance(&clock, late * 3, 1, PAUSE_OFF), 1);
+  ck_assert_uint_eq(clock.next_tick, late * 3 + interval);
+}
+END_TEST
+
+START_TEST(test_gravity_fractional_and_20g) {
+  ck_assert_uint_eq(level_gravity(0), GRAVITY_ONE);
+  ck_assert_uint_eq(level_gravity(GAME_LEVEL_CLASSIC), GRAVITY_ONE);
+  ck_assert_uint_eq(level_gravity(GAME_LEVEL_CLASSIC + 1), GRAVITY_ONE / 2);
+  ck_assert_uint_eq(level_gravity(GAME_LEVEL_MAX), GRAVITY_20G);
+
+  int total = 0, most = 0;
+  for (uint32_t tick = 1000; tick < 1000 + 3 * GRAVITY_ONE; tick++) {
+    int cells = gravity_cells(GRAVITY_ONE * 3 / 4, tick);
+    total += cells;
+    if (cells > most) most = cells;
+  }
+  ck_assert_int_eq(total, 3 * GRAVITY_ONE * 3 / 4);
+  ck_assert_int_eq(most, 1);
+  ck_assert_int_eq(gravity_cells(GRAVITY_ONE, 7), 1);
+  ck_assert_int_eq(gravity_cells(GRAVITY_20G, 7), GAME_FIELD_HEIGHT);
+
+  static TetrisSession_t session;
+  session_init(&session, 5, RNG_BAG);
+  session.engine.gravity = GRAVITY_20G;
+  session_input(&session, Start);
+  session_settle(&session);
+  uint32_t pieces = session.engine.pieces;
+  // Фигура падает на дно за один тик, дальше обычная фиксация
+  session_step(&session);
+  erase_temporary_figure(&session.info, &session.block);
+  ck_assert_int_eq(drop_distance(&session.info, &session.block), 0);
+  draw_temporary_figure(&session.info, &session.block);
+  session_step(&session);
+  session_step(&session);
+  ck_assert_uint_eq(session.engine.pieces, pieces + 1);
+}
+END_TEST
+
+START_TEST(test_drop_distance_matches_step_by_step) {
+  static TetrisSession_t session;
+  session_init(&session, 9, RNG_UNIFORM);
+  session.info.pause = PAUSE_OFF;
+  uint64_t hash = 1;
+  for (int row = 8; row < GAME_FIELD_HEIGHT; row++) {
+    for (int col = 0; col < GAME_FIELD_WIDTH; col++) {
+      hash = hash * 6364136223846793005ULL + 1442695040888963407ULL;
+      session.cells[row][col] = (hash >> 62) == 0;
+    }
+  }
+
+  for (int name = I; name <= Z; name++) {
+    for (int rotation = 0; rotation < 4; rotation++) {
+      for (int col = 0; col < GAME_FIELD_WIDTH; col++) {
+        GameBlock_t block = {.name = name, .rotation = rotation, .x = 1,
+                             .y = col};
+        if (check_collision(&session.info, &block, false)) continue;
+        int expected = 0;
+        while (!check_collision(&session.info, &block, true)) {
+          block.x++;
+          expected++;
+        }
+        block.x = 1;
+        ck_assert_int_eq(drop_distance(&session.info, &block), expected);
+        ck_assert_int_eq(fall_down(&session.info, &block), ATTACHING);
+        ck_assert_int_eq(block.x, 1 + expected);
+      }
+    }
+  }
+}
+END_TEST
+
+START_TEST(test_input_queue_das_and_arr) {
+  const uint64_t ms = 1000000ULL;
+  InputQueue_t queue;
+  InputEvent_t event;
+  input_queue_init(&queue, 170 * ms, 50 * ms);
+
+  // Пачка разных клавиш за кадр: всё в очереди, по порядку
+  input_queue_key(&queue, Left, 1000 * ms);
+  input_queue_key(&queue, Up, 1000 * ms);
+  input_queue_key(&queue, Right, 1000 * ms);
+  ck_assert_uint_eq(queue.count, 3);
+  ck_assert(input_queue_pop(&queue, &event));
+  ck_assert_int_eq(event.action, Left);
+  ck_assert(!event.repeat);
+  ck_assert(input_queue_pop(&queue, &event));
+  ck_assert(input_queue_pop(&queue, &event));
+  ck_assert_int_eq(event.action, Right);
+  ck_assert(!input_queue_pop(&queue, &event));
+
+  // Повторы терминала после его задержки включают наш автоповтор
+  input_queue_key(&queue, Right, 1500 * ms);
+  input_queue_key(&queue, Right, 1530 * ms);
+  ck_assert_uint_eq(input_queue_deadline(&queue), 1580 * ms);
+  for (uint64_t t = 1560; t <= 1800; t += 30) {
+    input_queue_key(&queue, Right, t * ms);
+  }
+  input_queue_advance(&queue, 2000 * ms);
+  ck_assert_uint_eq(input_queue_deadline(&queue), 0);
+
+  uint64_t expected = 1530 * ms;
+  ck_assert(input_queue_pop(&queue, &event));
+  ck_assert(!event.repeat);
+  while (input_queue_pop(&queue, &event)) {
+    ck_assert(event.repeat);
+    ck_assert_int_eq(event.action, Right);
+    ck_assert_uint_eq(event.time, expected);
+    expected += 50 * ms;
+  }
+  // Повторы идут до отпускания через 80 мс после последнего 1800
+  ck_assert_uint_eq(event.time, 1880 * ms);
+
+  // Зажатый поворот не крутит фигуру: после первого повтора терминала
+  // остальные отбрасываются
+  input_queue_key(&queue, Up, 3000 * ms);
+  input_queue_key(&queue, Up, 3500 * ms);
+  input_queue_key(&queue, Up, 3530 * ms);
+  input_queue_key(&queue, Up, 3560 * ms);
+  ck_assert_uint_eq(queue.count, 2);
+  while (input_queue_pop(&queue, &event)) ck_assert(!event.repeat);
+
+  // Два быстрых нажатия до задержки терминала - два сдвига
+  input_queue_key(&queue, Left, 5000 * ms);
+  input_queue_key(&queue, Left, 5040 * ms);
+  input_queue_key(&queue, Left, 5070 * ms);
+  ck_assert_uint_eq(queue.count, 3);
+  while (input_queue_pop(&queue, &event)) {
+    ck_assert_int_eq(event.action, Left);
+    ck_assert(!event.repeat);
+  }
+  ck_assert_uint_eq(input_queue_deadline(&queue), 0);
+
+  // ARR = 0 сдвигает до стены сразу после DAS
+  input_queue_init(&queue, 300 * ms, 0);
+  input_queue_key(&queue, Left, 0);
+  input_queue_key(&queue, Left, 250 * ms);
+  input_queue_key(&queue, Left, 280 * ms);
+  ck_assert_uint_eq(queue.count, 2);
+  ck_assert_uint_eq(input_queue_deadline(&queue), 300 * ms);
+  input_queue_advance(&queue, 300 * ms);
+  ck_assert_uint_eq(queue.count, 2 + INPUT_INSTANT_SHIFTS);
+  ck_assert_uint_eq(queue.dropped, 0);
+}
+END_TEST
+
+typedef struct {
+  int listen_fd;
+  int memfd;
+  int messages;
+  uint32_t words[2];  // Число дескрипторов, объявленное в сообщении
+  int copies[2];      // Сколько раз сегмент на самом деле передаётся
+} HandoffShortSender_t;
+
+static bool handoff_send_copies(int client, uint32_t word, int memfd,
+                                int copies) {
+  int fds[4 * HANDOFF_MAX_FDS];
+  for (int i = 0; i < copies; i++) fds[i] = memfd;
+  struct iovec iov = {.iov_base = &word, .iov_len = sizeof(word)};
+  union {
+    char buffer[CMSG_SPACE(sizeof(fds))];
+    struct cmsghdr align;
+  } control;
+  memset(&control, 0, sizeof(control));
+  struct msghdr message = {0};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = CMSG_SPACE(copies * sizeof(int));
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(copies * sizeof(int));
+  memcpy(CMSG_DATA(cmsg), fds, copies * sizeof(int));
+  return sendmsg(client, &message, MSG_NOSIGNAL) > 0;
+}
+
+static void* handoff_short_sender(void* arg) {
+  HandoffShortSender_t* sender = (HandoffShortSender_t*)arg;
+  int client = accept(sender->listen_fd, NULL, NULL);
+  if (client < 0) return NULL;
+
+  // Число дескрипторов в сообщениях не совпадает с обещанным
+  bool sent = true;
+  for (int i = 0; sent && i < sender->messages; i++) {
+    sent = handoff_send_copies(client, sender->words[i], sender->memfd,
+                               sender->copies[i]);
+  }
+  uint8_t ack;
+  if (sent && read(client, &ack, 1) < 0) {
+  }
+  close(client);
+  return NULL;
+}
+
+static int open_fd_count(void) {
+  int count = 0;
+  DIR* dir = opendir("/proc/self/fd");
+  if (!dir) return -1;
+  while (readdir(dir)) count++;
+  closedir(dir);
+  return count;
+}
+
+START_TEST(test_handoff_refusal_closes_segment) {
+  Handoff_t outgoing, incoming;
+  ck_assert(handoff_create(&outgoing, 1));
+  const char* path = "./test/handoff_short.sock";
+  // Обещаем три дескриптора, а передаём только сегмент
+  HandoffShortSender_t sender = {handoff_listen(path), outgoing.memfd, 1,
+                                 {3}, {1}};
+  ck_assert_int_ge(sender.listen_fd, 0);
+
+  int before = open_fd_count();
+  pthread_t thread;
+  ck_assert_int_eq(
+      pthread_create(&thread, NULL, handoff_short_sender, &sender), 0);
+  ck_assert(!handoff_receive(&incoming, path));
+  pthread_join(thread, NULL);
+
+  // Принятая копия сегмента закрыта вместе с сокетом
+  ck_assert_int_eq(open_fd_count(), before);
+
+  // Лишние дескрипторы второго сообщения не помещаются в буфер и
+  // обрезаются ядром, такую передачу нельзя принять, даже если остаток
+  // совпал с объявленным числом
+  int buffer_fds = (int)((CMSG_SPACE((HANDOFF_MAX_FDS + 1) * sizeof(int)) -
+                          CMSG_LEN(0)) /
+                         sizeof(int));
+  sender.messages = 2;
+  sender.words[0] = HANDOFF_MAX_FDS + (uint32_t)buffer_fds;
+  sender.copies[0] = HANDOFF_MAX_FDS + 1;
+  sender.words[1] = (uint32_t)buffer_fds;
+  sender.copies[1] = 4 * HANDOFF_MAX_FDS;
+  ck_assert_int_eq(
+      pthread_create(&thread, NULL, handoff_short_sender, &sender), 0);
+  ck_assert(!handoff_receive(&incoming, path));
+  pthread_join(thread, NULL);
+  ck_assert_int_eq(open_fd_count(), before);
+
+  close(sender.listen_fd);
+  unlink(path);
+  handoff_close(&outgoing);
+}
+END_TEST
+
+typedef struct {
+  Server_t* server;
+  int listen_fd;
+  bool handed_over;
+} ServerHandoffCall_t;
+
+static void* server_handoff_thread(void* arg) {
+  ServerHandoffCall_t* call = (ServerHandoffCall_t*)arg;
+  call->handed_over = server_handoff(call->server, call->listen_fd);
+  return NULL;
+}
+
+START_TEST(test_server_handoff_keeps_clients) {
+  enum { CLIENTS = 20 };
+  const char* path = "./test/server.sock";
+  const char* handoff_path = "./test/server_handoff.sock";
+  static Server_t old_server, new_server;
+  ServerConfig_t config = {.unix_path = path, .loops = 2, .tick_hz = 200};
+  ck_assert(server_start(&old_server, &config));
+
+  // Клиентов больше, чем дескрипторов в одном сообщении SCM_RIGHTS
+  int fds[CLIENTS];
+  uint64_t ids[CLIENTS];
+  ServerReply_t reply;
+  for (int i = 0; i < CLIENTS; i++) {
+    fds[i] = server_client(path);
+    server_call(fds[i], SERVER_REQUEST_START, RNG_BAG, 300 + (uint64_t)i, 1,
+                &reply);
+    ids[i] = reply.session_id;
+  }
+  ck_assert_uint_eq(server_wait_sessions(&old_server, CLIENTS), CLIENTS);
+  TetrisSession_t replica;
+  session_init(&replica, 300, RNG_BAG);
+  session_input(&replica, Start);
+  server_call(fds[0], SERVER_REQUEST_INPUT, Left, 0, 2, &reply);
+  while (replica.engine.tick < reply.tick) session_step(&replica);
+  session_input(&replica, Left);
+  ck_assert_uint_eq(reply.checksum, replica.engine.checksum);
+
+  ServerHandoffCall_t call = {&old_server, handoff_listen(handoff_path),
+                              false};
+  ck_assert_int_ge(call.listen_fd, 0);
+  pthread_t thread;
+  ck_assert_int_eq(
+      pthread_create(&thread, NULL, server_handoff_thread, &call), 0);
+  config.loops = 3;
+  ck_assert(server_resume(&new_server, &config, handoff_path));
+  pthread_join(thread, NULL);
+  ck_assert(call.handed_over);
+  close(call.listen_fd);
+  unlink(handoff_path);
+  ck_assert_int_eq(access(path, F_OK), 0);
+  ck_assert_uint_eq(server_wait_sessions(&new_server, CLIENTS), CLIENTS);
+
+  // Те же соединения, те же партии, игра продолжается с того же места
+  for (int i = 0; i < CLIENTS; i++) {
+    server_call(fds[i], SERVER_REQUEST_STATE, 0, 0, 3, &reply);
+    ck_assert_uint_eq(reply.session_id, ids[i]);
+    ck_assert_int_eq(reply.pause, PAUSE_OFF);
+  }
+  server_call(fds[0], SERVER_REQUEST_INPUT, Right, 0, 4, &reply);
+  while (replica.engine.tick < reply.tick) session_step(&replica);
+  session_input(&replica, Right);
+  ck_assert_uint_eq(reply.checksum, replica.engine.checksum);
+
+  // Новый сервер принимает клиентов на унаследованном сокете
+  int late = server_client(path);
+  server_call(late, SERVER_REQUEST_STATE, 0, 0, 5, &reply);
+  ck_assert_uint_gt(reply.session_id, ids[CLIENTS - 1]);
+  close(late);
+
+  for (int i = 0; i < CLIENTS; i++) close(fds[i]);
+  ck_assert_uint_eq(server_wait_sessions(&new_server, 0), 0);
+  server_stop(&new_server);
+  ck_assert_int_ne(access(path, F_OK), 0);
+}
+END_TEST
+
+START_TEST(test_bot_protocol_skips_rest_of_long_line) {
+  FILE* commands = tmpfile();
+  ck_assert_ptr_nonnull(commands);
+  for (int i = 0; i < BOT_INPUT_MAX; i++) fputc('x', commands);
+  // Хвост длинной строки не должен выполниться как команда
+  fputs("quit\nstate\nquit\n", commands);
+  fflush(commands);
+  rewind(commands);
+
+  int replies[2];
+  ck_assert_int_eq(pipe(replies), 0);
+  ck_assert(bot_protocol_serve(fileno(commands), replies[1]));
+  fclose(commands);
+  close(replies[1]);
+
+  char output[1024];
+  ssize_t got = read(replies[0], output, sizeof(output) - 1);
+  close(replies[0]);
+  ck_assert_int_gt(got, 0);
+  output[got] = '\0';
+  ck_assert(strncmp(output, "error line too long\nstate 0 ", 28) == 0);
+  ck_assert(strstr(output, "\nbye\n") != NULL);
+}
+END_TEST
+
+static int unreachable_choose(void* state, const BotBoardView_t* view,
+                              BotPlacement_t* placement) {
+  (void)state;
+  // Поворот выполним, а колонка за стеной - фигура успеет сдвинуться
+  placement->rotation = (view->rotation + 1) % BOT_ROTATION_COUNT;
+  placement->column = GAME_FIELD_WIDTH + 5;
+  return 0;
+}
+
+START_TEST(test_bot_plugin_rejected_move_keeps_session) {
+  static BotPlugin_t plugin;
+  static TetrisSession_t session;
+  char error[256] = "";
+  ck_assert(bot_plugin_load(&plugin, "./greedy_bot.so", 1, 1, error,
+                            sizeof(error)));
+  session_init(&session, 5, RNG_BAG);
+  session_input(&session, Start);
+  session_settle(&session);
+  ck_assert_int_eq(bot_plugin_move(&plugin, &session), BOT_MOVE_PLACED);
+
+  const BotPluginApi_t* greedy = plugin.api;
+  BotPluginApi_t unreachable = *greedy;
+  unreachable.choose = unreachable_choose;
+  plugin.api = &unreachable;
+
+  GameSnapshot_t before, after;
+  session_save(&session, &before);
+  ck_assert_int_eq(bot_plugin_move(&plugin, &session), BOT_MOVE_REJECTED);
+  session_save(&session, &after);
+  ck_assert_mem_eq(&before, &after, sizeof(before));
+
+  // После отказа бот продолжает с того же места
+  plugin.api = greedy;
+  ck_assert_int_eq(bot_plugin_move(&plugin, &session), BOT_MOVE_PLACED);
+  ck_assert_uint_eq(session.engine.pieces, 2);
+  bot_plugin_unload(&plugin);
+}
+END_TEST
+
 Suite* tetris_suite(void) {
   Suite* s;
   TCase* tc_core;
@@ -1161,6 +3244,83 @@ Suite* tetris_suite(void) {
 
   tcase_add_test(tc_core, test_FSM_MOVING_when_just_spawned);
   tcase_add_test(tc_core, test_FSM_Action_falls_to_filled_line_and_attaches);
+
+  tcase_add_test(tc_core, test_frame_capture_expand_roundtrip);
+  tcase_add_test(tc_core, test_frame_history_view_order);
+  tcase_add_test(tc_core, test_frame_history_clamps_depth);
+
+  tcase_add_test(tc_core, test_piece_rng_reproducible);
+  tcase_add_test(tc_core, test_piece_rng_batch_matches_single);
+  tcase_add_test(tc_core, test_piece_rng_bag_has_every_piece);
+  tcase_add_test(tc_core, test_piece_rng_uniform_distribution);
+
+  tcase_add_test(tc_core, test_replay_roundtrip);
+  tcase_add_test(tc_core, test_replay_long_game_stays_small);
+  tcase_add_test(tc_core, test_replay_rejects_garbage);
+
+  tcase_add_test(tc_core, test_session_replay_reproduces_game);
+  tcase_add_test(tc_core, test_session_keeps_singleton_untouched);
+  tcase_add_test(tc_core, test_session_step_paused);
+
+  tcase_add_test(tc_core, test_replay_index_seek_matches_full_simulation);
+  tcase_add_test(tc_core, test_snapshot_restore_roundtrip);
+
+  tcase_add_test(tc_core, test_io_writer_thread_backend);
+  tcase_add_test(tc_core, test_io_writer_uring_backend);
+  tcase_add_test(tc_core, test_io_writer_rejects_bad_path);
+
+  tcase_add_test(tc_core, test_persist_record_in_data_dir);
+  tcase_add_test(tc_core, test_persist_write_atomic_replaces_file);
+
+  tcase_add_test(tc_core, test_leaderboard_insert_and_rank);
+  tcase_add_test(tc_core, test_leaderboard_recovers_from_log);
+  tcase_add_test(tc_core, test_submit_result_and_load_high_score);
+
+  tcase_add_test(tc_core, test_checkpoint_encode_decode);
+  tcase_add_test(tc_core, test_checkpoint_store_resume_sessions);
+
+  tcase_add_test(tc_core, test_handoff_passes_sessions_and_fds);
+  tcase_add_test(tc_core, test_handoff_rejects_other_layout);
+
+  tcase_add_test(tc_core, test_session_clone_is_independent);
+  tcase_add_test(tc_core, test_session_branch_copy_on_write);
+
+  tcase_add_test(tc_core, test_undo_history_walks_placements);
+
+  tcase_add_test(tc_core, test_tas_rewind_restores_tick_start);
+  tcase_add_test(tc_core, test_tas_script_builds_scenario);
+
+  tcase_add_test(tc_core, test_rollback_late_input_matches_on_time);
+  tcase_add_test(tc_core, test_rollback_two_processes_stay_in_sync);
+
+  tcase_add_test(tc_core, test_server_hosts_independent_sessions);
+  tcase_add_test(tc_core, test_server_gravity_matches_game_timer);
+
+  tcase_add_test(tc_core, test_timer_wheel_fires_on_time);
+
+  tcase_add_test(tc_core, test_server_spectator_follows_deltas);
+
+  tcase_add_test(tc_core, test_battle_queue_and_garbage);
+  tcase_add_test(tc_core, test_battle_routes_attacks_deterministically);
+
+  tcase_add_test(tc_core, test_bot_protocol_answers_pipelined_commands);
+
+  tcase_add_test(tc_core, test_bot_plugin_plays_from_board_view);
+
+  tcase_add_test(tc_core, test_game_clock_keeps_fractional_time);
+
+  tcase_add_test(tc_core, test_gravity_fractional_and_20g);
+  tcase_add_test(tc_core, test_drop_distance_matches_step_by_step);
+
+  tcase_add_test(tc_core, test_input_queue_das_and_arr);
+
+  tcase_add_test(tc_core, test_handoff_refusal_closes_segment);
+
+  tcase_add_test(tc_core, test_server_handoff_keeps_clients);
+
+  tcase_add_test(tc_core, test_bot_protocol_skips_rest_of_long_line);
+
+  tcase_add_test(tc_core, test_bot_plugin_rejected_move_keeps_session);
   suite_add_tcase(s, tc_core);
 
   return s;
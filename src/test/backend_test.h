@@ -3,9 +3,32 @@
 
 #define PAUSE_ON 1
 #include <check.h>
+#include <dirent.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "../brick_game/tetris/backend.h"
+#include "../brick_game/tetris/battle.h"
+#include "../brick_game/tetris/bot_plugin.h"
+#include "../brick_game/tetris/bot_protocol.h"
+#include "../brick_game/tetris/checkpoint.h"
+#include "../brick_game/tetris/frame.h"
+#include "../brick_game/tetris/handoff.h"
+#include "../brick_game/tetris/input_queue.h"
+#include "../brick_game/tetris/io_writer.h"
+#include "../brick_game/tetris/leaderboard.h"
+#include "../brick_game/tetris/persist.h"
+#include "../brick_game/tetris/replay.h"
+#include "../brick_game/tetris/rng.h"
+#include "../brick_game/tetris/rollback.h"
+#include "../brick_game/tetris/session.h"
+#include "../brick_game/tetris/tas.h"
 #include "../common/common.h"
+#include "../server/server.h"
 
 int** create_test_matrix(int size, int fill_value);
 bool is_matrix_empty(int** matrix, int rows, int cols);
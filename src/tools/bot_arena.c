@@ -0,0 +1,87 @@
+/**
+ * @file bot_arena.c
+ * @brief Plays headless games with a bot plugin and measures its speed
+ *
+ * Usage: bot_arena [-g games] [-s seed] [-q preview] [-n pieces] [-b] ./bot.so
+ *
+ * Game i uses seed + i and ends on game over, when the bot gives up or
+ * after -n pieces. Prints lines and score per game and the placements per
+ * second over all games, bot time included. A path without a slash is
+ * looked up by dlopen() in the library path, not in the current directory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../brick_game/tetris/bot_plugin.h"
+
+int main(int argc, char** argv) {
+  long games = 10, pieces_max = 100000, preview = 1;
+  unsigned long long seed = 1;
+  PieceRngMode mode = RNG_UNIFORM;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "g:s:q:n:b")) != -1) {
+    if (opt == 'g') {
+      games = strtol(optarg, NULL, 10);
+    } else if (opt == 's') {
+      seed = strtoull(optarg, NULL, 10);
+    } else if (opt == 'q') {
+      preview = strtol(optarg, NULL, 10);
+    } else if (opt == 'n') {
+      pieces_max = strtol(optarg, NULL, 10);
+    } else if (opt == 'b') {
+      mode = RNG_BAG;
+    } else {
+      optind = argc;
+      break;
+    }
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr,
+            "Usage: %s [-g games] [-s seed] [-q preview] [-n pieces] [-b] "
+            "bot.so\n",
+            argv[0]);
+    return 2;
+  }
+
+  static BotPlugin_t plugin;
+  static TetrisSession_t session;
+  char error[256];
+  unsigned long long placements = 0;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (long game = 0; game < games; game++) {
+    if (!bot_plugin_load(&plugin, argv[optind], seed + (uint64_t)game,
+                         (int)preview, error, sizeof(error))) {
+      fprintf(stderr, "%s: %s\n", argv[0], error);
+      return 1;
+    }
+    session_init(&session, seed + (uint64_t)game, mode);
+    session_input(&session, Start);
+    session_settle(&session);
+
+    BotMoveResult result = BOT_MOVE_PLACED;
+    long placed = 0;
+    while (result == BOT_MOVE_PLACED && placed < pieces_max) {
+      result = bot_plugin_move(&plugin, &session);
+      placed += result == BOT_MOVE_PLACED;
+    }
+    placements += (unsigned long long)placed;
+    printf("game %ld: %ld pieces, %u lines, score %d%s\n", game, placed,
+           session.engine.lines, session.info.score,
+           result == BOT_MOVE_REJECTED  ? ", unreachable pose"
+           : result == BOT_MOVE_GAVE_UP ? ", bot gave up"
+                                        : "");
+    bot_plugin_unload(&plugin);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double elapsed = (double)(end.tv_sec - start.tv_sec) +
+                   (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("%llu placements, %.3f s, %.0f placements/s\n", placements, elapsed,
+         elapsed > 0 ? (double)placements / elapsed : 0.0);
+  return 0;
+}
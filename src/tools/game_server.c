@@ -0,0 +1,137 @@
+/**
+ * @file game_server.c
+ * @brief Hosts headless game sessions for clients on local sockets
+ *
+ * Usage: game_server [-u path] [-p port] [-j loops] [-r hz] [-n max]
+ *                    [-H path | -A path]
+ *
+ * Listens on a Unix socket (-u) and/or on 127.0.0.1 (-p) and serves the
+ * protocol from server/protocol.h until SIGINT or SIGTERM, then prints the
+ * counters of the run.
+ *
+ * With -H the server can be replaced without disconnecting its clients: on
+ * SIGUSR1 it waits on the given handoff socket for the new binary, started
+ * as game_server -A with the same path, hands it every session with the
+ * listening and client sockets and exits. The new server takes its
+ * listening sockets from the old one, -u only names the socket it removes
+ * on exit. If nobody connects within GAME_SERVER_HANDOFF_WAIT_MS or the new
+ * server refuses, the old one keeps serving.
+ */
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../brick_game/tetris/handoff.h"
+#include "../server/server.h"
+
+#define GAME_SERVER_HANDOFF_WAIT_MS 30000
+
+static bool hand_over(Server_t* server, const char* path) {
+  int listen_fd = handoff_listen(path);
+  if (listen_fd < 0) return false;
+
+  // Пока новый процесс запускается, старый продолжает обслуживать клиентов
+  struct pollfd ready = {.fd = listen_fd, .events = POLLIN};
+  bool ok = poll(&ready, 1, GAME_SERVER_HANDOFF_WAIT_MS) == 1 &&
+            server_handoff(server, listen_fd);
+  close(listen_fd);
+  unlink(path);
+  return ok;
+}
+
+/**
+ * Waits for the old server to open the handoff socket, the new one may be
+ * started right after the signal.
+ */
+static bool wait_handoff_socket(const char* path) {
+  for (int waited = 0; waited < GAME_SERVER_HANDOFF_WAIT_MS; waited += 10) {
+    if (access(path, F_OK) == 0) return true;
+    usleep(10000);
+  }
+  return false;
+}
+
+int main(int argc, char** argv) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  ServerConfig_t config = {.unix_path = NULL,
+                           .tcp_port = 0,
+                           .loops = cpus > 4 ? 4 : (int)cpus,
+                           .tick_hz = SERVER_DEFAULT_TICK_HZ,
+                           .max_sessions = 0};
+  const char* handoff_path = NULL;
+  const char* adopt_path = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "u:p:j:r:n:H:A:")) != -1) {
+    if (opt == 'u') {
+      config.unix_path = optarg;
+    } else if (opt == 'p') {
+      config.tcp_port = (int)strtol(optarg, NULL, 10);
+    } else if (opt == 'j') {
+      config.loops = (int)strtol(optarg, NULL, 10);
+    } else if (opt == 'r') {
+      config.tick_hz = (uint32_t)strtoul(optarg, NULL, 10);
+    } else if (opt == 'n') {
+      config.max_sessions = (uint32_t)strtoul(optarg, NULL, 10);
+    } else if (opt == 'H') {
+      handoff_path = optarg;
+    } else if (opt == 'A') {
+      adopt_path = optarg;
+    } else {
+      fprintf(stderr,
+              "Usage: %s [-u path] [-p port] [-j loops] [-r hz] [-n max] "
+              "[-H path | -A path]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  if (!config.unix_path && !config.tcp_port && !adopt_path) {
+    config.unix_path = "./tetris.sock";
+  }
+
+  // Сигналы ждёт только главный поток, потоки цикла их не получают
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  if (handoff_path) sigaddset(&signals, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+  Server_t* server = (Server_t*)malloc(sizeof(Server_t));
+  bool started =
+      server && (adopt_path ? wait_handoff_socket(adopt_path) &&
+                                  server_resume(server, &config, adopt_path)
+                            : server_start(server, &config));
+  if (!started) {
+    fprintf(stderr, "%s: cannot start the server\n", argv[0]);
+    free(server);
+    return 1;
+  }
+
+  ServerStats_t stats;
+  bool handed_over = false;
+  for (;;) {
+    int signal_number;
+    sigwait(&signals, &signal_number);
+    server_stats(server, &stats);
+    if (signal_number != SIGUSR1) break;
+
+    handed_over = hand_over(server, handoff_path);
+    if (handed_over) break;
+    fprintf(stderr, "%s: handoff failed, still serving\n", argv[0]);
+  }
+  if (handed_over) {
+    printf("%u sessions handed over\n", stats.sessions);
+  } else {
+    server_stop(server);
+  }
+  printf("%llu ticks, %llu late, %llu steps, %llu requests\n",
+         (unsigned long long)stats.ticks, (unsigned long long)stats.late_ticks,
+         (unsigned long long)stats.steps, (unsigned long long)stats.requests);
+  printf("%llu spectator frames, %llu keyframes\n",
+         (unsigned long long)stats.frames, (unsigned long long)stats.keyframes);
+  free(server);
+  return 0;
+}
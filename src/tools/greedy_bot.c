@@ -0,0 +1,149 @@
+/**
+ * @file greedy_bot.c
+ * @brief Sample bot plugin that places the falling piece greedily
+ *
+ * Build: gcc -O2 -shared -fPIC -o greedy_bot.so tools/greedy_bot.c
+ *
+ * Tries every rotation and column of the falling piece that can be reached
+ * by rotating in place, sliding and dropping, and keeps the one whose board
+ * scores best on cleared lines, total height, holes and bumpiness. Uses
+ * nothing but bot_abi.h.
+ */
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../brick_game/tetris/bot_abi.h"
+
+#define GREEDY_MAX_HEIGHT 32
+
+typedef struct {
+  uint16_t rows[GREEDY_MAX_HEIGHT];
+  int height;
+  int width;
+} Board_t;
+
+static bool fits(const Board_t* board, const int8_t (*cells)[2], int row,
+                 int column) {
+  for (int i = 0; i < BOT_PIECE_CELLS; i++) {
+    int r = row + cells[i][0];
+    int c = column + cells[i][1];
+    if (r >= board->height || c < 0 || c >= board->width) return false;
+    // Над полем свободно, как и в движке
+    if (r >= 0 && (board->rows[r] >> c) & 1) return false;
+  }
+  return true;
+}
+
+/**
+ * Follows the host's path: rotate at the spawn pose, slide to the column,
+ * drop. Returns the landing row or INT_MIN if the pose is not reachable.
+ */
+static int landing_row(const Board_t* board, const BotBoardView_t* view,
+                       int rotation, int column) {
+  const BotShapeTable_t* shapes = view->shapes;
+  int row = view->row, current = view->rotation, col = view->column;
+
+  while (current != rotation) {
+    current = (current + 1) % BOT_ROTATION_COUNT;
+    if (!fits(board, shapes->cells[view->piece][current], row, col)) {
+      return INT_MIN;
+    }
+  }
+  const int8_t(*cells)[2] = shapes->cells[view->piece][rotation];
+  int direction = column > col ? 1 : -1;
+  while (col != column) {
+    col += direction;
+    if (!fits(board, cells, row, col)) return INT_MIN;
+  }
+  while (fits(board, cells, row + 1, col)) row++;
+  return row;
+}
+
+static long evaluate(const Board_t* board, int cleared) {
+  int heights[16] = {0};
+  long holes = 0, total = 0, bumpiness = 0;
+
+  for (int c = 0; c < board->width; c++) {
+    bool covered = false;
+    for (int r = 0; r < board->height; r++) {
+      bool full = (board->rows[r] >> c) & 1;
+      if (full && !covered) heights[c] = board->height - r;
+      covered |= full;
+      holes += covered && !full;
+    }
+    total += heights[c];
+    if (c) bumpiness += labs((long)heights[c] - heights[c - 1]);
+  }
+  // Веса подобраны вручную, важен только их порядок
+  return 760 * cleared - 510 * total - 3560 * holes - 180 * bumpiness;
+}
+
+static void* greedy_create(uint64_t seed) {
+  (void)seed;
+  static int no_state;
+  return &no_state;
+}
+
+static int greedy_choose(void* state, const BotBoardView_t* view,
+                         BotPlacement_t* placement) {
+  (void)state;
+  if (view->height > GREEDY_MAX_HEIGHT || view->width > 16 ||
+      view->piece < 0 || view->piece >= BOT_PIECE_COUNT) {
+    return 1;
+  }
+
+  Board_t board = {.height = view->height, .width = view->width};
+  memcpy(board.rows, view->rows, (size_t)view->height * sizeof(uint16_t));
+  uint16_t full = (uint16_t)((1u << view->width) - 1);
+  long best = LONG_MIN;
+
+  for (int rotation = 0; rotation < BOT_ROTATION_COUNT; rotation++) {
+    const int8_t(*cells)[2] = view->shapes->cells[view->piece][rotation];
+    for (int column = -2; column < view->width + 2; column++) {
+      int row = landing_row(&board, view, rotation, column);
+      if (row == INT_MIN) continue;
+
+      Board_t after = board;
+      bool above = false;
+      for (int i = 0; i < BOT_PIECE_CELLS; i++) {
+        int r = row + cells[i][0];
+        if (r < 0) {
+          above = true;
+        } else {
+          after.rows[r] |= (uint16_t)(1u << (column + cells[i][1]));
+        }
+      }
+      if (above) continue;
+
+      int cleared = 0, to = after.height - 1;
+      for (int r = after.height - 1; r >= 0; r--) {
+        if (after.rows[r] == full) {
+          cleared++;
+        } else {
+          after.rows[to--] = after.rows[r];
+        }
+      }
+      while (to >= 0) after.rows[to--] = 0;
+
+      long score = evaluate(&after, cleared);
+      if (score > best) {
+        best = score;
+        placement->rotation = rotation;
+        placement->column = column;
+      }
+    }
+  }
+  return best == LONG_MIN;
+}
+
+static const BotPluginApi_t greedy_api = {.abi_version = BOT_ABI_VERSION,
+                                          .name = "greedy",
+                                          .create = greedy_create,
+                                          .choose = greedy_choose,
+                                          .destroy = NULL};
+
+BOT_PLUGIN_ENTRY(version) {
+  return version == BOT_ABI_VERSION ? &greedy_api : NULL;
+}
@@ -0,0 +1,433 @@
+/**
+ * @file load_gen.c
+ * @brief Synthetic clients that load the game server and check its state
+ *
+ * Usage: load_gen [-u path | -p port] [-c clients] [-j threads] [-r rate]
+ *                 [-d seconds] [-b random|drop] [-s seed]
+ *
+ * Every client starts a game and sends one action every 1/rate seconds,
+ * waiting for the reply to the previous one. A headless TetrisSession_t
+ * replays the same actions at the ticks the server reports, so every reply
+ * is checked against the local state. At the end the tool prints the
+ * round-trip latency percentiles, the throughput, the late ticks reported
+ * by the server and the number of state mismatches.
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../brick_game/tetris/session.h"
+#include "../server/protocol.h"
+
+#define LATENCY_SUB_BITS 3
+#define LATENCY_BUCKETS (64 << LATENCY_SUB_BITS)
+#define LOAD_EVENTS_MAX 256
+
+typedef enum { BOT_RANDOM, BOT_DROP } BotKind;
+
+typedef struct {
+  const char* unix_path;
+  int tcp_port;
+  int clients;
+  int threads;
+  double rate;
+  double seconds;
+  BotKind bot;
+  uint64_t seed;
+} LoadOptions_t;
+
+/**
+ * @brief Log-linear histogram of microseconds, 8 buckets per power of two
+ */
+typedef struct {
+  uint64_t counts[LATENCY_BUCKETS];
+  uint64_t total;
+  uint64_t max_us;
+} Histogram_t;
+
+typedef struct {
+  int fd;
+  TetrisSession_t replica;
+  uint64_t seed;
+  uint64_t rng;
+  uint32_t sequence;
+  bool waiting;
+  bool restart;  // После расхождения начать новую партию
+  uint8_t pending_type;
+  uint8_t pending_action;
+  uint64_t sent_ns;
+  uint64_t next_send_ns;
+  uint8_t input[sizeof(ServerReply_t)];
+  size_t input_len;
+  int target_column;
+  uint32_t target_pieces;
+} LoadClient_t;
+
+typedef struct {
+  const LoadOptions_t* options;
+  LoadClient_t* clients;
+  int count;
+  int first;
+  int epoll_fd;
+  pthread_t thread;
+  Histogram_t latency;
+  uint64_t requests;
+  uint64_t replies;
+  uint64_t mismatches;
+  uint64_t failures;
+  uint32_t late_ticks;
+} LoadWorker_t;
+
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t next_random(uint64_t* state) {
+  *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+  return *state >> 33;
+}
+
+static int bucket_of(uint64_t us) {
+  if (us < (1u << LATENCY_SUB_BITS)) return (int)us;
+  int msb = 63 - __builtin_clzll(us);
+  int sub = (int)(us >> (msb - LATENCY_SUB_BITS)) &
+            ((1 << LATENCY_SUB_BITS) - 1);
+  return ((msb - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + sub;
+}
+
+static uint64_t bucket_floor(int bucket) {
+  if (bucket < (1 << LATENCY_SUB_BITS)) return (uint64_t)bucket;
+  int msb = (bucket >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+  uint64_t sub = (uint64_t)(bucket & ((1 << LATENCY_SUB_BITS) - 1));
+  return ((1ULL << LATENCY_SUB_BITS) + sub) << (msb - LATENCY_SUB_BITS);
+}
+
+static void histogram_add(Histogram_t* histogram, uint64_t us) {
+  histogram->counts[bucket_of(us)]++;
+  histogram->total++;
+  if (us > histogram->max_us) histogram->max_us = us;
+}
+
+static uint64_t histogram_percentile(const Histogram_t* histogram,
+                                     double percentile) {
+  uint64_t rank = (uint64_t)(percentile / 100.0 * (double)histogram->total);
+  uint64_t seen = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += histogram->counts[i];
+    if (seen > rank) return bucket_floor(i);
+  }
+  return histogram->max_us;
+}
+
+static int connect_server(const LoadOptions_t* options) {
+  int fd;
+  if (options->unix_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(options->unix_path) >= sizeof(address.sun_path)) return -1;
+    strcpy(address.sun_path, options->unix_path);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 &&
+        connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  } else {
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t)options->tcp_port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 &&
+        connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+      close(fd);
+      fd = -1;
+    }
+    int one = 1;
+    if (fd >= 0) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  if (fd >= 0) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+static UserAction_t choose_action(const LoadOptions_t* options,
+                                  LoadClient_t* client) {
+  const TetrisSession_t* game = &client->replica;
+  if (game->info.pause != PAUSE_OFF) return Start;
+
+  if (options->bot == BOT_DROP) {
+    if (game->engine.pieces != client->target_pieces) {
+      client->target_pieces = game->engine.pieces;
+      client->target_column =
+          (int)(next_random(&client->rng) % GAME_FIELD_WIDTH) - 1;
+    }
+    if (game->block.y < client->target_column) return Right;
+    if (game->block.y > client->target_column) return Left;
+    return Action;
+  }
+
+  static const UserAction_t actions[] = {Left, Right, Up, Down, Action};
+  return actions[next_random(&client->rng) % 5];
+}
+
+static bool send_request(LoadWorker_t* worker, LoadClient_t* client,
+                         uint8_t type, uint8_t action) {
+  ServerRequest_t request = {.type = type,
+                             .action = action,
+                             .mode = RNG_BAG,
+                             .sequence = ++client->sequence,
+                             .seed = client->seed};
+  client->pending_type = type;
+  client->pending_action = action;
+  client->sent_ns = now_ns();
+  client->waiting = true;
+  worker->requests++;
+  return send(client->fd, &request, sizeof(request), MSG_NOSIGNAL) ==
+         (ssize_t)sizeof(request);
+}
+
+/**
+ * Brings the replica to the tick of the reply, applies the same request
+ * and compares the result.
+ */
+static bool replica_matches(LoadClient_t* client, const ServerReply_t* reply) {
+  TetrisSession_t* game = &client->replica;
+
+  if (client->pending_type == SERVER_REQUEST_START) {
+    session_init(game, client->seed, RNG_BAG);
+    session_input(game, Start);
+  } else {
+    while (game->engine.tick < reply->tick) {
+      if (!session_step(game)) return false;
+    }
+    session_input(game, (UserAction_t)client->pending_action);
+  }
+
+  return reply->type == SERVER_REPLY_STATE && reply->sequence ==
+         client->sequence && reply->tick == game->engine.tick &&
+         reply->score == game->info.score &&
+         reply->lines == game->engine.lines &&
+         reply->pieces == game->engine.pieces &&
+         reply->checksum == game->engine.checksum;
+}
+
+static bool read_replies(LoadWorker_t* worker, LoadClient_t* client) {
+  for (;;) {
+    ssize_t n = recv(client->fd, client->input + client->input_len,
+                     sizeof(client->input) - client->input_len, 0);
+    if (n == 0) return false;
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    client->input_len += (size_t)n;
+    if (client->input_len < sizeof(ServerReply_t)) continue;
+
+    ServerReply_t reply;
+    memcpy(&reply, client->input, sizeof(reply));
+    client->input_len = 0;
+
+    uint64_t now = now_ns();
+    histogram_add(&worker->latency, (now - client->sent_ns) / 1000);
+    worker->replies++;
+    if (reply.late_ticks > worker->late_ticks) {
+      worker->late_ticks = reply.late_ticks;
+    }
+    if (!replica_matches(client, &reply)) {
+      worker->mismatches++;
+      client->restart = true;
+    }
+
+    client->waiting = false;
+    uint64_t interval = (uint64_t)(1e9 / worker->options->rate);
+    client->next_send_ns = client->sent_ns + interval;
+  }
+}
+
+static void* worker_thread(void* arg) {
+  LoadWorker_t* worker = (LoadWorker_t*)arg;
+  const LoadOptions_t* options = worker->options;
+  struct epoll_event events[LOAD_EVENTS_MAX];
+
+  for (int i = 0; i < worker->count; i++) {
+    LoadClient_t* client = &worker->clients[i];
+    client->seed = options->seed + (uint64_t)(worker->first + i);
+    client->rng = client->seed * 2 + 1;
+    client->target_pieces = UINT32_MAX;
+    client->fd = connect_server(options);
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = client};
+    if (client->fd < 0 ||
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, client->fd, &event) != 0 ||
+        !send_request(worker, client, SERVER_REQUEST_START, 0)) {
+      worker->failures++;
+      if (client->fd >= 0) close(client->fd);
+      client->fd = -1;
+    }
+  }
+
+  uint64_t end = now_ns() + (uint64_t)(options->seconds * 1e9);
+  for (uint64_t now = now_ns(); now < end; now = now_ns()) {
+    int count = epoll_wait(worker->epoll_fd, events, LOAD_EVENTS_MAX, 1);
+    for (int i = 0; i < count; i++) {
+      LoadClient_t* client = (LoadClient_t*)events[i].data.ptr;
+      if (client->fd >= 0 && !read_replies(worker, client)) {
+        worker->failures++;
+        close(client->fd);
+        client->fd = -1;
+      }
+    }
+
+    now = now_ns();
+    for (int i = 0; i < worker->count; i++) {
+      LoadClient_t* client = &worker->clients[i];
+      if (client->fd < 0 || client->waiting || now < client->next_send_ns) {
+        continue;
+      }
+      bool sent;
+      if (client->restart) {
+        client->restart = false;
+        sent = send_request(worker, client, SERVER_REQUEST_START, 0);
+      } else {
+        sent = send_request(worker, client, SERVER_REQUEST_INPUT,
+                            (uint8_t)choose_action(options, client));
+      }
+      if (!sent) {
+        worker->failures++;
+        close(client->fd);
+        client->fd = -1;
+      }
+    }
+  }
+
+  for (int i = 0; i < worker->count; i++) {
+    if (worker->clients[i].fd >= 0) close(worker->clients[i].fd);
+  }
+  return NULL;
+}
+
+int main(int argc, char** argv) {
+  LoadOptions_t options = {.unix_path = NULL,
+                           .tcp_port = 0,
+                           .clients = 100,
+                           .threads = 4,
+                           .rate = 10.0,
+                           .seconds = 10.0,
+                           .bot = BOT_RANDOM,
+                           .seed = 1};
+  int opt;
+
+  while ((opt = getopt(argc, argv, "u:p:c:j:r:d:b:s:")) != -1) {
+    if (opt == 'u') {
+      options.unix_path = optarg;
+    } else if (opt == 'p') {
+      options.tcp_port = (int)strtol(optarg, NULL, 10);
+    } else if (opt == 'c') {
+      options.clients = (int)strtol(optarg, NULL, 10);
+    } else if (opt == 'j') {
+      options.threads = (int)strtol(optarg, NULL, 10);
+    } else if (opt == 'r') {
+      options.rate = strtod(optarg, NULL);
+    } else if (opt == 'd') {
+      options.seconds = strtod(optarg, NULL);
+    } else if (opt == 'b' && strcmp(optarg, "random") == 0) {
+      options.bot = BOT_RANDOM;
+    } else if (opt == 'b' && strcmp(optarg, "drop") == 0) {
+      options.bot = BOT_DROP;
+    } else if (opt == 's') {
+      options.seed = strtoull(optarg, NULL, 10);
+    } else {
+      fprintf(stderr,
+              "Usage: %s [-u path | -p port] [-c clients] [-j threads] "
+              "[-r rate] [-d seconds] [-b random|drop] [-s seed]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  if (!options.unix_path && !options.tcp_port) {
+    options.unix_path = "./tetris.sock";
+  }
+  if (options.clients < 1) options.clients = 1;
+  if (options.threads < 1) options.threads = 1;
+  if (options.threads > options.clients) options.threads = options.clients;
+  if (options.rate <= 0) options.rate = 1.0;
+
+  LoadClient_t* clients =
+      (LoadClient_t*)calloc((size_t)options.clients, sizeof(LoadClient_t));
+  LoadWorker_t* workers =
+      (LoadWorker_t*)calloc((size_t)options.threads, sizeof(LoadWorker_t));
+  if (!clients || !workers) return 2;
+
+  uint64_t start = now_ns();
+  int first = 0;
+  for (int i = 0; i < options.threads; i++) {
+    LoadWorker_t* worker = &workers[i];
+    worker->options = &options;
+    worker->first = first;
+    worker->count = options.clients / options.threads +
+                    (i < options.clients % options.threads);
+    worker->clients = clients + first;
+    worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    first += worker->count;
+    if (worker->epoll_fd < 0 ||
+        pthread_create(&worker->thread, NULL, worker_thread, worker) != 0) {
+      fprintf(stderr, "%s: cannot start worker %d\n", argv[0], i);
+      return 2;
+    }
+  }
+
+  Histogram_t latency = {{0}, 0, 0};
+  uint64_t requests = 0, replies = 0, mismatches = 0, failures = 0;
+  uint32_t late_ticks = 0;
+  for (int i = 0; i < options.threads; i++) {
+    LoadWorker_t* worker = &workers[i];
+    pthread_join(worker->thread, NULL);
+    close(worker->epoll_fd);
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+      latency.counts[b] += worker->latency.counts[b];
+    }
+    latency.total += worker->latency.total;
+    if (worker->latency.max_us > latency.max_us) {
+      latency.max_us = worker->latency.max_us;
+    }
+    requests += worker->requests;
+    replies += worker->replies;
+    mismatches += worker->mismatches;
+    failures += worker->failures;
+    if (worker->late_ticks > late_ticks) late_ticks = worker->late_ticks;
+  }
+  double elapsed = (double)(now_ns() - start) / 1e9;
+
+  printf("%d clients, %d threads, %.1f s\n", options.clients, options.threads,
+         elapsed);
+  printf("%llu requests, %llu replies, %.0f replies/s\n",
+         (unsigned long long)requests, (unsigned long long)replies,
+         (double)replies / elapsed);
+  printf("rtt us: p50 %llu p90 %llu p99 %llu p99.9 %llu max %llu\n",
+         (unsigned long long)histogram_percentile(&latency, 50),
+         (unsigned long long)histogram_percentile(&latency, 90),
+         (unsigned long long)histogram_percentile(&latency, 99),
+         (unsigned long long)histogram_percentile(&latency, 99.9),
+         (unsigned long long)latency.max_us);
+  printf("server late ticks %u, mismatches %llu, failed clients %llu\n",
+         late_ticks, (unsigned long long)mismatches,
+         (unsigned long long)failures);
+
+  free(workers);
+  free(clients);
+  return mismatches || failures ? 1 : 0;
+}
@@ -0,0 +1,143 @@
+/**
+ * @file replay_verify.c
+ * @brief Re-simulates replay files in parallel and checks their results
+ *
+ * Usage: replay_verify [-j threads] [-q] replay.bgr...
+ *
+ * Every replay is decoded and run through a headless TetrisSession_t at
+ * full speed. Final tick, score, lines, locked pieces and the per-piece
+ * state checksum must match the replay trailer. Exit status is 0 only if
+ * every replay matches.
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../brick_game/tetris/replay.h"
+#include "../brick_game/tetris/session.h"
+
+typedef enum { VERIFY_OK, VERIFY_MISMATCH, VERIFY_INVALID } VerifyStatus;
+
+typedef struct {
+  VerifyStatus status;
+  uint16_t engine_version;
+  ReplaySummary_t expected;
+  ReplaySummary_t actual;
+} VerifyResult_t;
+
+typedef struct {
+  char** paths;
+  VerifyResult_t* results;
+  size_t count;
+  atomic_size_t next;
+} VerifyJob_t;
+
+static VerifyStatus verify_one(const char* path, VerifyResult_t* result) {
+  Replay_t replay;
+  if (!replay_load(path, &replay)) return VERIFY_INVALID;
+
+  TetrisSession_t session;
+  bool ran = session_run_replay(&replay, &session);
+
+  result->engine_version = replay.engine_version;
+  result->expected = replay.summary;
+  session_summary(&session, &result->actual);
+  replay_free(&replay);
+
+  if (!ran) return VERIFY_INVALID;
+
+  const ReplaySummary_t* e = &result->expected;
+  const ReplaySummary_t* a = &result->actual;
+  bool same = e->final_tick == a->final_tick && e->score == a->score &&
+              e->lines == a->lines && e->pieces == a->pieces &&
+              e->checksum == a->checksum;
+  return same ? VERIFY_OK : VERIFY_MISMATCH;
+}
+
+static void* verify_worker(void* arg) {
+  VerifyJob_t* job = (VerifyJob_t*)arg;
+
+  for (size_t i = atomic_fetch_add(&job->next, 1); i < job->count;
+       i = atomic_fetch_add(&job->next, 1)) {
+    VerifyResult_t* result = &job->results[i];
+    memset(result, 0, sizeof(*result));
+    result->status = verify_one(job->paths[i], result);
+  }
+  return NULL;
+}
+
+static void print_result(const char* path, const VerifyResult_t* result) {
+  static const char* names[] = {"OK", "MISMATCH", "INVALID"};
+  const ReplaySummary_t* e = &result->expected;
+  const ReplaySummary_t* a = &result->actual;
+
+  printf("%-8s %s", names[result->status], path);
+  if (result->status == VERIFY_MISMATCH) {
+    printf(" (engine v%u) tick %u/%u score %d/%d lines %u/%u pieces %u/%u"
+           " checksum %016llx/%016llx",
+           result->engine_version, e->final_tick, a->final_tick, e->score,
+           a->score, e->lines, a->lines, e->pieces, a->pieces,
+           (unsigned long long)e->checksum, (unsigned long long)a->checksum);
+  }
+  printf("\n");
+}
+
+int main(int argc, char** argv) {
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  bool quiet = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "j:q")) != -1) {
+    if (opt == 'j') {
+      threads = strtol(optarg, NULL, 10);
+    } else if (opt == 'q') {
+      quiet = true;
+    } else {
+      fprintf(stderr, "Usage: %s [-j threads] [-q] replay.bgr...\n", argv[0]);
+      return 2;
+    }
+  }
+  if (threads < 1) threads = 1;
+
+  VerifyJob_t job = {.paths = argv + optind,
+                     .count = (size_t)(argc - optind),
+                     .next = 0};
+  job.results = (VerifyResult_t*)calloc(job.count + 1, sizeof(VerifyResult_t));
+  pthread_t* workers = (pthread_t*)calloc((size_t)threads, sizeof(pthread_t));
+  if (!job.results || !workers) return 2;
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  long started = 0;
+  for (; started < threads; started++) {
+    if (pthread_create(&workers[started], NULL, verify_worker, &job) != 0) {
+      break;
+    }
+  }
+  if (started == 0) verify_worker(&job);
+  for (long i = 0; i < started; i++) pthread_join(workers[i], NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  size_t failed = 0;
+  for (size_t i = 0; i < job.count; i++) {
+    if (job.results[i].status != VERIFY_OK) failed++;
+    if (!quiet || job.results[i].status != VERIFY_OK) {
+      print_result(job.paths[i], &job.results[i]);
+    }
+  }
+
+  double elapsed = (double)(end.tv_sec - start.tv_sec) +
+                   (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("%zu replays, %zu failed, %ld threads, %.3f s\n", job.count, failed,
+         started ? started : 1, elapsed);
+
+  free(workers);
+  free(job.results);
+  return failed ? 1 : 0;
+}